@@ -6,6 +6,7 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PatternAnalyzer.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/MatrixTester.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/NTupleMaker.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/StubCacheMaker.h"
 
 #include "boost/program_options.hpp"
 #include <cstdlib>
@@ -38,10 +39,11 @@ int main(int argc, char **argv) {
         ("bankGeneration,B"    , "Generate associative memory pattern bank")
         ("patternRecognition,R", "Run associative memory pattern recognition")
         ("matrixBuilding,M"    , "Calculate matrix constants for PCA track fitting")
-        ("trackFitting,T"      , "Perform track fitting")
+        ("trackFitting,T"      , "Perform track fitting (with -R: fit the roads in memory, without writing them)")
         ("bankAnalysis,A"      , "Analyze associative memory pattern bank")
         ("matrixTesting,U"     , "Test matrix constants for PCA track fitting")
         ("write,W"             , "Write full ntuple")
+        ("makeCache"           , "Write the stub and particle branches into a .cache file, accepted as input by every stage")
         ("no-color"            , "Turn off colored text")
         ("timing"              , "Show timing information")
         ;
@@ -54,12 +56,15 @@ int main(int argc, char **argv) {
         ("output,o"     , po::value<std::string>(&option.output)->required(), "Specify output file")
         ("bank,b"       , po::value<std::string>(&option.bankfile), "Specify pattern bank file")
         ("matrix,m"     , po::value<std::string>(&option.matrixfile), "Specify matrix constants file")
-        ("roads"        , po::value<std::string>(&option.roadfile), "Specify file containing the roads")
+        ("roads"        , po::value<std::string>(&option.roadfile), "Specify file containing the roads (with -RT: optional output file for the roads)")
         ("tracks"       , po::value<std::string>(&option.trackfile), "Specify file containing the tracks")
 
         ("verbosity,v"  , po::value<int>(&option.verbose)->default_value(1), "Verbosity level (-1 = very quiet; 0 = quiet, 1 = verbose, 2+ = debug)")
         ("speedup"      , po::value<int>(&option.speedup)->default_value(0), "Speed-up level")
         ("maxEvents,n"  , po::value<long long>(&option.maxEvents)->default_value(-1), "Specfiy max number of events")
+        ("threads,j"    , po::value<int>(&option.threads)->default_value(1), "Specify number of threads")
+        ("readCacheSize", po::value<int>(&option.readCacheSize)->default_value(0), "Specify the size of the input read cache in MB (0: ROOT default)")
+        ("readAhead"    , po::bool_switch(&option.readAhead)->default_value(false), "Unzip the next input entries in a background thread")
 
         ("nLayers"      , po::value<unsigned>(&option.nLayers)->default_value(6), "Specify # of layers")
         ("nFakers"      , po::value<unsigned>(&option.nFakers)->default_value(0), "Specify # of fake superstrips")
@@ -72,7 +77,7 @@ int main(int argc, char **argv) {
         ("superstrip,s" , po::value<std::string>(&option.superstrip)->default_value("ss256_nz2"), "Specify the superstrip definition (default: ss256_nz2)")
 
         // Track fitting algorithm
-        ("algo,f"       , po::value<std::string>(&option.algo)->default_value("LTF"), "Select track fitter -- PCA4: PCA fitter 4 params; PCA5: PCA fitter 5 params; ATF4: ATF fitter 4 params; ATF5: ATF fitter 5 params; LTF: Linearized track fitter (default: LTF)")
+        ("algo,f"       , po::value<std::string>(&option.algo)->default_value("LTF"), "Select track fitter -- PCA4: PCA fitter 4 params; PCA5: PCA fitter 5 params; PCA4-FW: fixed-point PCA fitter 4 params; ATF4: ATF fitter 4 params; ATF5: ATF fitter 5 params; LTF: Linearized track fitter (default: LTF)")
 
         // MC truth
         ("minPt"        , po::value<float>(&option.minPt)->default_value(     2.0), "Specify min pt")
@@ -100,17 +105,27 @@ int main(int argc, char **argv) {
         ("maxMisses"    , po::value<int>(&option.maxMisses)->default_value(0), "Specify max number of allowed misses")
         ("maxStubs"     , po::value<int>(&option.maxStubs)->default_value(999999999), "Specfiy max number of stubs per superstrip")
         ("maxRoads"     , po::value<int>(&option.maxRoads)->default_value(999999999), "Specfiy max number of roads per event")
+        ("parallelFiles", po::bool_switch(&option.parallelFiles)->default_value(false), "Process the files of a .txt input list in parallel, one per thread, and merge the outputs in order")
 
         // Only for matrix building
         ("view"         , po::value<std::string>(&option.view)->default_value("XYZ"), "Specify fit view (e.g. XYZ, XY, RZ)")
         ("hitBits"      , po::value<unsigned>(&option.hitBits)->default_value(0), "Specify hit bits (0: all hit, 1: miss layer 1, ..., 6: miss layer 6)")
+        ("matrixGrid"   , po::bool_switch(&option.matrixGrid)->default_value(false), "Build the matrices for all invPt segments and hit bits (output is a directory)")
+        ("matrixBundle" , po::bool_switch(&option.matrixBundle)->default_value(false), "Convert the text matrices of the tower in the input directory into a binary bundle")
 
         // Only for track fitting
         ("maxChi2"      , po::value<float>(&option.maxChi2)->default_value(5.), "Specify maximum reduced chi-squared")
 	("CutPrincipals", po::bool_switch(&option.CutPrincipals)->default_value(false), "replace chi**2 cut with principals cut")
+        ("earlyReject"  , po::bool_switch(&option.earlyReject)->default_value(false), "Let the PCA fitter stop on combinations that fail the chi2 or principals cut")
         ("minNdof"      , po::value<int>(&option.minNdof)->default_value(1), "Specify minimum degree of freedom")
         ("maxCombs"     , po::value<int>(&option.maxCombs)->default_value(999999999), "Specfiy max number of combinations per road")
         ("maxTracks"    , po::value<int>(&option.maxTracks)->default_value(999999999), "Specfiy max number of tracks per event")
+        ("fwStubBits"   , po::value<unsigned>(&option.fwStubBits)->default_value(14), "Specify number of bits of the stub coordinates in the PCA4-FW fitter")
+        ("fwConstBits"  , po::value<unsigned>(&option.fwConstBits)->default_value(14), "Specify number of bits of the matrix constants in the PCA4-FW fitter")
+        ("parallelRoads", po::value<int>(&option.parallelRoads)->default_value(0), "Specify min number of roads of an event to fit its roads in parallel (0: never)")
+        ("fitCache"     , po::bool_switch(&option.fitCache)->default_value(false), "Fit the identical combinations of an event only once")
+        ("downdate"     , po::bool_switch(&option.downdate)->default_value(false), "Derive the PCA fits of the 5/6 combinations from the 6/6 fits with the same stubs (chi2 selection only)")
+        ("pipeline"     , po::bool_switch(&option.pipeline)->default_value(false), "With -RT, run reading, superstrips, AM lookup, fitting, duplicate removal and writing as concurrent stages, and print the throughput of each stage")
 
 	// Only for Duplicate Flag
         ("rmDuplicate", po::value<int>(&option.rmDuplicate)->default_value(-1), "Duplicate removal option. The argument is the number of max stubs allowed to be shared between AM tracks")
@@ -174,7 +189,8 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    // Exactly one of these options must be selected
+    // Exactly one of these options must be selected, except for '-R' and '-T'
+    // which can be combined as '-RT'
     int vmcount = vm.count("stubCleaning")       +
                   vm.count("bankGeneration")     +
                   vm.count("patternRecognition") +
@@ -182,9 +198,11 @@ int main(int argc, char **argv) {
                   vm.count("trackFitting")       +
                   vm.count("bankAnalysis")       +
                   vm.count("matrixTesting")      +
-                  vm.count("write")              ;
-    if (vmcount != 1) {
-        std::cerr << "ERROR: Must select exactly one of '-C', '-B', '-R', '-M', '-T', '-A', '-U', or 'W'" << std::endl;
+                  vm.count("write")              +
+                  vm.count("makeCache")          ;
+    bool fused = vm.count("patternRecognition") && vm.count("trackFitting");
+    if (vmcount != 1 && !(vmcount == 2 && fused)) {
+        std::cerr << "ERROR: Must select exactly one of '-C', '-B', '-R', '-M', '-T', '-A', '-U', 'W', '-RT', or '--makeCache'" << std::endl;
         //std::cout << visible << std::endl;
         return EXIT_FAILURE;
     }
@@ -201,6 +219,8 @@ int main(int argc, char **argv) {
     if (option.maxEvents < 0)
         option.maxEvents = std::numeric_limits<long long>::max();
 
+    option.threads = std::max(1, option.threads);
+
     option.nLayers = std::min(std::max(3u, option.nLayers), 8u);
     option.nFakers = std::min(std::max(0u, option.nFakers), 3u);
     option.nDCBits = std::min(std::max(0u, option.nDCBits), 4u);
@@ -216,7 +236,19 @@ int main(int argc, char **argv) {
     // _________________________________________________________________________
     // Call the producers
 
-    if (vm.count("stubCleaning")) {
+    if (fused) {
+        std::cout << Color("magenta") << "Start pattern recognition and track fitting..." << EndColor() << std::endl;
+
+        PatternMatcher matcher(option);
+        TrackFitter fitter(option);
+        int exitcode = fitter.run(matcher);
+        if (exitcode) {
+            std::cerr << "An error occurred during pattern recognition and track fitting. Exiting." << std::endl;
+            return exitcode;
+        }
+        std::cout << "Pattern recognition and track fitting " << Color("lgreenb") << "DONE" << EndColor() << "." << std::endl;
+
+    } else if (vm.count("stubCleaning")) {
         std::cout << Color("magenta") << "Start stub cleaning..." << EndColor() << std::endl;
 
         StubCleaner cleaner(option);
@@ -304,6 +336,17 @@ int main(int argc, char **argv) {
         }
         std::cout << "Writing full ntuple " << Color("lgreenb") << "DONE" << EndColor() << "." << std::endl;
 
+    } else if (vm.count("makeCache")) {
+        std::cout << Color("magenta") << "Start writing stub cache..." << EndColor() << std::endl;
+
+        StubCacheMaker maker(option);
+        int exitcode = maker.run();
+        if (exitcode) {
+            std::cerr << "An error occurred during writing stub cache. Exiting." << std::endl;
+            return exitcode;
+        }
+        std::cout << "Writing stub cache " << Color("lgreenb") << "DONE" << EndColor() << "." << std::endl;
+
     }
 
     return EXIT_SUCCESS;
@@ -1,6 +1,7 @@
 #ifndef AMSimulation_CombinationBuilderFactory_h_
 #define AMSimulation_CombinationBuilderFactory_h_
 
+#include <algorithm>
 #include <vector>
 #include <memory>
 #include <iostream>
@@ -13,7 +14,7 @@ class CombinationBuilderFactory
 {
  public:
   // Constructor
-  CombinationBuilderFactory(const bool advancedCombinationBuilder) : verbose_(true)
+  CombinationBuilderFactory(const bool advancedCombinationBuilder) : verbose_(true), ncombinations_(0), icombination_(0)
   {
     // bool advancedCombinationBuilder = false;
     if (advancedCombinationBuilder) combinationBuilder_ = std::make_shared<AdvancedCombinationBuilder>(true);
@@ -59,6 +60,42 @@ class CombinationBuilderFactory
     return combinations;
   }
 
+  // Arrange combinations one at a time: start() then call next() until it returns false.
+  // Only the first maxStubs stubRefs of each layer are used. The Road passed
+  // to the CB is kept until the next start().
+  void start(const std::vector<std::vector<unsigned> >& stubRefs, unsigned maxStubs=BAD)
+  {
+    const std::vector<std::vector<unsigned> > * layers = &stubRefs;
+    for (unsigned i=0; i<stubRefs.size(); ++i) {
+      if (stubRefs[i].size() > maxStubs) {
+        // Truncated copy, in storage kept from one road to the next
+        truncated_.resize(stubRefs.size());
+        for (unsigned j=0; j<stubRefs.size(); ++j)
+          truncated_[j].assign(stubRefs[j].begin(), stubRefs[j].begin() + std::min((unsigned) stubRefs[j].size(), maxStubs));
+        layers = &truncated_;
+        break;
+      }
+    }
+
+    road_ = std::make_shared<Road>(*layers);
+    combinationBuilder_->initialize(*road_);
+    ncombinations_ = combinationBuilder_->totalCombinations();
+    icombination_ = 0;
+  }
+
+  bool next(std::vector<unsigned>& combination)
+  {
+    if (icombination_ >= ncombinations_) return false;
+    ++icombination_;
+
+    StubsCombination stubsCombination(combinationBuilder_->nextCombination());
+    combination.clear();
+    for (auto s : stubsCombination) {
+      combination.push_back(s.stubRef());
+    }
+    return true;
+  }
+
   // Debug
   void print();
 
@@ -66,6 +103,10 @@ class CombinationBuilderFactory
   // Member data
   int verbose_;
   std::shared_ptr<CombinationBuilderBase> combinationBuilder_;
+  std::shared_ptr<Road> road_;
+  int ncombinations_;
+  int icombination_;
+  std::vector<std::vector<unsigned> > truncated_;
 };
 
 }
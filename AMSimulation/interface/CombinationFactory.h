@@ -1,6 +1,7 @@
 #ifndef AMSimulation_CombinationFactory_h_
 #define AMSimulation_CombinationFactory_h_
 
+#include <algorithm>
 #include <vector>
 
 namespace slhcl1tt {
@@ -8,7 +9,7 @@ namespace slhcl1tt {
 class CombinationFactory {
   public:
     // Constructor
-    CombinationFactory() : verbose_(true) {}
+    CombinationFactory() : verbose_(true), groups_(0), done_(true) {}
 
     // Destructor
     ~CombinationFactory() {}
@@ -24,32 +25,37 @@ class CombinationFactory {
         std::vector<T> combination;
         std::vector<std::vector<T> > combinations;
 
-        const int ngroups = groups.size();
-        std::vector<unsigned> indices(ngroups, 0);  // init to zeroes
+        std::vector<unsigned> sizes(groups.size(), 0);
+        for (unsigned i=0; i<groups.size(); ++i)
+            sizes[i] = groups[i].size();
 
-        int i=0, j=0;
-        while (true) {
-            combination.clear();
-            for (i=0; i<ngroups; ++i) {
-                if (groups.at(i).size())
-                    combination.push_back(groups.at(i).at(indices.at(i)));
-                else  // empty group
-                    combination.push_back(CombinationFactory::BAD);
-            }
+        std::vector<unsigned> indices(groups.size(), 0);  // init to zeroes
+        do {
+            fill(groups, sizes, indices, combination);
             combinations.push_back(combination);
+        } while (increment(sizes, indices));
 
-            for (i=ngroups-1; i>=0; --i)
-                if (groups.at(i).size())
-                    if (indices.at(i) != groups.at(i).size() - 1)
-                        break;  // take the last index that has not reached the end
-            if (i == -1)  break;
+        return combinations;
+    }
 
-            indices[i] += 1;  // increment that index
-            for (j=i+1; j<ngroups; ++j)
-                indices[j] = 0;  // set indices behind that index to zeroes
-        }
+    // Arrange combinations one at a time: start() then call next() until it
+    // returns false. Only the first maxSize elements of each group are used.
+    // The groups must stay alive until then.
+    void start(const std::vector<std::vector<unsigned> >& groups, unsigned maxSize=BAD) {
+        groups_ = &groups;
+        const int ngroups = groups.size();
+        sizes_.resize(ngroups);
+        for (int i=0; i<ngroups; ++i)
+            sizes_[i] = std::min((unsigned) groups[i].size(), maxSize);
+        indices_.assign(ngroups, 0);  // init to zeroes
+        done_ = false;
+    }
 
-        return combinations;
+    bool next(std::vector<unsigned>& combination) {
+        if (done_)  return false;
+        fill(*groups_, sizes_, indices_, combination);
+        done_ = !increment(sizes_, indices_);
+        return true;
     }
 
     // Debug
@@ -57,8 +63,44 @@ class CombinationFactory {
 
 
   private:
+    // Set the combination given by the indices, and the sizes of the groups in use
+    template<typename T>
+    static void fill(const std::vector<std::vector<T> >& groups, const std::vector<unsigned>& sizes, const std::vector<unsigned>& indices, std::vector<T>& combination) {
+        const int ngroups = groups.size();
+        combination.resize(ngroups);
+        for (int i=0; i<ngroups; ++i) {
+            if (sizes[i])
+                combination[i] = groups[i][indices[i]];
+            else  // empty group
+                combination[i] = CombinationFactory::BAD;
+        }
+    }
+
+    // Move the indices to the next combination, given the sizes of the
+    // groups in use, return false after the last one
+    static bool increment(const std::vector<unsigned>& sizes, std::vector<unsigned>& indices) {
+        const int ngroups = sizes.size();
+        int i=0, j=0;
+        for (i=ngroups-1; i>=0; --i)
+            if (sizes[i])
+                if (indices[i] != sizes[i] - 1)
+                    break;  // take the last index that has not reached the end
+        if (i == -1)  return false;
+
+        indices[i] += 1;  // increment that index
+        for (j=i+1; j<ngroups; ++j)
+            indices[j] = 0;  // set indices behind that index to zeroes
+        return true;
+    }
+
     // Member data
     int verbose_;
+
+    // State of the combinations arranged one at a time
+    const std::vector<std::vector<unsigned> > * groups_;
+    std::vector<unsigned> sizes_;
+    std::vector<unsigned> indices_;
+    bool done_;
 };
 
 }
@@ -0,0 +1,76 @@
+#ifndef AMSimulation_CovarianceAccumulator_h_
+#define AMSimulation_CovarianceAccumulator_h_
+
+#include "Eigen/Core"
+#include <cmath>
+
+namespace slhcl1tt {
+
+// Accumulate the count, the mean vector and the co-moment matrix
+//   sum_i (x_i - mean) (x_i - mean)^T
+// of a sample. Partial accumulators are combined exactly with the pairwise
+// update of Chan, Golub & LeVeque, so a sample can be split into chunks that
+// are filled independently and merged afterwards.
+// The storage is fixed to MaxDim, no heap allocation is done.
+template<int MaxDim>
+class CovarianceAccumulator {
+  public:
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MaxDim, 1>                   Vector;
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, MaxDim, MaxDim> Matrix;
+
+    // Constructor
+    explicit CovarianceAccumulator(unsigned ndim=MaxDim)
+    : n_(0), means_(Vector::Zero(ndim)), comoments_(Matrix::Zero(ndim, ndim)) {}
+
+    // Add one entry
+    template<typename Derived>
+    void fill(const Eigen::MatrixBase<Derived>& x) {
+        ++n_;
+        const Vector delta = x - means_;
+        means_ += delta / double(n_);
+        comoments_.noalias() += delta * (x - means_).transpose();
+    }
+
+    // Combine with another accumulator
+    void merge(const CovarianceAccumulator& other) {
+        if (other.n_ == 0)
+            return;
+        if (n_ == 0) {
+            *this = other;
+            return;
+        }
+
+        const double n = double(n_) + double(other.n_);
+        const Vector delta = other.means_ - means_;
+        means_ += delta * (double(other.n_) / n);
+        comoments_ += other.comoments_;
+        comoments_.noalias() += (delta * delta.transpose()) * (double(n_) * double(other.n_) / n);
+        n_ += other.n_;
+    }
+
+    unsigned      getDimension()   const { return means_.size(); }
+    long int      getEntries()     const { return n_; }
+    const Vector& getMeans()       const { return means_; }
+    const Matrix& getComoments()   const { return comoments_; }
+
+    // Covariance matrix, divided by n as the running estimate it replaces
+    // (and as Statistics), so the matrices do not change
+    Matrix getCovariances() const {
+        if (n_ == 0)
+            return Matrix::Zero(means_.size(), means_.size());
+        return comoments_ / double(n_);
+    }
+
+    double getMean(unsigned i)     const { return means_(i); }
+    double getVariance(unsigned i) const { return (n_ == 0) ? 0. : comoments_(i,i) / double(n_); }
+    double getSigma(unsigned i)    const { return std::sqrt(getVariance(i)); }
+
+  private:
+    long int n_;
+    Vector   means_;
+    Matrix   comoments_;
+};
+
+}  // namespace slhcl1tt
+
+#endif
@@ -4,10 +4,17 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTTrackReader.h"
 #include <vector>
 #include <algorithm>
+#include <unordered_map>
+#include <stdint.h>
 
 
 namespace slhcl1tt {
 
+// Greedy duplicate removal: the tracks are taken in order of chi2/ndof, and
+// a track is dropped if it shares more than dupRm stubs with any track
+// already accepted. The stubs of the accepted tracks are indexed by
+// (layer, stubRef), so a track is only compared to the accepted tracks it
+// shares a stub with. The buffers are kept between calls.
 class DuplicateRemoval {
   public:
     // Constructor
@@ -16,8 +23,22 @@ class DuplicateRemoval {
     // Destructor
     ~DuplicateRemoval() {}
 
-    // Return flags categorizing as duplicate (1) or not (0)
+    // Remove the duplicate tracks, the unique tracks are kept in order of chi2/ndof
     void CheckTracks(std::vector<TTTrack2>& full_am_track_list, int dupRm);
+
+  private:
+    // Track indices sorted by chi2/ndof, then the indices of the unique tracks
+    std::vector<unsigned> order_;
+    std::vector<unsigned> accepted_;
+
+    // (layer, stubRef) -> unique track
+    std::unordered_multimap<uint64_t, unsigned> stubIndex_;
+
+    // Number of stubs shared with the current track, per track
+    std::vector<int>      sharedStubs_;
+    std::vector<unsigned> touched_;
+
+    std::vector<char>     done_;
 };
 
 }
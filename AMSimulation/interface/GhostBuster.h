@@ -1,6 +1,9 @@
 #ifndef AMSimulation_GhostBuster_h_
 #define AMSimulation_GhostBuster_h_
 
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTTrack2.h"
+#include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 namespace slhcl1tt {
@@ -8,7 +11,7 @@ namespace slhcl1tt {
 class GhostBuster {
   public:
     // Constructor
-    GhostBuster() {}
+    GhostBuster() : verbose_(1), nlayers_(0) {}
 
     // Destructor
     ~GhostBuster() {}
@@ -20,14 +23,34 @@ class GhostBuster {
     bool isGhostRoad(const std::vector<unsigned>& superstripIds1, const std::vector<unsigned>& superstripIds2, const unsigned threshold=2) const;
 
     // Is track 2 a ghost of track 1?
-    bool isGhostTrack(const std::vector<unsigned>& stubRefs1, const std::vector<unsigned>& stubRefs2, const unsigned threshold=2) const;
+    bool isGhostTrack(const TTConstSpan<unsigned>& stubRefs1, const TTConstSpan<unsigned>& stubRefs2, const unsigned threshold=2) const;
+
+    // Flag track i as ghost if isGhostTrack() is true for any non-ghost track
+    // j < i, same as comparing all pairs in order. Each track is put in
+    // buckets keyed by its stubRefs with a few layers masked out, such that
+    // two tracks that can be ghosts of each other share a bucket, and only the
+    // tracks in the same buckets are compared.
+    void flagGhostTracks(std::vector<TTTrack2>& tracks, const unsigned threshold=2);
 
     // Debug
     void print();
 
   private:
+    // Layers that may be masked out in a bucket key, given the layers
+    // without stub, and the number of other layers that may be masked out
+    void getKeyMasks(const unsigned badMask, const unsigned nmasked, std::vector<unsigned>& keyMasks) const;
+
+    uint64_t getKey(const unsigned * stubRefs, const unsigned keyMask) const;
+
     // Member data
     int verbose_;
+
+    // Buckets, reused from event to event
+    unsigned nlayers_;
+    std::vector<unsigned> stubRefs_;  // stubRefs of all tracks, flattened
+    std::vector<unsigned> badMasks_;  // layers without stub of all tracks
+    std::unordered_multimap<uint64_t, unsigned> buckets_;
+    std::vector<unsigned> keyMasks_;
 };
 
 }
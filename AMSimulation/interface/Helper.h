@@ -2,6 +2,7 @@
 #define AMSimulation_Helper_h_
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/Helper.h"
+#include <utility>
 
 
 namespace slhcl1tt {
@@ -59,6 +60,38 @@ inline unsigned compressLayer(const unsigned& lay) {
     return 255;
 }
 
+/// Containers
+
+// Keep v[indices[0]], v[indices[1]], ... in this order, moving the elements
+// in place. The indices must be distinct. They are extended to a permutation
+// of v, which is applied cycle by cycle; done is a scratch buffer.
+template<typename T>
+void selectInPlace(std::vector<T>& v, std::vector<unsigned>& indices, std::vector<char>& done) {
+    const unsigned n = v.size(), nkept = indices.size();
+
+    done.assign(n, 0);
+    for (unsigned k=0; k<nkept; ++k)  done[indices[k]] = 1;
+    for (unsigned i=0; i<n; ++i)
+        if (!done[i])  indices.push_back(i);
+
+    done.assign(n, 0);
+    for (unsigned k=0; k<nkept; ++k) {
+        if (done[k] || indices[k] == k)  continue;
+        T tmp = std::move(v[k]);
+        unsigned j = k;
+        while (indices[j] != k) {
+            v[j] = std::move(v[indices[j]]);
+            done[j] = 1;
+            j = indices[j];
+        }
+        v[j] = std::move(tmp);
+        done[j] = 1;
+    }
+
+    v.resize(nkept);
+    indices.resize(nkept);
+}
+
 }  // namespace slhcl1tt
 
 #endif
@@ -3,6 +3,7 @@
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TrackingParticle.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTTrack2.h"
+#include <utility>
 #include <vector>
 
 namespace slhcl1tt {
@@ -50,6 +51,21 @@ class MCTruthAssociator {
     void print();
 
   private:
+    // Parameter resolutions of a reco track, they depend on its invPt only
+    struct Resolutions {
+        float invPt;
+        float phi0;
+        float cottheta;
+        float z0;
+    };
+
+    float matchChi2(const TrackingParticle& trkPart, const TTTrack2& track, const Resolutions& res) const;
+
+    // Per-event buffers: resolutions of the reco tracks, (invPt, index) of
+    // the reco tracks sorted by invPt, and the candidates of a particle
+    std::vector<Resolutions> resolutions_;
+    std::vector<std::pair<float, unsigned> > byInvPt_;
+    std::vector<unsigned> candidates_;
 
     // Member data
     //float rms_invPt_;
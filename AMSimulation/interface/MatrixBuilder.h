@@ -1,7 +1,9 @@
 #ifndef AMSimulation_MatrixBuilder_h_
 #define AMSimulation_MatrixBuilder_h_
 
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/CovarianceAccumulator.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/MatrixEventCache.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ProgramOption.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoPCA.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TriggerTowerMap.h"
@@ -50,6 +52,17 @@ class MatrixBuilder {
         meansR_ = Eigen::VectorXd::Zero(6);
         meansR_ << 22.5913, 35.4772, 50.5402, 68.3101, 88.5002, 107.71;
 
+        // Either a single matrix, or all invPt segments and hit bits
+        if (po.matrixGrid || po.matrixBundle) {
+            nsegments_ = PCA_NSEGMENTS;
+            for (unsigned hb=0; hb<PCA_NHITBITS; ++hb)
+                hitBitsList_.push_back(hb);
+        } else {
+            nsegments_ = 1;
+            hitBitsList_.push_back(po.hitBits);
+        }
+        mats_.resize(nslots());
+
         // Initialize
         ttmap_ = new TriggerTowerMap();
         ttmap_->read(po_.datadir);
@@ -65,31 +78,85 @@ class MatrixBuilder {
 
 
   private:
+    // Up to 12 variables plus 5 parameters
+    typedef CovarianceAccumulator<17> Accumulator;
+
+    // One coordinate per layer
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, 6, 1> LayerVector;
+
+    // One object per matrix slot, merged element by element
+    template<typename T>
+    struct SlotSet : public std::vector<T> {
+        SlotSet(unsigned n, const T& value) : std::vector<T>(n, value) {}
+
+        void merge(const SlotSet& other) {
+            for (unsigned i=0; i<this->size(); ++i)
+                this->at(i).merge(other.at(i));
+        }
+    };
+
+    // Statistics of the fit results
+    struct EvalStatistics {
+        EvalStatistics(unsigned nvariables, unsigned nparameters)
+        : statCT(2), statX(nvariables), statV(nvariables), statP(nparameters), statP100GeV(nparameters) {}
+
+        void merge(const EvalStatistics& other) {
+            statCT.merge(other.statCT);
+            statX.merge(other.statX);
+            statV.merge(other.statV);
+            statP.merge(other.statP);
+            statP100GeV.merge(other.statP100GeV);
+        }
+
+        Accumulator statCT, statX, statV, statP, statP100GeV;
+    };
+
+    typedef SlotSet<Accumulator>    AccumulatorSet;
+    typedef SlotSet<EvalStatistics> EvalStatisticsSet;
+
     // Member functions
 
     // Book histograms
     int bookHistograms();
 
     // Set certain variables to zero
-    int setVariableToZero(Eigen::VectorXd& variables1, Eigen::VectorXd& variables2, Eigen::VectorXd& variables3, const unsigned hitBits);
-    int setRotationToZero(Eigen::MatrixXd& rotation, const unsigned nvariables, const unsigned hitBits);
-    int setCovarianceToUnit(Eigen::MatrixXd& covariances, const unsigned nvariables, const unsigned hitBits);
+    int setVariableToZero(LayerVector& variables1, LayerVector& variables2, LayerVector& variables3, const unsigned hitBits) const;
+    int setRotationToZero(Eigen::MatrixXd& rotation, const unsigned nvariables, const unsigned hitBits) const;
+    int setCovarianceToUnit(Eigen::MatrixXd& covariances, const unsigned nvariables, const unsigned hitBits) const;
+
+    // Get variables and parameters of a cached event
+    void getVariables(const MatrixEventCache::Block& block, const unsigned ient, const unsigned hitBits,
+                      LayerVector& variables1, LayerVector& variables2, LayerVector& variables3) const;
+    void getParameters(const MatrixEventCache::Block& block, const unsigned ient,
+                       Accumulator::Vector& parameters) const;
+
+    // Get the invPt segment of a cached event (always 0 for a single matrix)
+    unsigned getSegment(const MatrixEventCache::Block& block, const unsigned ient) const;
+
+    // Number of matrices to build; slot = segment * (# hit bits) + index of hit bits
+    unsigned nslots() const { return nsegments_ * hitBitsList_.size(); }
+
+    void printSlot(const unsigned islot) const;
 
     // Build matrices
     int buildMatrices(TString src);
 
+    // Read the text matrices of all invPt segments and hit bits
+    int readMatrices(TString src);
+
     int loopEventsAndFilter(TTStubReader& reader);
 
-    int loopEventsAndSolveCT(TTStubReader& reader);
+    int loopEventsAndSolveCT();
 
-    int loopEventsAndSolveEigenvectors(TTStubReader& reader);
+    int loopEventsAndSolveEigenvectors();
 
-    int loopEventsAndSolveD(TTStubReader& reader);
+    int loopEventsAndSolveD();
 
-    int loopEventsAndEval(TTStubReader& reader);
+    int loopEventsAndEval();
 
     // Write matrices
     int writeMatrices(TString out);
+    int writeBundle(TString out);
     int writeHistograms(TString out);
 
     // Program options
@@ -104,13 +171,19 @@ class MatrixBuilder {
     FitView view_;
     unsigned nvariables_;   // number of hit coordinates or principal components
     unsigned nparameters_;  // number of track parameters
+    unsigned nsegments_;    // number of invPt segments
+    std::vector<unsigned> hitBitsList_;
 
     // Matrices
     Eigen::VectorXd meansR_;
-    PCAMatrix mat_;
+    std::vector<PCAMatrix> mats_;
+
+    // Events that pass the filter, read once from the input
+    MatrixEventCache cache_;
 
-    // Event filter decisions
-    std::vector<bool> keepEvents_;
+    // Outlier rejection decisions for the cached events
+    // (not std::vector<bool>, as it is written by several threads)
+    std::vector<char> keepEvents_;
 
     // Histograms
     std::map<TString, TH1F *>  histograms_;
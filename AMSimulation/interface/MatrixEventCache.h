@@ -0,0 +1,87 @@
+#ifndef AMSimulation_MatrixEventCache_h_
+#define AMSimulation_MatrixEventCache_h_
+
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace slhcl1tt {
+
+// Compact column-wise (SoA) buffer of the events used for matrix building.
+// Each event holds 6 stubs (r, phi, z) plus the sim track parameters.
+// Events are stored in fixed-size blocks. Once the number of blocks in memory
+// exceeds the budget, the following blocks are spilled to a temporary file.
+class MatrixEventCache {
+  public:
+    enum Column {
+        STUB_R = 0,
+        STUB_PHI = 6,
+        STUB_Z = 12,
+        SIM_CHARGEOVERPT = 18,
+        SIM_COTTHETA,
+        SIM_PHI,
+        SIM_VZ,
+        NCOLUMNS
+    };
+
+    static const unsigned NSTUBS     = 6;
+    static const unsigned BLOCK_SIZE = 16384;
+
+    // The data of a block are allocated by the cache, when events are
+    // appended to it or when it is read back from the spill file
+    struct Block {
+        Block() : size(0) {}
+
+        const float * column(unsigned icol) const { return &data[icol * BLOCK_SIZE]; }
+        float * column(unsigned icol) { return &data[icol * BLOCK_SIZE]; }
+
+        const float * r  (unsigned istub) const { return column(STUB_R   + istub); }
+        const float * phi(unsigned istub) const { return column(STUB_PHI + istub); }
+        const float * z  (unsigned istub) const { return column(STUB_Z   + istub); }
+
+        unsigned size;
+        std::vector<float> data;
+    };
+
+    // Constructor
+    MatrixEventCache(unsigned long maxEventsInMemory=8000000);
+
+    // Destructor
+    ~MatrixEventCache();
+
+    // Functions
+    void clear();
+
+    // Append an event
+    void push_back(const float * stubs_r, const float * stubs_phi, const float * stubs_z,
+                   float simChargeOverPt, float simCotTheta, float simPhi, float simVz);
+
+    // Number of events
+    unsigned long size() const { return size_; }
+
+    // Number of blocks
+    unsigned nblocks() const { return blocks_.size(); }
+
+    // Number of blocks spilled to disk
+    unsigned nspilled() const;
+
+    // Retrieve a block; a spilled block is read back into the buffer, which
+    // is only allocated then. Can be called from several threads, each with
+    // its own buffer.
+    const Block& getBlock(unsigned iblock, Block& buffer) const;
+
+  private:
+    void spill(Block * block);
+
+    // Member data
+    unsigned maxBlocksInMemory_;
+    unsigned long size_;
+    std::vector<Block *> blocks_;  // null if spilled
+    std::vector<long>    offsets_; // position in the spill file
+    std::FILE * spillFile_;
+    mutable std::mutex spillMutex_;
+};
+
+}
+
+#endif
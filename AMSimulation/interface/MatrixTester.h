@@ -1,6 +1,7 @@
 #ifndef AMSimulation_MatrixTester_h_
 #define AMSimulation_MatrixTester_h_
 
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/CovarianceAccumulator.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ProgramOption.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TriggerTowerMap.h"
@@ -35,6 +36,9 @@ class MatrixTester {
 
 
   private:
+    // Up to 12 principals
+    typedef CovarianceAccumulator<12> Accumulator;
+
     // Member functions
 
     // Build matrices
@@ -23,6 +23,7 @@ class PCAMatrix {
     Eigen::MatrixXd V;
     Eigen::MatrixXd D;
     Eigen::MatrixXd DV;
+    Eigen::VectorXd invSqrtEigenvalues;  // 0 if the eigenvalue is not positive
 
     unsigned nvariables;
     unsigned nparameters;
@@ -32,6 +33,8 @@ class PCAMatrix {
 
     int write(const std::string txt);
 
+    void computeInvSqrtEigenvalues();
+
     void print();
 };
 
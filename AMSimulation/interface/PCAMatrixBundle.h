@@ -0,0 +1,94 @@
+#ifndef AMSimulation_PCAMatrixBundle_h_
+#define AMSimulation_PCAMatrixBundle_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PCAMatrix.h"
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace slhcl1tt {
+
+// Binary file holding the PCA matrices of all invPt segments and hit bits of
+// one trigger tower. The file is a 64-byte header followed by one fixed-size,
+// 64-byte aligned record per matrix, ordered as segment * nhitbits + hitBits.
+// It is memory-mapped for reading, so loading it does not parse anything.
+class PCAMatrixBundle {
+  public:
+    static const uint32_t VERSION         = 1;
+    static const unsigned MAX_NVARIABLES  = 12;
+    static const unsigned MAX_NPARAMETERS = 5;
+
+    struct Header {
+        char     magic[8];      // "PCAMATRX"
+        uint32_t version;
+        uint32_t headerSize;
+        uint32_t recordSize;
+        uint32_t tower;
+        uint32_t nsegments;
+        uint32_t nhitbits;
+        uint32_t nvariables;
+        uint32_t nparameters;
+        char     padding[24];
+    };
+
+    // Matrices are stored row-major with the maximum dimensions
+    struct alignas(64) Record {
+        uint32_t nvariables;
+        uint32_t nparameters;
+        uint32_t padding[14];
+
+        double meansR[MAX_NVARIABLES/2];
+        double meansC;
+        double meansT;
+        double solutionsC[MAX_NVARIABLES/2];
+        double solutionsT[MAX_NVARIABLES/2];
+
+        double sqrtEigenvalues[MAX_NVARIABLES];
+        double meansX[MAX_NVARIABLES];
+        double meansV[MAX_NVARIABLES];
+        double meansP[MAX_NPARAMETERS];
+        double V [MAX_NVARIABLES][MAX_NVARIABLES];
+        double D [MAX_NPARAMETERS][MAX_NVARIABLES];
+        double DV[MAX_NPARAMETERS][MAX_NVARIABLES];
+    };
+
+    // Constructor
+    PCAMatrixBundle() : data_(0), length_(0), header_(0), records_(0) {}
+
+    // Destructor
+    ~PCAMatrixBundle() { close(); }
+
+    // Map a bundle; returns 1 if the file does not exist, throws if it is invalid
+    int open(const std::string bin);
+
+    void close();
+
+    // Write a bundle from the matrices
+    static int write(const std::string bin, unsigned tower, unsigned nsegments, unsigned nhitbits,
+                     const std::vector<PCAMatrix>& matrices);
+
+    // Accessors
+    const Header& header() const { return *header_; }
+
+    unsigned size() const { return header_ ? header_->nsegments * header_->nhitbits : 0; }
+
+    const Record& record(unsigned i) const { return records_[i]; }
+
+    // Copy a record into a PCAMatrix
+    void get(unsigned i, PCAMatrix& mat) const;
+
+  private:
+    // Non-copyable, it owns the mapping
+    PCAMatrixBundle(const PCAMatrixBundle&);
+    PCAMatrixBundle& operator=(const PCAMatrixBundle&);
+
+    void * data_;
+    std::size_t length_;
+    const Header * header_;
+    const Record * records_;
+};
+
+}  // namespace slhcl1tt
+
+#endif
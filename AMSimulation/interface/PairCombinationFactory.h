@@ -4,36 +4,79 @@
 #include <vector>
 #include <iostream>
 #include <cmath>
-#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/PairAssignment.h"
+#include <stdint.h>
 
 namespace slhcl1tt{
 
+// Combination building with pairwise Delta Delta S cleaning (PDDS).
+// Two stubs in adjacent layers are compatible if their coarsened Delta S
+// differ by less than the cut of that layer pair. A combination is kept if
+// all its adjacent pairs are compatible, and if it has at most one dummy.
+// The compatibility of each layer pair is stored as bitmasks, one per stub,
+// so there can be at most MAX_STUBS stubs per layer, dummy included; the
+// stubs beyond are dropped, and the road is counted in ntruncated().
 class PairCombinationFactory{
   public:
-    PairCombinationFactory() : verbose_(true) {}
-    
+    PairCombinationFactory();
+
     ~PairCombinationFactory() {}
-    
+
     // Enum
     enum Flag { BAD=999999999 };
-    
-    std::vector<std::vector<unsigned> > combine(const std::vector<std::vector<unsigned> >& groups, std::vector<std::vector<float> > DeltaS, bool FiveOfSix);
-    
+
+    static const unsigned MAX_STUBS = 64;
+
+    std::vector<std::vector<unsigned> > combine(const std::vector<std::vector<unsigned> >& groups, const std::vector<std::vector<float> >& DeltaS, bool FiveOfSix);
+
+    //arrange combinations one at a time: start() then call next() until it returns false
+    void start(const std::vector<std::vector<unsigned> >& groups, const std::vector<std::vector<float> >& DeltaS, bool FiveOfSix);
+    //same, with stubDeltaS[stubRef] the DeltaS of a stub, and at most maxStubs stubs per layer
+    void start(const std::vector<std::vector<unsigned> >& groups, const std::vector<float>& stubDeltaS, bool FiveOfSix, unsigned maxStubs);
+    bool next(std::vector<unsigned>& combination);
+
+    //number of roads started with more than MAX_STUBS stubs in a layer
+    long int ntruncated() const { return ntruncated_; }
+
     //debug
     void print();
-    
+
   private:
     int verbose_;
-    
+
     //DDS value coarsening based on layer number
-    float Coarsener(float DeltaS, int precision, int layer);
+    float Coarsener(float DeltaS, int layer) const;
+
+    //compatibility masks of the stubs set by start(), and the first candidates
+    void buildMasks();
+
+    //candidate stubs at a given depth of the search, given the stubs chosen before
+    uint64_t Candidates(unsigned depth) const;
+
+    //stubs of the current road, with a dummy in front if requested
+    unsigned nstubs_[6];
+    unsigned stubs_[6][MAX_STUBS];
+    float    deltaS_[6][MAX_STUBS];
 
-    //central functions
-    std::vector<PairAssignment> Stage1Pair(std::vector<std::pair<unsigned, float> > first, std::vector<std::pair<unsigned, float> > second, float cut);
-    std::vector<std::vector<unsigned> > CombinationBuilder(std::vector<PairAssignment> Layer10, std::vector<PairAssignment> Layer12, std::vector<PairAssignment> Layer32, std::vector<PairAssignment> Layer34, std::vector<PairAssignment> Layer54, unsigned l0, unsigned l2, unsigned l4);
+    //compatibility of the layer pairs (layer, layer+1)
+    //down_[l][i] has bit j set if stub i of layer l and stub j of layer l+1 are compatible
+    //up_[l][j] has bit i set for the same pair
+    uint64_t down_[5][MAX_STUBS];
+    uint64_t up_[5][MAX_STUBS];
+
+    //depth-first search over the layers in the order 1, 0, 3, 2, 5, 4,
+    //which gives the combinations in the order of the original nested loops
+    int      depth_;
+    uint64_t remaining_[6];
+    unsigned chosen_[6];
+    unsigned ndummies_[6];
+
+    //coarsening of Delta S, per layer
+    int      coarsening_[6];
+
+    long int ntruncated_;
 };
 
-    
+
 }
 
 #endif
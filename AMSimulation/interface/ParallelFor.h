@@ -0,0 +1,93 @@
+#ifndef AMSimulation_ParallelFor_h_
+#define AMSimulation_ParallelFor_h_
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace slhcl1tt {
+
+// Call func(i, ithread) for every i in [0, n) using up to nthreads threads,
+// including the calling one, which has ithread = 0. Indices are handed out one
+// at a time, so the result must not depend on which thread processes which
+// index; ithread is meant to select per-thread workspaces. The first exception
+// thrown by func is rethrown in the calling thread.
+template<typename Func>
+void parallelForThread(unsigned n, unsigned nthreads, Func func) {
+    nthreads = std::min(nthreads, n);
+    if (nthreads <= 1) {
+        for (unsigned i=0; i<n; ++i)
+            func(i, 0u);
+        return;
+    }
+
+    std::atomic<unsigned> next(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto work = [&](unsigned ithread) {
+        try {
+            for (unsigned i=next++; i<n; i=next++)
+                func(i, ithread);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error)
+                error = std::current_exception();
+            next = n;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned ithread=1; ithread<nthreads; ++ithread)
+        threads.emplace_back(work, ithread);
+    work(0);
+    for (unsigned ithread=0; ithread<threads.size(); ++ithread)
+        threads.at(ithread).join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// Call func(i) for every i in [0, n) using up to nthreads threads, including
+// the calling one. Indices are handed out one at a time, so the result must
+// not depend on which thread processes which index. The first exception
+// thrown by func is rethrown in the calling thread.
+template<typename Func>
+void parallelFor(unsigned n, unsigned nthreads, Func func) {
+    parallelForThread(n, nthreads, [&](unsigned i, unsigned) { func(i); });
+}
+
+// Call func(i, partial) for every i in [0, n) in parallel, each with its own
+// copy of empty, and merge the partial results with T::merge() in the order
+// of i. A partial result is merged as soon as all the previous ones are, so
+// only a few of them are alive at any time. The result does not depend on
+// the number of threads.
+template<typename T, typename Func>
+T parallelAccumulate(unsigned n, unsigned nthreads, const T& empty, Func func) {
+    T total(empty);
+    std::vector<std::unique_ptr<T> > partials(n);
+    std::mutex mergeMutex;
+    unsigned nmerged = 0;
+
+    parallelFor(n, nthreads, [&](unsigned i) {
+        std::unique_ptr<T> partial(new T(empty));
+        func(i, *partial);
+
+        std::lock_guard<std::mutex> lock(mergeMutex);
+        partials.at(i) = std::move(partial);
+        while (nmerged < n && partials.at(nmerged)) {
+            total.merge(*partials.at(nmerged));
+            partials.at(nmerged).reset();
+            ++nmerged;
+        }
+    });
+    return total;
+}
+
+}  // namespace slhcl1tt
+
+#endif
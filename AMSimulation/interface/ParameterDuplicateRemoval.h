@@ -3,17 +3,11 @@
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTTrackReader.h"
 #include <vector>
+#include <unordered_map>
+#include <stdint.h>
 #include <TVector2.h>
 
 namespace slhcl1tt{
-  class ParameterDuplicateRemoval{
-    public:
-      ParameterDuplicateRemoval() {}
-      ~ParameterDuplicateRemoval() {}
-
-      void ReduceTracks(std::vector<TTTrack2>& Tracks);
-  };
-
   //structure containing necessary original Track information
   struct TrackCloud{
     std::vector<unsigned> TrackIterators;
@@ -24,7 +18,12 @@ namespace slhcl1tt{
     float BestPhi;
     float BestPt; //test
 
-    bool Add(unsigned TrackIterator_, const std::vector<unsigned> &combination_, float Chi2_, float Eta_, float Phi_, float Pt_){ //test
+    //whether a track is inside the window around the best track
+    bool Matches(float Eta_, float Phi_, float Pt_) const{
+      return fabs(Eta_-BestEta)<0.0601 && fabs(TVector2::Phi_mpi_pi(Phi_-BestPhi))<0.00576 && ((BestPt>100. && Pt_>100.) || fabs(BestPt-Pt_)<10.); //test
+    }
+
+    bool Add(unsigned TrackIterator_, const TTConstSpan<unsigned> &combination_, float Chi2_, float Eta_, float Phi_, float Pt_){ //test
       bool ContainsNoDummy=true;
       for(unsigned i=0; i<combination_.size(); ++i){
         if(combination_[i]==999999999) ContainsNoDummy=false;
@@ -39,7 +38,7 @@ namespace slhcl1tt{
         BestTrack=TrackIterator_;
         return true;
       }
-      else if(fabs(Eta_-BestEta)<0.0601 && fabs(TVector2::Phi_mpi_pi(Phi_-BestPhi))<0.00576 && ((BestPt>100. && Pt_>100.) || fabs(BestPt-Pt_)<10.)){ //test
+      else if(Matches(Eta_,Phi_,Pt_)){
         if(Chi2_<BestChi2){    
           BestChi2=Chi2_;
           BestEta=Eta_;
@@ -54,6 +53,26 @@ namespace slhcl1tt{
       else return false;
     }
   };
+
+  //Merges the tracks within an (eta, phi, pt) window of the best track of a
+  //cloud. Each track joins the first cloud that accepts it. The clouds are
+  //binned on an (eta, phi) grid by their best track, with cells at least as
+  //large as the window, so a track only probes the clouds of the 3x3 cells
+  //around it. The buffers are kept between calls.
+  class ParameterDuplicateRemoval{
+    public:
+      ParameterDuplicateRemoval() {}
+      ~ParameterDuplicateRemoval() {}
+
+      void ReduceTracks(std::vector<TTTrack2>& Tracks);
+
+    private:
+      std::vector<TrackCloud> Clouds; //container for merged tracks
+      std::vector<uint64_t> CloudCells; //grid cell of the best track of each cloud
+      std::unordered_multimap<uint64_t, unsigned> Grid; //grid cell -> clouds
+      std::vector<unsigned> UniqueTracks;
+      std::vector<char> Done;
+  };
 }
 
 #endif
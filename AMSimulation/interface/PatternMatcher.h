@@ -2,6 +2,7 @@
 #define AMSimulation_PatternMatcher_h_
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/Pattern.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTRoad.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ProgramOption.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TriggerTowerMap.h"
@@ -11,6 +12,10 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ModuleOverlapMap.h"
 using namespace slhcl1tt;
 
+namespace slhcl1tt {
+class TTStubPlusTPReader;
+}
+
 
 class PatternMatcher {
   public:
@@ -23,6 +28,7 @@ class PatternMatcher {
         // Initialize
         ttmap_ = new TriggerTowerMap();
         ttmap_->read(po_.datadir);
+        ttrmap_ = ttmap_->getTriggerTowerReverseMap(po_.tower);
 
         arbiter_ = new SuperstripArbiter();
         arbiter_->setDefinition(po_.superstrip, po_.tower, ttmap_);
@@ -42,16 +48,59 @@ class PatternMatcher {
     // Main driver
     int run();
 
+    // Load pattern bank
+    int loadPatterns(TString bank);
+
+    // Pattern recognition on the event in the reader, for use by other
+    // stages. The stubs and particles that are not used are nulled in the
+    // reader, as when the roads are written.
+    int matchEvent(TTStubPlusTPReader& reader, long long ievt, std::vector<TTRoad>& roads) {
+        return matchEvent(reader, ievt, hitBuffer_, roads);
+    }
+
+    // Null the stubs outside the trigger tower and the particles that are not
+    // primary, and flag the stubs that are not used by pattern recognition
+    void selectStubs(TTStubPlusTPReader& reader, long long ievt, std::vector<bool>& stubsSkipped) const;
+
+    // The steps of matchEvent(), on stubs that are not in a reader
+
+    // Flag the stubs outside the trigger tower, and the stubs that are not
+    // used by pattern recognition
+    void flagStubs(long long ievt, const std::vector<unsigned>& modId, const std::vector<float>& coordx, const std::vector<float>& coordy,
+                   std::vector<bool>& stubsNotInTower, std::vector<bool>& stubsSkipped) const;
+
+    // Find the superstrip of each stub that is not skipped; returns 1 if
+    // there are way too many stubs
+    int findSuperstrips(const std::vector<unsigned>& modId, const std::vector<float>& coordx, const std::vector<float>& coordy,
+                        const std::vector<float>& r, const std::vector<float>& phi, const std::vector<float>& z, const std::vector<float>& ds,
+                        const std::vector<bool>& stubsSkipped, std::vector<unsigned>& ssIdHashes) const;
+
+    // Associative memory lookup of the superstrips, and roads of the patterns
+    // that fired
+    void findRoads(const std::vector<unsigned>& ssIdHashes, const std::vector<bool>& stubsSkipped, std::vector<TTRoad>& roads) {
+        findRoads(ssIdHashes, stubsSkipped, hitBuffer_, roads);
+    }
+
 
   private:
     // Member functions
 
-    // Load pattern bank
-    int loadPatterns(TString bank);
-
     // Do pattern recognition, write roads (patterns that fired)
     int makeRoads(TString src, TString out);
 
+    // Same as makeRoads(), with the files of a .txt list processed in
+    // parallel, each by one thread with its own reader and writer. The
+    // outputs of the files are then merged in the order of the list.
+    int makeRoadsPerFile(TString src, TString out);
+
+    // Pattern recognition on the first nEvents events of src
+    int matchEvents(TString src, TString out, long long nEvents, HitBuffer& hitBuffer);
+
+    // Pattern recognition on the event in the reader
+    int matchEvent(TTStubPlusTPReader& reader, long long ievt, HitBuffer& hitBuffer, std::vector<TTRoad>& roads);
+
+    void findRoads(const std::vector<unsigned>& ssIdHashes, const std::vector<bool>& stubsSkipped, HitBuffer& hitBuffer, std::vector<TTRoad>& roads);
+
     // Program options
     const ProgramOption po_;
     long long nEvents_;
@@ -64,6 +113,7 @@ class PatternMatcher {
 
     // Operators
     TriggerTowerMap   * ttmap_;
+    std::map<unsigned, bool> ttrmap_;
     SuperstripArbiter * arbiter_;
     ModuleOverlapMap  * momap_;
 
@@ -0,0 +1,272 @@
+#ifndef AMSimulation_Pipeline_h_
+#define AMSimulation_Pipeline_h_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace slhcl1tt {
+
+// Queue of at most capacity items. push() waits while the queue is full and
+// pop() while it is empty. After close(), push() drops the item and returns
+// false, and pop() returns false once the queue is empty.
+template<typename T>
+class BoundedQueue {
+  public:
+    explicit BoundedQueue(unsigned capacity) : capacity_(std::max(1u, capacity)), closed_(false) {}
+
+    bool push(const T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_)
+            return false;
+        items_.push_back(item);
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty())
+            return false;
+        item = items_.front();
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+
+  private:
+    const unsigned capacity_;
+    bool closed_;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable notFull_;
+    std::condition_variable notEmpty_;
+};
+
+
+// Event loop split into stages that run concurrently, each on its own
+// threads, connected by bounded queues. The items are the workspaces of the
+// events in flight: the first stage fills a free item with the next event,
+// the item goes through the stages in the order they were added, and it is
+// free again after the last stage. So at most items.size() events are in
+// flight, and the items keep their memory from one event to the next.
+//
+// A stage is func(item, ithread), which returns 0 on success. Any other value
+// stops the pipeline and is returned by run(); the first stage returns a
+// negative value at the end of the input. The first stage and the ordered
+// stages run on one thread, and an ordered stage gets the items in the order
+// of the first stage. The first exception thrown by a stage is rethrown by
+// run().
+template<typename T>
+class Pipeline {
+  public:
+    typedef std::function<int(T&, unsigned)> Func;
+
+    // Time spent by the threads of a stage, in seconds
+    struct Statistics {
+        std::string name;
+        unsigned    nthreads;
+        long long   nitems;
+        double      busy;  // in func
+        double      idle;  // waiting for items
+    };
+
+    explicit Pipeline(std::vector<T>& items) : items_(items), wall_(0.) {}
+
+    void addStage(const std::string& name, unsigned nthreads, Func func, bool ordered=false) {
+        if (stages_.empty() || ordered)
+            nthreads = 1;
+        Stage stage;
+        stage.func    = func;
+        stage.ordered = ordered;
+        stage.stats.name     = name;
+        stage.stats.nthreads = std::max(1u, nthreads);
+        stage.stats.nitems   = 0;
+        stage.stats.busy     = 0.;
+        stage.stats.idle     = 0.;
+        stages_.push_back(stage);
+    }
+
+    int run() {
+        const unsigned nstages = stages_.size();
+        const unsigned nitems = items_.size();
+        if (!nstages || !nitems)
+            return 0;
+
+        // queues_[i] is in front of stage i, queues_[0] holds the free items.
+        // Each queue can hold all the items, so push() never waits.
+        queues_.clear();
+        for (unsigned istage=0; istage<nstages; ++istage)
+            queues_.emplace_back(new BoundedQueue<Token>(nitems));
+        for (unsigned i=0; i<nitems; ++i)
+            queues_.front()->push(Token{i, 0});
+
+        exitcode_ = 0;
+        error_ = std::exception_ptr();
+        nextSeq_ = 0;
+        for (unsigned istage=0; istage<nstages; ++istage) {
+            stages_.at(istage).stats.nitems = 0;
+            stages_.at(istage).stats.busy   = 0.;
+            stages_.at(istage).stats.idle   = 0.;
+        }
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+        std::vector<std::unique_ptr<std::atomic<unsigned> > > running;
+        for (unsigned istage=0; istage<nstages; ++istage) {
+            running.emplace_back(new std::atomic<unsigned>(stages_.at(istage).stats.nthreads));
+            for (unsigned ithread=0; ithread<stages_.at(istage).stats.nthreads; ++ithread)
+                threads.emplace_back(&Pipeline::work, this, istage, ithread, std::ref(*running.back()));
+        }
+        for (unsigned i=0; i<threads.size(); ++i)
+            threads.at(i).join();
+
+        wall_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (error_)
+            std::rethrow_exception(error_);
+        return exitcode_;
+    }
+
+    // Statistics of the last run()
+    std::vector<Statistics> statistics() const {
+        std::vector<Statistics> stats;
+        for (unsigned istage=0; istage<stages_.size(); ++istage)
+            stats.push_back(stages_.at(istage).stats);
+        return stats;
+    }
+
+    double wall() const { return wall_; }
+
+  private:
+    // An item and the position of its event in the input
+    struct Token {
+        unsigned  item;
+        long long seq;
+    };
+
+    struct Stage {
+        Func       func;
+        bool       ordered;
+        Statistics stats;
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    // Stop all the stages
+    void abort(int exitcode, std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!exitcode_ && !error_) {
+            exitcode_ = exitcode;
+            error_ = error;
+        }
+        for (unsigned i=0; i<queues_.size(); ++i)
+            queues_.at(i)->close();
+    }
+
+    void work(unsigned istage, unsigned ithread, std::atomic<unsigned>& running) {
+        Stage& stage = stages_.at(istage);
+        BoundedQueue<Token>& in  = *queues_.at(istage);
+        BoundedQueue<Token>& out = *queues_.at((istage + 1) % queues_.size());
+
+        long long nitems = 0;
+        Clock::duration busy = Clock::duration::zero(), idle = Clock::duration::zero();
+        std::map<long long, Token> pending;  // ordered stage: items that came early
+        long long next = 0;
+
+        try {
+            Token token;
+            Clock::time_point t0 = Clock::now();
+            while (in.pop(token)) {
+                Clock::time_point t1 = Clock::now();
+                idle += t1 - t0;
+
+                if (istage == 0)
+                    token.seq = nextSeq_++;
+
+                if (stage.ordered)
+                    pending[token.seq] = token;
+
+                // Process the item, or the items that are now in order
+                int exitcode = 0;
+                while (exitcode == 0) {
+                    if (stage.ordered) {
+                        typename std::map<long long, Token>::iterator it = pending.find(next);
+                        if (it == pending.end())  break;
+                        token = it->second;
+                        pending.erase(it);
+                        ++next;
+                    }
+
+                    exitcode = stage.func(items_.at(token.item), ithread);
+                    if (exitcode == 0) {
+                        ++nitems;
+                        out.push(token);
+                    }
+                    if (!stage.ordered)  break;
+                }
+
+                t0 = Clock::now();
+                busy += t0 - t1;
+
+                if (exitcode < 0 && istage == 0)  // end of input
+                    break;
+                if (exitcode != 0) {
+                    abort(exitcode, std::exception_ptr());
+                    break;
+                }
+            }
+        } catch (...) {
+            abort(1, std::current_exception());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stage.stats.nitems += nitems;
+            stage.stats.busy   += std::chrono::duration<double>(busy).count();
+            stage.stats.idle   += std::chrono::duration<double>(idle).count();
+        }
+
+        // The last thread of a stage closes the queue of the next stage; the
+        // free items are not needed any more once the first stage is done
+        if (--running == 0) {
+            if (istage + 1 < queues_.size())
+                queues_.at(istage + 1)->close();
+            if (istage == 0)
+                queues_.front()->close();
+        }
+    }
+
+    std::vector<T>& items_;
+    std::vector<Stage> stages_;
+    std::vector<std::unique_ptr<BoundedQueue<Token> > > queues_;
+    std::mutex mutex_;
+    int exitcode_;
+    std::exception_ptr error_;
+    long long nextSeq_;  // only used by the first stage
+    double wall_;
+};
+
+}  // namespace slhcl1tt
+
+#endif
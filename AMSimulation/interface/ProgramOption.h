@@ -18,6 +18,9 @@ struct ProgramOption {
     int         verbose;
     int         speedup;
     long long   maxEvents;
+    int         threads;
+    int         readCacheSize;
+    bool        readAhead;
 
     unsigned    nLayers;
     unsigned    nFakers;
@@ -44,15 +47,25 @@ struct ProgramOption {
     int         maxMisses;
     int         maxStubs;
     int         maxRoads;
+    bool        parallelFiles;
 
     std::string view;
     unsigned    hitBits;
+    bool        matrixGrid;
+    bool        matrixBundle;
 
     float       maxChi2;
     bool	CutPrincipals;
+    bool        earlyReject;
     int         minNdof;
     int         maxCombs;
     int         maxTracks;
+    unsigned    fwStubBits;
+    unsigned    fwConstBits;
+    int         parallelRoads;
+    bool        fitCache;
+    bool        downdate;
+    bool        pipeline;
 
     int 	rmDuplicate;
     bool        rmParDuplicate;
@@ -0,0 +1,36 @@
+#ifndef AMSimulation_StubCacheMaker_h_
+#define AMSimulation_StubCacheMaker_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ProgramOption.h"
+using namespace slhcl1tt;
+
+
+// Write the genParticle, stub and trkParticle branches of the input into a
+// columnar cache file, which every stage then accepts as input in place of
+// the ntuple (see StubCacheReader)
+class StubCacheMaker {
+  public:
+    // Constructor
+    StubCacheMaker(const ProgramOption& po)
+    : po_(po),
+      nEvents_(po.maxEvents), verbose_(po.verbose) {}
+
+    // Destructor
+    ~StubCacheMaker() {}
+
+    // Main driver
+    int run();
+
+
+  private:
+    // Member functions
+    int makeCache(TString src, TString out);
+
+    // Program options
+    const ProgramOption po_;
+    long long nEvents_;
+    int verbose_;
+};
+
+#endif
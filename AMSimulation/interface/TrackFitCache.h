@@ -0,0 +1,50 @@
+#ifndef AMSimulation_TrackFitCache_h_
+#define AMSimulation_TrackFitCache_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTRoadComb.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTTrack2.h"
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace slhcl1tt {
+
+// Overlapping roads give the same stub combinations. The fit of a
+// combination only depends on its stubRefs, hitBits and ptSegment, so within
+// an event each distinct combination is fitted once, and its track is copied
+// to the other combinations. The road, combination and pattern refs are set
+// on the tracks afterwards, as for any fit.
+class TrackFitCache {
+  public:
+    // Constructor
+    TrackFitCache() : ncombinations_(0), nhits_(0) {}
+
+    // Destructor
+    ~TrackFitCache() {}
+
+    // Copy the distinct combinations of an event to uniques, in order
+    void select(const std::vector<TTRoadComb>& acombs, std::vector<TTRoadComb>& uniques);
+
+    // Copy the tracks fitted from uniques to all the combinations
+    void expand(const std::vector<TTTrack2>& uniqueTracks, std::vector<TTTrack2>& atracks) const;
+
+    // Number of combinations and of combinations not fitted, summed over the events
+    long int ncombinations() const { return ncombinations_; }
+    long int nhits()         const { return nhits_; }
+
+  private:
+    uint64_t getKey(const TTRoadComb& acomb) const;
+
+    bool isSame(const TTRoadComb& acomb1, const TTRoadComb& acomb2) const;
+
+    // Distinct combinations by key, and distinct combination of each combination
+    std::unordered_multimap<uint64_t, unsigned> index_;
+    std::vector<unsigned> sources_;
+
+    long int ncombinations_;
+    long int nhits_;
+};
+
+}  // namespace slhcl1tt
+
+#endif
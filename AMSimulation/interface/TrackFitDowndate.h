@@ -0,0 +1,71 @@
+#ifndef AMSimulation_TrackFitDowndate_h_
+#define AMSimulation_TrackFitDowndate_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTRoadComb.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTTrack2.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoBase.h"
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace slhcl1tt {
+
+// With the 5/6 permutations, most 5/6 combinations have the same stubs as a
+// 6/6 combination of the same road, except in the missing layer. The fit of
+// such a 5/6 combination is derived from the fit of the first of these 6/6
+// combinations by the fitter, instead of a full fit. The other combinations
+// are fitted as usual. The pairs are made within a road, so the result does
+// not depend on how the combinations of an event are split, as long as the
+// roads are not.
+class TrackFitDowndate {
+  public:
+    // Constructor
+    TrackFitDowndate() : ncombinations_(0), nderived_(0) {}
+
+    // Destructor
+    ~TrackFitDowndate() {}
+
+    // Copy the combinations that need a full fit to fulls
+    void select(const std::vector<TTRoadComb>& acombs, std::vector<TTRoadComb>& fulls);
+
+    // Set the tracks of all the combinations, copied from the tracks fitted
+    // from fulls or derived from them
+    int expand(TrackFitterAlgoBase& fitter, const std::vector<TTRoadComb>& acombs,
+               const std::vector<TTTrack2>& fullTracks, std::vector<TTTrack2>& atracks);
+
+    // Same for the combinations in [begin, end), with atracks already of the
+    // size of acombs. The ranges can be done by several threads, each with
+    // its own fitter; the number of derived fits is added to nderived.
+    int expand(TrackFitterAlgoBase& fitter, const std::vector<TTRoadComb>& acombs,
+               const std::vector<TTTrack2>& fullTracks, std::vector<TTTrack2>& atracks,
+               unsigned begin, unsigned end, long int& nderived) const;
+
+    // Count the fits derived by the ranges
+    void addDerived(long int nderived) { nderived_ += nderived; }
+
+    // Number of combinations and of combinations derived, summed over the events
+    long int ncombinations() const { return ncombinations_; }
+    long int nderived()      const { return nderived_; }
+
+  private:
+    // Key of the stubs of a combination without a layer
+    uint64_t getKey(const TTRoadComb& acomb, unsigned layer) const;
+
+    bool isSame(const TTRoadComb& acomb1, const TTRoadComb& acomb2, unsigned layer) const;
+
+    // Copy a combination to fulls[nfulls]
+    void addFull(const TTRoadComb& acomb, unsigned& nfulls, std::vector<TTRoadComb>& fulls) const;
+
+    // 6/6 combinations in fulls by key (empty slots point past them), and for
+    // each combination, its full fit or the 6/6 combination it is derived from
+    std::vector<std::pair<uint64_t, unsigned> > index_;
+    std::vector<unsigned> sources_;
+    std::vector<char>     derived_;
+
+    long int ncombinations_;
+    long int nderived_;
+};
+
+}  // namespace slhcl1tt
+
+#endif
@@ -1,20 +1,35 @@
 #ifndef AMSimulation_TrackFitter_h_
 #define AMSimulation_TrackFitter_h_
 
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTRoad.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/BasicReader.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ProgramOption.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoPCA.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoPCAFW.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoATF.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoLTF.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/CombinationFactory.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/CombinationBuilderFactory.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PairCombinationFactory.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitCache.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitDowndate.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/GhostBuster.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/DuplicateRemoval.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ParameterDuplicateRemoval.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/MCTruthAssociator.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ParallelFor.h"
 using namespace slhcl1tt;
 
+#include <memory>
+
+namespace slhcl1tt {
+class TTStubPlusTPReader;
+class TTRoadReader;
+}
+
+class PatternMatcher;
+
 
 class TrackFitter {
 
@@ -23,64 +38,218 @@ class TrackFitter {
     TrackFitter(const ProgramOption& po) :
       po_(po),
       nEvents_(po.maxEvents), verbose_(po.verbose),
-      prefixRoad_("AMTTRoads_"), prefixTrack_("AMTTTracks_"), suffix_(""),
-      combinationBuilderFactory_(std::make_shared<CombinationBuilderFactory>(po_.FiveOfSix)) {
+      selection_(po.maxChi2, po.CutPrincipals),
+      prefixRoad_("AMTTRoads_"), prefixTrack_("AMTTTracks_"), suffix_("") {
 
         // Decide the track fitter to use
-        fitter_ = 0;
+        TrackFitterAlgoBase * fitter = 0;
         if (po.algo == "PCA4" || po.algo == "PCA5") {
-            fitter_ = new TrackFitterAlgoPCA(po);
+            fitter = new TrackFitterAlgoPCA(po);
+        } else if (po.algo == "PCA4-FW") {
+            fitter = new TrackFitterAlgoPCAFW(po);
         } else if (po.algo == "ATF4") {
-            fitter_ = new TrackFitterAlgoATF(false);
+            fitter = new TrackFitterAlgoATF(false);
         } else if (po.algo == "ATF5") {
-            fitter_ = new TrackFitterAlgoATF(true);
+            fitter = new TrackFitterAlgoATF(true);
         } else if (po.algo == "LTF") {
-            fitter_ = new TrackFitterAlgoLTF(po);
+            fitter = new TrackFitterAlgoLTF(po);
         } else {
             throw std::invalid_argument("unknown track fitter algo.");
         }
+
+        if (po.earlyReject)
+            fitter->setEarlyReject(selection_);
+
+        // The derived 5/6 tracks have no principals to cut on
+        if (po.downdate && po.CutPrincipals) {
+            delete fitter;
+            throw std::invalid_argument("5/6 downdate requires the chi2 selection.");
+        }
+
+        // One worker per thread, the other fitters are clones of the first
+        for (int ithread=0; ithread<std::max(1, po.threads); ++ithread) {
+            if (ithread > 0) {
+                fitter = workers_.front()->fitter->clone();
+                fitter->detachHistograms(Form("_thread%i", ithread));
+            }
+            workers_.emplace_back(new Worker(fitter, po.FiveOfSix));
+        }
     }
 
     // Destructor
-    ~TrackFitter() {
-        if (fitter_)  delete fitter_;
-    }
+    ~TrackFitter() {}
 
     // Main driver
     int run();
 
+    // Main driver of the fused mode, which fits the roads of the matcher
+    // without writing them in between
+    int run(PatternMatcher& matcher);
+
 
   private:
+    // Input of an event, copied from the reader so that events can be
+    // processed by several threads
+    struct RoadEvent {
+        long long ievt;
+        std::vector<unsigned>                             patternRef;
+        std::vector<float>                                patternInvPt;
+        std::vector<std::vector<std::vector<unsigned> > > stubRefs;
+        std::vector<float>                                stubs_r;
+        std::vector<float>                                stubs_phi;
+        std::vector<float>                                stubs_z;
+        std::vector<float>                                stubs_trigBend;
+        std::vector<TrackingParticle>                     trkParts;
+        BranchBuffers                                     branches;  // input branches written with the event
+    };
+
+    // Workspace of an event in the pipeline
+    struct PipelineEvent {
+        RoadEvent                evt;
+        std::vector<unsigned>    stubs_modId;
+        std::vector<float>       stubs_coordx;
+        std::vector<float>       stubs_coordy;
+        std::vector<float>       stubs_trigBend;
+        std::vector<bool>        stubsNotInTower;
+        std::vector<bool>        stubsSkipped;
+        std::vector<unsigned>    ssIdHashes;
+        std::vector<TTRoad>      roads;
+        std::vector<TTTrack2>    tracks;
+        bool                     fitted;
+        bool                     kept;
+    };
+
+    // Everything that is modified while processing an event, one per thread
+    struct Worker {
+        Worker(TrackFitterAlgoBase * f, bool fiveOfSix)
+        : fitter(f), combinationBuilderFactory(std::make_shared<CombinationBuilderFactory>(fiveOfSix)), icomb(0) {}
+
+        // Track fitter
+        std::unique_ptr<TrackFitterAlgoBase> fitter;
+
+        // Combination factory
+        CombinationFactory combinationFactory;
+
+        // pair combination factory
+        PairCombinationFactory pairCombinationFactory;
+
+        // SCB and ACB combination factory
+        std::shared_ptr<CombinationBuilderFactory> combinationBuilderFactory;
+
+        // Ghost buster
+        GhostBuster ghostBuster;
+
+        // Duplicate removal
+        DuplicateRemoval duplicateRemoval;
+        ParameterDuplicateRemoval parameterDuplicateRemoval;
+
+        // MC truth associator
+        MCTruthAssociator truthAssociator;
+
+        // Current combination of a road, and its index
+        std::vector<unsigned> combination;
+        unsigned icomb;
+
+        // Combinations of an event and their fits
+        std::vector<TTRoadComb> acombs;
+        std::vector<TTTrack2> atracks;
+
+        // Combinations that are no longer used, whose vectors are reused by
+        // the next ones
+        std::vector<TTRoadComb> spareCombs;
+
+        // Fit cache, with the distinct combinations of an event and their fits
+        TrackFitCache fitCache;
+        std::vector<TTRoadComb> uniqueCombs;
+        std::vector<TTTrack2> uniqueTracks;
+
+        // 5/6 downdate, with the combinations that need a full fit and their fits
+        TrackFitDowndate fitDowndate;
+        std::vector<TTRoadComb> fullCombs;
+        std::vector<TTTrack2> fullTracks;
+    };
+
     // Member functions
     int makeTracks(TString src, TString out);
 
+    // Same as makeTracks(), with the roads made from the stubs of src by the
+    // matcher. The roads are written to roadOut only if it is not empty.
+    int makeRoadsAndTracks(PatternMatcher& matcher, TString src, TString out, TString roadOut);
+
+    // Same, with reading, superstrips, AM lookup, fitting, duplicate removal
+    // and writing run as concurrent stages
+    int makeRoadsAndTracksPipelined(PatternMatcher& matcher, TString src, TString out, TString roadOut);
+
+    // Copy an event from the reader
+    void readEvent(TTRoadReader& reader, long long ievt, RoadEvent& evt) const;
+
+    // Same, with the roads given
+    void readEvent(const TTStubPlusTPReader& reader, long long ievt, const std::vector<TTRoad>& roads, RoadEvent& evt) const;
+
+    // Copy the roads of an event
+    void readRoads(const std::vector<TTRoad>& roads, RoadEvent& evt) const;
+
+    // Copy the stubs and particles of an event from the reader
+    void readStubs(const TTStubPlusTPReader& reader, long long ievt, RoadEvent& evt) const;
+
+    // Start the fit combinations of a road, returns false if the road is skipped
+    bool startCombinations(const RoadEvent& evt, unsigned iroad, Worker& worker) const;
+
+    // Append the next fit combinations of the road to acombs, at most ncombs
+    // of them; returns true if the road has more
+    bool makeCombinations(const RoadEvent& evt, unsigned iroad, Worker& worker, std::vector<TTRoadComb>& acombs, unsigned ncombs) const;
+
+    // Empty acombs, keeping its elements for the next combinations
+    void recycleCombinations(Worker& worker, std::vector<TTRoadComb>& acombs) const;
+
+    // Fit the combinations, with the 5/6 downdate and the fit cache if requested
+    int fitCombinations(Worker& worker, const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks) const;
+
+    // Fit a block of combinations, append the selected tracks to tracks, and
+    // empty the block
+    void fitBlock(Worker& worker, std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& tracks) const;
+
+    // Append the fitted tracks that pass the selection to tracks
+    void selectTracks(const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks, int fitstatus, std::vector<TTTrack2>& tracks) const;
+
+    // Sort the tracks, flag ghosts and duplicates, and do the truth association;
+    // returns true if any track passes the selection
+    bool finishEvent(const RoadEvent& evt, Worker& worker, std::vector<TTTrack2>& tracks) const;
+
+    // Fit the tracks of an event, returns true if any track passes the selection
+    bool processEvent(const RoadEvent& evt, Worker& worker, std::vector<TTTrack2>& tracks) const;
+
+    // Same, using all the threads for a single event
+    bool processEventOverRoads(const RoadEvent& evt, std::vector<TTTrack2>& tracks) const;
+
+    // First step of processEvent(), without finishEvent(); returns false if
+    // the event has no road
+    bool fitEvent(const RoadEvent& evt, Worker& worker, std::vector<TTTrack2>& tracks) const;
+
+    // Fit the tracks of the first nevents events, in parallel
+    void processEvents(const std::vector<RoadEvent>& events, unsigned nevents, std::vector<std::vector<TTTrack2> >& tracks, std::vector<char>& kept) const;
+
+    // Print the fit cache, 5/6 downdate and PDDS statistics
+    void printStatistics() const;
+
+    // Merge the histograms of the fitters and move them to the current directory
+    void writeHistograms();
+
     // Program options
     const ProgramOption po_;
     long long nEvents_;
     int verbose_;
 
+    // Track selection
+    const TrackSelection selection_;
+
     // Configurations
     const TString prefixRoad_;
     const TString prefixTrack_;
     const TString suffix_;
 
-    // Track fitter
-    TrackFitterAlgoBase * fitter_;
-
-    // Combination factory
-    CombinationFactory combinationFactory_;
-    
-    // pair combination factory
-    PairCombinationFactory pairCombinationFactory_;
-
-    // SCB and ACB combination factory
-    std::shared_ptr<CombinationBuilderFactory> combinationBuilderFactory_;
-
-    // Ghost buster
-    GhostBuster ghostBuster_;
-
-    // MC truth associator
-    MCTruthAssociator truthAssociator_;
+    // Workers
+    std::vector<std::unique_ptr<Worker> > workers_;
 };
 
 #endif
@@ -22,7 +22,16 @@ class TrackFitterAlgoATF : public TrackFitterAlgoBase
 
     int fit(const TTRoadComb& acomb, TTTrack2& atrack);
 
+    TrackFitterAlgoBase * clone() const { return new TrackFitterAlgoATF(*this); }
+
+    static const unsigned NLAYERS = 6;
+
   private:
+    static const unsigned NSUMS = 15;
+
+    // Solve the fit from the sums over the stubs
+    void setTrack(const double * sums, unsigned nstubs, TTTrack2& atrack) const;
+
     bool fiveParameters_;
 };
 
@@ -4,6 +4,7 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTRoadComb.h"
 //#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTTrack.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTTrack2.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackSelection.h"
 
 #include "TString.h"
 #include "TH1F.h"
@@ -20,13 +21,68 @@ enum FitView { XYZ=0, XY, RZ };
 
 class TrackFitterAlgoBase {
   public:
-    TrackFitterAlgoBase() {}
+    TrackFitterAlgoBase() : earlyReject_(false) {}
     virtual ~TrackFitterAlgoBase() {}
 
     virtual int fit(const TTRoadComb& acomb, TTTrack2& atrack) = 0;
 
+    // Make an independent copy of the fitter, to be used in another thread.
+    // The constants are copied, not reloaded.
+    virtual TrackFitterAlgoBase * clone() const = 0;
+
+    // Fit several combinations at once, atracks[i] is the fit of acombs[i]
+    virtual int fitBatch(const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks) {
+        atracks.clear();
+        atracks.resize(acombs.size());
+
+        int status = 0;
+        for (unsigned i=0; i<acombs.size(); ++i)
+            status |= fit(acombs[i], atracks[i]);
+        return status;
+    }
+
+    // Derive the fit of a 5/6 combination from atrack6, the fit of the 6/6
+    // combination with the same stubs in the other layers. Returns false if
+    // the fitter cannot, then the combination has to be fitted.
+    virtual bool fitFiveOfSix(const TTRoadComb& acomb, const TTTrack2& atrack6, TTTrack2& atrack) {
+        return false;
+    }
+
+    // Let the fitter stop on a combination as soon as it is known to fail the
+    // selection. The track of such a combination is left with ndof < 0; the
+    // selection of the other tracks is still up to the caller.
+    void setEarlyReject(const TrackSelection& selection) {
+        earlyReject_ = true;
+        selection_ = selection;
+    }
+
+    // Replace the histograms by empty copies owned by this fitter, so that a
+    // clone does not fill the histograms of the original
+    void detachHistograms(const TString& suffix) {
+        for (std::map<TString, TH1F *>::iterator it=histograms_.begin(); it!=histograms_.end(); ++it) {
+            if (!it->second)  continue;
+            it->second = (TH1F *) it->second->Clone(TString(it->second->GetName()) + suffix);
+            it->second->SetDirectory(0);
+            it->second->Reset();
+        }
+    }
+
+    // Add the histograms of a clone
+    void mergeHistograms(const TrackFitterAlgoBase& other) {
+        for (std::map<TString, TH1F *>::const_iterator it=other.histograms_.begin(); it!=other.histograms_.end(); ++it) {
+            std::map<TString, TH1F *>::iterator found = histograms_.find(it->first);
+            if (it->second && found != histograms_.end() && found->second)
+                found->second->Add(it->second);
+        }
+    }
+
     // Histograms
     std::map<TString, TH1F *>  histograms_;
+
+  protected:
+    // Early rejection
+    bool            earlyReject_;
+    TrackSelection  selection_;
 };
 
 }  // namespace slhcl1tt
@@ -14,7 +14,7 @@ class TrackFitterAlgoLTF : public TrackFitterAlgoBase {
    public:
   TrackFitterAlgoLTF(const slhcl1tt::ProgramOption& po) :
     TrackFitterAlgoBase(),
-      linearizedTrackFitter_(std::make_shared<LinearizedTrackFitter>("LinearizedTrackFit/LinearizedTrackFit/python/", true, 0, true, 14)),
+      linearizedTrackFitter_(makeLinearizedTrackFitter()),
     verbose_(po.verbose)
   {}
 
@@ -22,7 +22,18 @@ class TrackFitterAlgoLTF : public TrackFitterAlgoBase {
 
     int fit(const TTRoadComb& acomb, TTTrack2& atrack);
 
+    // The linearized track fitter has internal state, so a clone gets its own
+    TrackFitterAlgoBase * clone() const {
+        TrackFitterAlgoLTF * fitter = new TrackFitterAlgoLTF(*this);
+        fitter->linearizedTrackFitter_ = makeLinearizedTrackFitter();
+        return fitter;
+    }
+
   private:
+    static std::shared_ptr<LinearizedTrackFitter> makeLinearizedTrackFitter() {
+        return std::make_shared<LinearizedTrackFitter>("LinearizedTrackFit/LinearizedTrackFit/python/", true, 0, true, 14);
+    }
+
     std::shared_ptr<LinearizedTrackFitter> linearizedTrackFitter_;
     int verbose_;
 };
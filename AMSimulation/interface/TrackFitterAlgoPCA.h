@@ -10,6 +10,11 @@ static const unsigned PCA_NHITBITS  = 7;      // 7 layer combinations
 static const float    PCA_MAX_INVPT = +1./2;  // 2 GeV
 static const float    PCA_MIN_INVPT = -1./2;  // 2 GeV
 
+// Index of the invPt segment; out of range if invPt is outside [MIN, MAX)
+inline unsigned getPtSegment(float invPt) {
+    return (invPt - PCA_MIN_INVPT) / (PCA_MAX_INVPT - PCA_MIN_INVPT) * PCA_NSEGMENTS;
+}
+
 
 namespace slhcl1tt {
 
@@ -52,17 +57,39 @@ class TrackFitterAlgoPCA : public TrackFitterAlgoBase {
 
     ~TrackFitterAlgoPCA() {}
 
+    // Returns 1 with an empty track if the combination has no matrix
     int fit(const TTRoadComb& acomb, TTTrack2& atrack);
 
+    TrackFitterAlgoBase * clone() const { return new TrackFitterAlgoPCA(*this); }
+
+    int fitBatch(const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks);
+
+    // Remove the contribution of the missing layer from the 6/6 fit: the phi
+    // and z of the layer are set to the values that minimize the chi2, and the
+    // chi2 and the parameters are corrected to first order (the DeltaR
+    // correction is not redone). XYZ view only. The derived track has no
+    // principals, as they are not in the basis of the 5/6 matrix.
+    bool fitFiveOfSix(const TTRoadComb& acomb, const TTTrack2& atrack6, TTTrack2& atrack);
+
     unsigned nvariables()   const { return nvariables_; }
     unsigned nparameters()  const { return nparameters_; }
     void print();
 
-  private:
+  protected:
     int bookHistograms();
 
     int loadConstants();
 
+    int computeDowndateTerms();
+
+    // Allocation-free fit for the XYZ view (12 variables, 4 or 5 parameters)
+    template<int NPAR>
+    int fitXYZ(const TTRoadComb& acomb, TTTrack2& atrack) const;
+
+    // Batched fit for the XYZ view, one matrix-matrix product per matrix
+    template<int NPAR>
+    int fitBatchXYZ(const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks);
+
     // Settings
     std::string datadir_;
     unsigned    tower_;
@@ -74,6 +101,59 @@ class TrackFitterAlgoPCA : public TrackFitterAlgoBase {
 
     // Matrices
     std::vector<PCAMatrix> matrices;
+
+    // Fixed-size copies of the matrices for the XYZ view
+    struct FixedMatrix {
+        Eigen::Matrix<double, 6, 1>   meansR;
+        Eigen::Matrix<double, 1, 6>   solutionsC;
+        Eigen::Matrix<double, 1, 6>   solutionsT;
+        Eigen::Matrix<double, 12, 1>  meansV;
+        Eigen::Matrix<double, 12, 1>  invSqrtEigenvalues;
+        Eigen::Matrix<double, 5, 1>   meansP;
+        Eigen::Matrix<double, 12, 12> V;
+        Eigen::Matrix<double, 5, 12>  DV;
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    std::vector<FixedMatrix, Eigen::aligned_allocator<FixedMatrix> > fixedMatrices;
+
+    typedef Eigen::Matrix<double, 12, 1> FixedVector;
+
+    // Terms to derive the 5/6 fits from the 6/6 fits, per invPt segment and
+    // missing layer
+    struct DowndateTerms {
+        Eigen::Matrix<double, 12, 2> W;     // derivatives of the normalized chi2 principals by the phi and z of the layer
+        Eigen::Matrix<double, 2, 2>  Hinv;  // (W^T W)^-1
+        Eigen::Matrix<double, 5, 2>  K;     // derivatives of the parameters, times Hinv
+        bool                         valid;
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    std::vector<DowndateTerms, Eigen::aligned_allocator<DowndateTerms> > downdateTerms;
+
+    // Apply the DeltaR correction and return the 12 variables
+    void getVariablesXYZ(const FixedMatrix& mat, const TTRoadComb& acomb, FixedVector& variables) const;
+
+    // Rows [first, last) of the normalized principals that the early
+    // rejection looks at: the chi2 terms, or the principals with a cut
+    template<int NPAR>
+    void getEarlyRowsXYZ(const unsigned hitBits, unsigned& first, unsigned& last) const;
+
+    // Whether the normalized principals in these rows fail the selection
+    bool failsSelectionXYZ(const FixedVector& principals, const unsigned first, const unsigned last) const;
+
+    // Set the track from the normalized principals and the parameters
+    template<int NPAR>
+    void setTrackXYZ(const FixedVector& principals, const Eigen::Matrix<double, NPAR, 1>& parameters_fit,
+                     const unsigned hitBits, TTTrack2& atrack) const;
+
+    // Workspace for the batched fit, kept to avoid reallocations
+    std::vector<unsigned> batchOffsets_;   // first combination of each matrix
+    std::vector<unsigned> batchPositions_;
+    std::vector<unsigned> batchOrder_;     // combinations sorted by matrix
+    Eigen::Matrix<double, 12, Eigen::Dynamic> batchVariables_;
+    Eigen::Matrix<double, 12, Eigen::Dynamic> batchPrincipals_;
+    Eigen::Matrix<double,  5, Eigen::Dynamic> batchParameters_;
 };
 
 }  // namespace slhcl1tt
@@ -0,0 +1,115 @@
+#ifndef AMSimulation_TrackFitterAlgoPCAFW_h_
+#define AMSimulation_TrackFitterAlgoPCAFW_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoPCA.h"
+#include <stdint.h>
+
+
+namespace slhcl1tt {
+
+// Fixed-point emulation of the PCA fitter (XYZ view, 4 parameters).
+// The stub coordinates are quantized to fwStubBits and the matrix constants
+// to fwConstBits, then the fit is done with integer multiply-accumulate.
+// All the least significant bits are powers of two, so the rescalings are
+// shifts. The constants are quantized row by row, with the row scale folded
+// into a shift, and 1/sqrt(eigenvalue) is folded into the rows of V.
+class TrackFitterAlgoPCAFW : public TrackFitterAlgoPCA {
+  public:
+    // Ranges of the centered stub coordinates, as powers of two
+    static const int PHI_RANGE_BITS = -1;  // +/- 0.5 rad
+    static const int Z_RANGE_BITS   = 8;   // +/- 256 cm
+    static const int R_RANGE_BITS   = 4;   // +/- 16 cm
+
+    // Output formats, as numbers of fractional bits
+    static const int PRINCIPAL_FRAC_BITS = 8;
+    static const int PARAMETER_FRAC_BITS[4];  // phi0, cottheta, z0, q/pt
+
+    // Fit results in firmware units
+    struct FWResult {
+        int32_t  principals[12];  // LSB = 2^-PRINCIPAL_FRAC_BITS
+        int64_t  chi2;            // LSB = 2^-(2*PRINCIPAL_FRAC_BITS)
+        int32_t  parameters[4];   // LSB = 2^-PARAMETER_FRAC_BITS[i]
+        unsigned ndof;
+    };
+
+    TrackFitterAlgoPCAFW(const slhcl1tt::ProgramOption& po);
+
+    ~TrackFitterAlgoPCAFW() {}
+
+    int fit(const TTRoadComb& acomb, TTTrack2& atrack);
+
+    TrackFitterAlgoBase * clone() const { return new TrackFitterAlgoPCAFW(*this); }
+
+    // Same arithmetic as fit(), with the combinations grouped by matrix and
+    // the multiply-accumulates done on several combinations at once. The
+    // combinations that fitFW() cannot fit get an empty track, and 1 is
+    // returned.
+    int fitBatch(const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks);
+
+    // The firmware has no 5/6 downdate: return false, so that the 5/6
+    // combinations are fitted with fit() like the others
+    bool fitFiveOfSix(const TTRoadComb&, const TTTrack2&, TTTrack2&) {
+        return false;
+    }
+
+    // Fit in firmware units. Returns 1 without fitting if the combination
+    // has no matrix or does not have 6 stubs.
+    int fitFW(const TTRoadComb& acomb, FWResult& result) const;
+
+  private:
+    int quantizeConstants();
+
+    struct FWMatrix;
+
+    // Digitized and DeltaR-corrected stub coordinates of a combination
+    void getWordsFW(const FWMatrix& mat, const TTRoadComb& acomb, int16_t * variables) const;
+
+    // Principals, track parameters and chi2 from the accumulators of the
+    // 16 columns of W, acc[i * stride]
+    void getResultFW(const FWMatrix& mat, unsigned hitBits, const int32_t * acc, unsigned stride, FWResult& result) const;
+
+    // Convert a result back to physical units
+    void setTrackFW(const FWResult& result, TTTrack2& atrack) const;
+
+    // Quantized matrices. The 12 rows of V and the 4 rows of DV are stored
+    // transposed as the 16 columns of W, so that the fit is 12 multiply-
+    // accumulates on 16 lanes.
+    struct FWMatrix {
+        int16_t W[12][16];
+        int16_t solutionsC[6];
+        int16_t solutionsT[6];
+
+        int32_t meansX[12];  // in units of the stub coordinates
+        int32_t meansR[6];
+
+        int64_t offsetW[16];
+        int64_t offsetC;
+        int64_t offsetT;
+
+        int     shiftW[16];
+        int     shiftC;
+        int     shiftT;
+    };
+    std::vector<FWMatrix> fwMatrices;
+
+    // Settings
+    unsigned    stubBits_;
+    unsigned    constBits_;
+    int         phiExp_;  // LSB = 2^-phiExp_
+    int         zExp_;
+    int         rExp_;
+    double      phiScale_;  // 2^phiExp_
+    double      zScale_;
+    double      rScale_;
+
+    // Workspace for the batched fit, kept to avoid reallocations
+    std::vector<unsigned> batchOffsets_;   // first combination of each matrix
+    std::vector<unsigned> batchPositions_;
+    std::vector<unsigned> batchOrder_;     // combinations sorted by matrix
+    std::vector<int16_t>  batchWords_;     // pairs of variables, see fitBatch()
+    std::vector<int32_t>  batchAcc_;       // accumulators, one row per column of W
+};
+
+}  // namespace slhcl1tt
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef AMSimulation_TrackSelection_h_
+#define AMSimulation_TrackSelection_h_
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/TTTrack2.h"
+#include <vector>
+
+namespace slhcl1tt {
+
+// Cuts on the absolute values of the normalized principal components, for 12
+// components and otherwise; -1 means no cut
+static const unsigned PRINCIPAL_NCUTS6 = 12;
+static const unsigned PRINCIPAL_NCUTS5 = 10;
+static const float    PRINCIPAL_CUTS6[PRINCIPAL_NCUTS6] = {58.,33.,22.,12.,-1.,-1.,9.,3.,3.,3.,-1.,-1.};
+static const float    PRINCIPAL_CUTS5[PRINCIPAL_NCUTS5] = {33.,22.,12.,-1.,-1.,3.,3.,3.,-1.,-1.};
+
+// principal component cut function
+bool PrincipalCuts(const TTConstSpan<float>& princes);
+
+// Selection of the fitted tracks: reduced chi2 below maxChi2, or the
+// principal component cuts instead
+struct TrackSelection {
+    TrackSelection(float maxChi2_=5., bool cutPrincipals_=false)
+    : maxChi2(maxChi2_), cutPrincipals(cutPrincipals_) {}
+
+    bool pass(const TTTrack2& atrack) const;
+
+    float maxChi2;
+    bool  cutPrincipals;
+};
+
+}  // namespace slhcl1tt
+
+#endif
@@ -0,0 +1,53 @@
+import unittest
+import sys
+from ROOT import TFile, TTree, gROOT, gSystem, vector
+
+
+def tolist(v):
+    try:
+        return [tolist(x) for x in v]
+    except TypeError:
+        return v
+
+
+class TestAMSim(unittest.TestCase):
+    """Test that two outputs, e.g. with different numbers of threads, have the same tree"""
+
+    infile1 = "tracks.root"
+    infile2 = "tracks_j2.root"
+
+    def setUp(self):
+        gROOT.SetBatch(True)
+        gROOT.SetMacroPath(gSystem.Getenv("CMSSW_BASE")+"/src/SLHCL1TrackTriggerSimulations/AMSimulation")
+        gROOT.LoadMacro("python/test/loader.h+")
+        self.tfile1 = TFile.Open(self.infile1)
+        self.ttree1 = self.tfile1.Get("ntupler/tree")
+        self.tfile2 = TFile.Open(self.infile2)
+        self.ttree2 = self.tfile2.Get("ntupler/tree")
+
+    def tearDown(self):
+        pass
+
+    def test_nevents(self):
+        self.assertEqual(self.ttree1.GetEntries(), self.ttree2.GetEntries())
+
+    def test_branches(self):
+        names1 = sorted(b.GetName() for b in self.ttree1.GetListOfBranches())
+        names2 = sorted(b.GetName() for b in self.ttree2.GetListOfBranches())
+        self.assertEqual(names1, names2)
+
+    def test_entries(self):
+        names = [b.GetName() for b in self.ttree1.GetListOfBranches()]
+        for ievt in xrange(self.ttree1.GetEntries()):
+            self.ttree1.GetEntry(ievt)
+            self.ttree2.GetEntry(ievt)
+            for name in names:
+                self.assertEqual(tolist(getattr(self.ttree1, name)), tolist(getattr(self.ttree2, name)), "%s differs in event %i" % (name, ievt))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) > 2:
+        TestAMSim.infile2 = sys.argv.pop()
+        TestAMSim.infile1 = sys.argv.pop()
+
+    unittest.main()
@@ -1,4 +1,5 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/DuplicateRemoval.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
 using namespace slhcl1tt;
 
 #include <vector>
@@ -18,6 +19,18 @@ namespace{
     return (ltk.chi2()/(float)ltk.ndof()) < (rtk.chi2()/(float)rtk.ndof());
   }
 
+  //Sort track indices with the comparator of the tracks
+  struct IndexByChi2{
+    const std::vector<TTTrack2>& tracks;
+    explicit IndexByChi2(const std::vector<TTTrack2>& t) : tracks(t) {}
+    bool operator()(unsigned l, unsigned r) const { return sortByChi2(tracks[l], tracks[r]); }
+  };
+
+  //Key of a stub in the index
+  inline uint64_t stubKey(unsigned layer, unsigned stubRef){
+    return (uint64_t(layer) << 32) | stubRef;
+  }
+
 }
 
 
@@ -32,51 +45,63 @@ void DuplicateRemoval::CheckTracks(std::vector<TTTrack2>& full_am_track_list, in
 
   // If setted, duplicate removal is done
   else if(dupRm != -1 && dupRm < 7){
+    const unsigned int ntracks = full_am_track_list.size();
+
     ///Sort AM tracks by logic and pt (decreasing)
     //std::sort(full_am_track_list.begin(), full_am_track_list.end(), sortByLogicPt);
-    std::sort(full_am_track_list.begin(), full_am_track_list.end(), sortByChi2);
+    ///Sort AM track indices by chi2/ndof, ties keep their order
+    order_.resize(ntracks);
+    for(unsigned int itrack = 0; itrack < ntracks; itrack++) order_[itrack] = itrack;
+    std::stable_sort(order_.begin(), order_.end(), IndexByChi2(full_am_track_list));
 
-  
-    ///The duplicate removal itself
-    std::vector<TTTrack2> unique_tracks;
-    bool duplicate_found;
-    for(unsigned int itrack = 0; itrack < full_am_track_list.size(); itrack++){
-      //if(full_am_track_list.at(itrack).chi2()/full_am_track_list.at(itrack).ndof() > 3) std::cout<<"Violates Chi2/ndof<3 cut"<<std::endl;
 
-      duplicate_found = false;
+    ///The duplicate removal itself
+    accepted_.clear();
+    stubIndex_.clear();
+    sharedStubs_.assign(ntracks, 0);
+    for(unsigned int k = 0; k < ntracks; k++){
+      const unsigned int itrack = order_[k];
+      const TTConstSpan<unsigned> stubRefs = full_am_track_list[itrack].stubRefs();
+      const unsigned int nstubs = stubRefs.size();
+
+      bool duplicate_found = false;
       ///Always accept the first track
-      if(unique_tracks.size() == 0) unique_tracks.push_back( full_am_track_list.at(itrack) );
-      else{
-        unsigned int nstubs = full_am_track_list.at(itrack).stubRefs().size();
-        for(unsigned int jtrack = 0; jtrack < unique_tracks.size(); jtrack++){
-	  //Just a sanity check
-	  unsigned int j_nstubs = unique_tracks.at(jtrack).stubRefs().size();
-  	  assert(nstubs == j_nstubs);
-      
-	  int sharedStubs = 0;
-	  for(unsigned int istub = 0; istub < nstubs; istub++){
-	    //When comparing two 5/6's tracks we don't consider the pedestal value as a stub reference
-	    if( full_am_track_list.at(itrack).stubRefs()[istub] == 999999999 && unique_tracks.at(jtrack).stubRefs()[istub] == 999999999 ) continue;
-
-	    //Compares the stubs in each layer
-	    if( full_am_track_list.at(itrack).stubRefs()[istub] == unique_tracks.at(jtrack).stubRefs()[istub] ) sharedStubs++;
-	  }
-	  if(sharedStubs > dupRm) duplicate_found = true;
-        }//loop over non-duplicate tracks (unique_tracks vector)
-
-        //If track is not sharing more than allowed number of stubs, store it
-        if(!duplicate_found)
-          unique_tracks.push_back( full_am_track_list.at(itrack) );
-
-      }//else end
+      if(!accepted_.empty()){
+        //Just a sanity check
+        assert(nstubs == full_am_track_list[accepted_.front()].stubRefs().size());
+
+        //Any track shares more than a negative number of stubs
+        if(dupRm < 0) duplicate_found = true;
+
+        //Count the stubs shared with the unique tracks, layer by layer.
+        //When comparing two 5/6's tracks we don't consider the pedestal value as a stub reference
+        touched_.clear();
+        for(unsigned int istub = 0; istub < nstubs && !duplicate_found; istub++){
+          if(stubRefs[istub] == 999999999) continue;
+
+          auto range = stubIndex_.equal_range(stubKey(istub, stubRefs[istub]));
+          for(auto it = range.first; it != range.second; ++it){
+            const unsigned int jtrack = it->second;
+            if(sharedStubs_[jtrack]++ == 0) touched_.push_back(jtrack);
+            if(sharedStubs_[jtrack] > dupRm) duplicate_found = true;
+          }
+        }
+        for(unsigned int j = 0; j < touched_.size(); j++) sharedStubs_[touched_[j]] = 0;
+      }
+
+      //If track is not sharing more than allowed number of stubs, store it
+      if(!duplicate_found){
+        accepted_.push_back(itrack);
+        for(unsigned int istub = 0; istub < nstubs; istub++){
+          if(stubRefs[istub] != 999999999) stubIndex_.insert(std::make_pair(stubKey(istub, stubRefs[istub]), itrack));
+        }
+      }
     }//loop over all AM tracks
 
 
     //Remove the duplicate tracks from the original list
-    //And keeps only the unique tracks
-    full_am_track_list.resize(unique_tracks.size());
-    full_am_track_list = unique_tracks;
-    assert(full_am_track_list.size() == unique_tracks.size());
+    //And keeps only the unique tracks, in order of chi2/ndof
+    selectInPlace(full_am_track_list, accepted_, done_);
   }
 
   else{
@@ -1,6 +1,7 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/GhostBuster.h"
 using namespace slhcl1tt;
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 
@@ -25,15 +26,14 @@ bool GhostBuster::isGhostRoad(const std::vector<unsigned>& superstripIds1, const
 }
 
 // _____________________________________________________________________________
-bool GhostBuster::isGhostTrack(const std::vector<unsigned>& stubRefs1, const std::vector<unsigned>& stubRefs2, const unsigned threshold) const {
-    assert(stubRefs1.size() == stubRefs2.size());
-
+namespace {
+bool isGhost(const unsigned * stubRefs1, const unsigned * stubRefs2, const unsigned nlayers, const unsigned threshold) {
     unsigned n = 0;
-    for (unsigned i=0; i<stubRefs1.size(); ++i) {
-        if (stubRefs1.at(i) == GhostBuster::BAD || stubRefs2.at(i) == GhostBuster::BAD)
+    for (unsigned i=0; i<nlayers; ++i) {
+        if (stubRefs1[i] == GhostBuster::BAD || stubRefs2[i] == GhostBuster::BAD)
             continue;
 
-        if (stubRefs1.at(i) != stubRefs2.at(i)) {
+        if (stubRefs1[i] != stubRefs2[i]) {
             ++n;
             if (n >= threshold)
                return false;
@@ -42,6 +42,109 @@ bool GhostBuster::isGhostTrack(const std::vector<unsigned>& stubRefs1, const std
 
     return true;
 }
+}
+
+bool GhostBuster::isGhostTrack(const TTConstSpan<unsigned>& stubRefs1, const TTConstSpan<unsigned>& stubRefs2, const unsigned threshold) const {
+    assert(stubRefs1.size() == stubRefs2.size());
+
+    return isGhost(stubRefs1.data(), stubRefs2.data(), stubRefs1.size(), threshold);
+}
+
+// _____________________________________________________________________________
+void GhostBuster::getKeyMasks(const unsigned badMask, const unsigned nmasked, std::vector<unsigned>& keyMasks) const {
+    keyMasks.clear();
+    for (unsigned keyMask=0; keyMask<(1u << nlayers_); ++keyMask) {
+        if ((keyMask & badMask) == badMask && (unsigned) __builtin_popcount(keyMask & ~badMask) <= nmasked)
+            keyMasks.push_back(keyMask);
+    }
+}
+
+uint64_t GhostBuster::getKey(const unsigned * stubRefs, const unsigned keyMask) const {
+    uint64_t key = 14695981039346656037ULL ^ keyMask;
+    for (unsigned i=0; i<nlayers_; ++i) {
+        if (!((keyMask >> i) & 1))
+            key = (key ^ stubRefs[i]) * 1099511628211ULL;
+    }
+    return key;
+}
+
+// _____________________________________________________________________________
+void GhostBuster::flagGhostTracks(std::vector<TTTrack2>& tracks, const unsigned threshold) {
+    const unsigned ntracks = tracks.size();
+    if (ntracks == 0)
+        return;
+
+    // Tracks j and i are ghosts if they differ in at most (nmismatches) layers
+    // where both have a stub. Masking out these layers and the layers without
+    // stub of both tracks gives the same key for both
+    const unsigned nmismatches = std::max(threshold, 1u) - 1;
+
+    nlayers_ = tracks.front().stubRefs().size();
+    bool bucketed = (nlayers_ <= 8);
+
+    stubRefs_.resize(ntracks * nlayers_);
+    badMasks_.resize(ntracks);
+    unsigned maxBad = 0;
+    for (unsigned itrack=0; itrack<ntracks && bucketed; ++itrack) {
+        const TTConstSpan<unsigned> stubRefs = tracks.at(itrack).stubRefs();
+        if (stubRefs.size() != nlayers_) {
+            bucketed = false;
+            break;
+        }
+
+        unsigned badMask = 0;
+        for (unsigned i=0; i<nlayers_; ++i) {
+            stubRefs_[itrack * nlayers_ + i] = stubRefs[i];
+            if (stubRefs[i] == GhostBuster::BAD)
+                badMask |= (1u << i);
+        }
+        badMasks_[itrack] = badMask;
+        maxBad = std::max(maxBad, (unsigned) __builtin_popcount(badMask));
+    }
+
+    const unsigned nmasked = nmismatches + maxBad;
+
+    // Compare all pairs if the buckets would not help
+    if (!bucketed || nmasked >= nlayers_) {
+        for (unsigned itrack=0; itrack<ntracks; ++itrack) {  // all tracks
+            for (unsigned jtrack=0; jtrack<itrack; ++jtrack) {  // only non ghost tracks
+                if (tracks.at(jtrack).isGhost())  continue;
+
+                if (isGhostTrack(tracks.at(jtrack).stubRefs(), tracks.at(itrack).stubRefs(), threshold))
+                    tracks.at(itrack).setAsGhost();
+            }
+        }
+        return;
+    }
+
+    buckets_.clear();
+    for (unsigned itrack=0; itrack<ntracks; ++itrack) {  // all tracks
+        if (tracks.at(itrack).isGhost())  continue;
+
+        const unsigned * stubRefs = &stubRefs_[itrack * nlayers_];
+        getKeyMasks(badMasks_[itrack], nmasked, keyMasks_);
+
+        // Compare with the non ghost tracks before it in the same buckets
+        bool ghost = false;
+        for (unsigned ikey=0; ikey<keyMasks_.size() && !ghost; ++ikey) {
+            auto range = buckets_.equal_range(getKey(stubRefs, keyMasks_[ikey]));
+            for (auto it=range.first; it!=range.second; ++it) {
+                const unsigned jtrack = it->second;
+                if (isGhost(&stubRefs_[jtrack * nlayers_], stubRefs, nlayers_, threshold)) {
+                    ghost = true;
+                    break;
+                }
+            }
+        }
+
+        if (ghost) {
+            tracks.at(itrack).setAsGhost();
+        } else {
+            for (unsigned ikey=0; ikey<keyMasks_.size(); ++ikey)
+                buckets_.emplace(getKey(stubRefs, keyMasks_[ikey]), itrack);
+        }
+    }
+}
 
 // _____________________________________________________________________________
 void GhostBuster::print() {
@@ -4,6 +4,7 @@ using namespace slhcl1tt;
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <cmath>
 #include <map>
 #include <TMath.h>
 #define  debug 0
@@ -136,6 +137,32 @@ void MCTruthAssociator::associate(std::vector<TrackingParticle>& trkParts, std::
     //    }
     //}
 
+    // Compute the resolutions of each reco track once, and sort the tracks by invPt
+    resolutions_.resize(ntracks);
+    byInvPt_.clear();
+    float max_res_invPt = 0., max_res_phi0 = 0.;
+    for (unsigned itrack=0; itrack<ntracks; ++itrack) {
+        const float invPt = tracks[itrack].invPt();
+        Resolutions& res = resolutions_[itrack];
+        res.invPt    = resolution(invPt, "invPt");
+        res.phi0     = resolution(invPt, "phi0");
+        res.cottheta = resolution(invPt, "cottheta");
+        res.z0       = resolution(invPt, "z0");
+
+        // A track with a NaN resolution or invPt never passes the match chi2 cut
+        if (std::isnan(invPt) || std::isnan(res.invPt) || std::isnan(res.phi0))  continue;
+        byInvPt_.push_back(std::make_pair(invPt, itrack));
+        max_res_invPt = std::max(max_res_invPt, std::fabs(res.invPt));
+        max_res_phi0  = std::max(max_res_phi0 , std::fabs(res.phi0));
+    }
+    std::sort(byInvPt_.begin(), byInvPt_.end());
+
+    // Each of the four terms of the match chi2 is below degrees_of_freedom * match_chi2_cut
+    // for an accepted track, so are the invPt and phi0 terms. The windows get a 1% margin
+    // for the rounding.
+    const double window_invPt = 1.01 * std::sqrt(degrees_of_freedom * match_chi2_cut) * max_res_invPt;
+    const double window_phi0  = 1.01 * std::sqrt(degrees_of_freedom * match_chi2_cut) * max_res_phi0;
+
     // Stores flags to each MC/AM track
     std::vector<int> mcCategories(nparts, ParticleCategory::NOTFOUND);
     std::vector<int> recoCategories(ntracks, TrackCategory::FAKE);
@@ -157,12 +184,29 @@ void MCTruthAssociator::associate(std::vector<TrackingParticle>& trkParts, std::
         bool foundTheBest = false;
 	float best_quality = match_chi2_cut, i_quality = -1;
 	int best_match_id = -1;
-        for (unsigned am_itrack=0; am_itrack<ntracks; ++am_itrack) {// Loop over reco tracks
+
+        // Only the reco tracks within the invPt and phi0 windows can be below the match chi2 cut
+        const TrackingParticle& trkPart = trkParts.at(ipart);
+        if (!std::isfinite(trkPart.invPt) || !std::isfinite(trkPart.phi0))  continue;
+
+        std::vector<std::pair<float, unsigned> >::iterator first = std::lower_bound(byInvPt_.begin(), byInvPt_.end(), std::make_pair(float(trkPart.invPt - window_invPt), 0u));
+        std::vector<std::pair<float, unsigned> >::iterator last  = std::upper_bound(first, byInvPt_.end(), std::make_pair(float(trkPart.invPt + window_invPt), ntracks));
+
+        candidates_.clear();
+        for (; first != last; ++first) {
+            if (std::fabs(trkPart.phi0 - tracks[first->second].phi0()) <= window_phi0)
+                candidates_.push_back(first->second);
+        }
+        std::sort(candidates_.begin(), candidates_.end());
+
+        for (unsigned icand=0; icand<candidates_.size(); ++icand) {// Loop over reco tracks
+            const unsigned am_itrack = candidates_[icand];
 	    //std::cout<<"AM Track Chi2/ndof(from FITTER): "<<tracks.at(am_itrack).chi2()/tracks.at(am_itrack).ndof()<<std::endl;
 
             // Compute our match chi2 definition for each combination and 
 	    // checks if it is below our defined threshold (12.8)
-	    bool accpt_quality = accept(trkParts.at(ipart), tracks.at(am_itrack), i_quality);
+	    i_quality = matchChi2(trkPart, tracks[am_itrack], resolutions_[am_itrack]);
+	    bool accpt_quality = i_quality < match_chi2_cut;
 
 	    // Debug
 	    if(debug == 1) std::cout<<"AM Track --> "<<am_itrack<<"\tLogic --> "<<tracks.at(am_itrack).ndof()<<"\tPt --> "<<tracks.at(am_itrack).pt()<<"\tQuality --> "<<i_quality<<"\tCat: "<<recoCategories.at(am_itrack)<<std::endl;
@@ -235,17 +279,29 @@ void MCTruthAssociator::associate(std::vector<TrackingParticle>& trkParts, std::
 // _____________________________________________________________________________
 bool MCTruthAssociator::accept(const TrackingParticle& trkPart, const TTTrack2& track, float& quality){
 
-    quality = (squaredNormDiff(trkPart.invPt   , track.invPt()   , resolution(track.invPt(),"invPt") ) +
-               squaredNormDiff(trkPart.phi0    , track.phi0()    , resolution(track.invPt(),"phi0") ) +
-               squaredNormDiff(trkPart.cottheta, track.cottheta(), resolution(track.invPt(),"cottheta") ) +
-               squaredNormDiff(trkPart.z0      , track.z0()      , resolution(track.invPt(),"z0") )
-              )/degrees_of_freedom;
+    Resolutions res;
+    res.invPt    = resolution(track.invPt(),"invPt");
+    res.phi0     = resolution(track.invPt(),"phi0");
+    res.cottheta = resolution(track.invPt(),"cottheta");
+    res.z0       = resolution(track.invPt(),"z0");
+
+    quality = matchChi2(trkPart, track, res);
 
     bool acc = quality < match_chi2_cut;
 
     return acc;
 }
 
+// _____________________________________________________________________________
+float MCTruthAssociator::matchChi2(const TrackingParticle& trkPart, const TTTrack2& track, const Resolutions& res) const {
+
+    return (squaredNormDiff(trkPart.invPt   , track.invPt()   , res.invPt   ) +
+            squaredNormDiff(trkPart.phi0    , track.phi0()    , res.phi0    ) +
+            squaredNormDiff(trkPart.cottheta, track.cottheta(), res.cottheta) +
+            squaredNormDiff(trkPart.z0      , track.z0()      , res.z0      )
+           )/degrees_of_freedom;
+}
+
 // _____________________________________________________________________________
 void MCTruthAssociator::print() {
     //std::cout << "rms invPt: " << rms_invPt_ << " phi0: " << rms_phi0_ << " cottheta: " << rms_cottheta_ << " z0: " << rms_z0_ << " d0: " << rms_d0_ << std::endl;
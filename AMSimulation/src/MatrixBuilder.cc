@@ -1,8 +1,10 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/MatrixBuilder.h"
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTStubReader.h"
-#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Statistics.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PCAMatrixBundle.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ParallelFor.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <fstream>
 
@@ -80,7 +82,7 @@ int MatrixBuilder::bookHistograms() {
 
 // _____________________________________________________________________________
 // Set variable to zero according to hit bits
-int MatrixBuilder::setVariableToZero(Eigen::VectorXd& variables1, Eigen::VectorXd& variables2, Eigen::VectorXd& variables3, const unsigned hitBits) {
+int MatrixBuilder::setVariableToZero(LayerVector& variables1, LayerVector& variables2, LayerVector& variables3, const unsigned hitBits) const {
     if (hitBits == 0) {
         return 0;
     }
@@ -96,7 +98,7 @@ int MatrixBuilder::setVariableToZero(Eigen::VectorXd& variables1, Eigen::VectorX
 }
 
 // Set rotation to zeroes according to hit bits
-int MatrixBuilder::setRotationToZero(Eigen::MatrixXd& rotation, const unsigned nvariables, const unsigned hitBits) {
+int MatrixBuilder::setRotationToZero(Eigen::MatrixXd& rotation, const unsigned nvariables, const unsigned hitBits) const {
     if (hitBits == 0) {
         return 0;
     }
@@ -115,7 +117,7 @@ int MatrixBuilder::setRotationToZero(Eigen::MatrixXd& rotation, const unsigned n
 }
 
 // Set covariance to unit according to hit bits
-int MatrixBuilder::setCovarianceToUnit(Eigen::MatrixXd& covariances, const unsigned nvariables, const unsigned hitBits) {
+int MatrixBuilder::setCovarianceToUnit(Eigen::MatrixXd& covariances, const unsigned nvariables, const unsigned hitBits) const {
     if (hitBits == 0) {
         return 0;
     }
@@ -131,6 +133,56 @@ int MatrixBuilder::setCovarianceToUnit(Eigen::MatrixXd& covariances, const unsig
     return 1;
 }
 
+// _____________________________________________________________________________
+// Get the stub coordinates of a cached event
+void MatrixBuilder::getVariables(const MatrixEventCache::Block& block, const unsigned ient, const unsigned hitBits,
+                                 LayerVector& variables1, LayerVector& variables2, LayerVector& variables3) const {
+    variables1 = LayerVector::Zero(nvariables_/2);
+    variables2 = LayerVector::Zero(nvariables_/2);
+    variables3 = LayerVector::Zero(nvariables_/2);
+
+    // Loop over reconstructed stubs
+    for (unsigned istub=0; istub<MatrixEventCache::NSTUBS; ++istub) {
+        float    stub_r   = block.r(istub)  [ient];
+        float    stub_phi = block.phi(istub)[ient];
+        float    stub_z   = block.z(istub)  [ient];
+
+        variables1(istub) = stub_phi;
+        variables2(istub) = stub_z;
+        variables3(istub) = meansR_(istub) - stub_r;
+    }
+    setVariableToZero(variables1, variables2, variables3, hitBits);
+}
+
+// Get the sim track parameters of a cached event
+void MatrixBuilder::getParameters(const MatrixEventCache::Block& block, const unsigned ient,
+                                  Accumulator::Vector& parameters) const {
+    double simChargeOverPt = block.column(MatrixEventCache::SIM_CHARGEOVERPT)[ient];
+    double simCotTheta     = block.column(MatrixEventCache::SIM_COTTHETA)    [ient];
+    double simPhi          = block.column(MatrixEventCache::SIM_PHI)         [ient];
+    double simVz           = block.column(MatrixEventCache::SIM_VZ)          [ient];
+
+    parameters = Accumulator::Vector::Zero(nparameters_);
+    unsigned ipar = 0;
+    parameters(ipar++) = simPhi;
+    parameters(ipar++) = simCotTheta;
+    parameters(ipar++) = simVz;
+    parameters(ipar++) = simChargeOverPt;
+}
+
+// Get the invPt segment of a cached event
+unsigned MatrixBuilder::getSegment(const MatrixEventCache::Block& block, const unsigned ient) const {
+    if (!po_.matrixGrid)
+        return 0;
+    return getPtSegment(block.column(MatrixEventCache::SIM_CHARGEOVERPT)[ient]);
+}
+
+// Print the matrix slot being solved
+void MatrixBuilder::printSlot(const unsigned islot) const {
+    if (po_.matrixGrid)
+        std::cout << Info() << Form("pt segment: %u, hit bits: %u", islot / hitBitsList_.size(), hitBitsList_.at(islot % hitBitsList_.size())) << std::endl;
+}
+
 // _____________________________________________________________________________
 // Build matrices
 int MatrixBuilder::buildMatrices(TString src) {
@@ -139,6 +191,7 @@ int MatrixBuilder::buildMatrices(TString src) {
     // _________________________________________________________________________
     // For reading
     TTStubReader reader(verbose_);
+    reader.setReadAhead(po_.readCacheSize, po_.readAhead);
     if (reader.init(src, false)) {
         std::cout << Error() << "Failed to initialize TTStubReader." << std::endl;
         return 1;
@@ -157,7 +210,7 @@ int MatrixBuilder::buildMatrices(TString src) {
 
     if (verbose_)  std::cout << Info() << "Begin first loop on tracks" << std::endl;
 
-    if (loopEventsAndSolveCT(reader))
+    if (loopEventsAndSolveCT())
         return 1;
 
     // _________________________________________________________________________
@@ -165,7 +218,7 @@ int MatrixBuilder::buildMatrices(TString src) {
 
     if (verbose_)  std::cout << Info() << "Begin second loop on tracks" << std::endl;
 
-    if (loopEventsAndSolveEigenvectors(reader))
+    if (loopEventsAndSolveEigenvectors())
         return 1;
 
     // _________________________________________________________________________
@@ -173,7 +226,7 @@ int MatrixBuilder::buildMatrices(TString src) {
 
     if (verbose_)  std::cout << Info() << "Begin third loop on tracks" << std::endl;
 
-    if (loopEventsAndSolveD(reader))
+    if (loopEventsAndSolveD())
         return 1;
 
     // _________________________________________________________________________
@@ -181,7 +234,7 @@ int MatrixBuilder::buildMatrices(TString src) {
 
     if (verbose_)  std::cout << Info() << "Begin fourth loop on tracks" << std::endl;
 
-    if (loopEventsAndEval(reader))
+    if (loopEventsAndEval())
         return 1;
 
     return 0;
@@ -196,13 +249,17 @@ int MatrixBuilder::loopEventsAndFilter(TTStubReader& reader) {
 
     if (verbose_)  std::cout << Info() << "Filter events." << std::endl;
 
-    // Mean vector and covariance matrix
-    Eigen::VectorXd means = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::MatrixXd covariances = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
+    if (po_.nLayers != MatrixEventCache::NSTUBS) {
+        std::cout << Error() << "The event cache expects " << MatrixEventCache::NSTUBS << " layers." << std::endl;
+        return 1;
+    }
 
     // Bookkeepers
     long int nRead = 0, nKept = 0;
 
+    // Only the events that pass the filter are stored in the cache
+    cache_.clear();
+
     for (long long ievt=0; ievt<nEvents_; ++ievt) {
         if (reader.loadTree(ievt) < 0)  break;
         reader.getEntry(ievt);
@@ -217,10 +274,18 @@ int MatrixBuilder::loopEventsAndFilter(TTStubReader& reader) {
         double simCotTheta     = std::sinh(reader.vp_eta->front());
         if (simChargeOverPt < po_.minInvPt || po_.maxInvPt < simChargeOverPt) {
             ++nRead;
-            keepEvents_.push_back(false);
             continue;
         }
 
+        // In grid mode, the track must fall in one of the invPt segments
+        if (po_.matrixGrid) {
+            const float invPt = simChargeOverPt;
+            if (invPt < PCA_MIN_INVPT || getPtSegment(invPt) >= PCA_NSEGMENTS) {
+                ++nRead;
+                continue;
+            }
+        }
+
         // Apply trigger tower acceptance
         unsigned ngoodstubs = 0;
         for (unsigned istub=0; istub<nstubs; ++istub) {
@@ -231,57 +296,16 @@ int MatrixBuilder::loopEventsAndFilter(TTStubReader& reader) {
         }
         if (ngoodstubs != po_.nLayers) {
             ++nRead;
-            keepEvents_.push_back(false);
             continue;
         }
         assert(nstubs == po_.nLayers);
 
-        // _____________________________________________________________________
-        // Calculate means and covariances for V (cheating version)
-
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
-
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
-
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
-        }
-        //setVariableToZero(variables1, variables2, variables3, po_.hitBits);
-
-        // Apply DeltaR correction (cheating version)
-        const double simC = -0.5 * (0.003 * 3.8 * simChargeOverPt);  // 1/(2 x radius of curvature)
-        const double simT = simCotTheta;
-        variables1 += simC * variables3;
-        variables2 += simT * variables3;
-
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
-
-        // Update mean vector
-        long int nTracks = nKept + 1;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            means(ivar) += (variables(ivar) - means(ivar))/nTracks;
-        }
-
-        // Update covariance matrix
-        if (nTracks > 1) {
-            for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-                for (unsigned jvar=0; jvar<nvariables_; ++jvar) {
-                    covariances(ivar, jvar) += (variables(ivar) - means(ivar)) * (variables(jvar) - means(jvar)) / (nTracks-1) - covariances(ivar, jvar)/nTracks;
-                }
-            }
-        }
+        // Store the event in the cache
+        cache_.push_back(&reader.vb_r->front(), &reader.vb_phi->front(), &reader.vb_z->front(),
+                         simChargeOverPt, simCotTheta, reader.vp_phi->front(), reader.vp_vz->front());
 
         ++nKept;
         ++nRead;
-        keepEvents_.push_back(true);
     }
 
     if (nRead == 0) {
@@ -290,671 +314,629 @@ int MatrixBuilder::loopEventsAndFilter(TTStubReader& reader) {
     }
 
     if (verbose_)  std::cout << Info() << Form("Read: %7ld, kept: %7ld", nRead, nKept) << std::endl;
+    if (verbose_ && cache_.nspilled())  std::cout << Info() << "Spilled " << cache_.nspilled() << " of " << cache_.nblocks() << " blocks of the event cache to disk." << std::endl;
 
-     // Find eigenvectors of covariance matrix (cheating version)
-    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigensolver(covariances);
-    Eigen::VectorXd sqrtEigenvalues = Eigen::VectorXd::Zero(nvariables_);
-    for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-        sqrtEigenvalues(ivar) = std::sqrt(std::max(0., eigensolver.eigenvalues()(ivar)));
-    }
-
-    // Find matrix V (cheating version)
-    // V is the orthogonal transformation from coordinates space to principal components space
-    // The principal components are constraints + rotated track parameters
-    Eigen::MatrixXd V = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
-    V = (eigensolver.eigenvectors()).transpose();
+    keepEvents_.assign(cache_.size(), true);
 
     // _________________________________________________________________________
-    // Loop again to reject outliers
+    // Calculate means and covariances for V (cheating version), per invPt segment
 
-    const float sigma = 5.;
-    if (sigma >= 10.)
-        return 0;
+    const AccumulatorSet accumulators = parallelAccumulate(cache_.nblocks(), po_.threads, AccumulatorSet(nsegments_, Accumulator(nvariables_)),
+                                                           [&](unsigned iblock, AccumulatorSet& partial) {
+        MatrixEventCache::Block buffer;
+        const MatrixEventCache::Block& block = cache_.getBlock(iblock, buffer);
 
-    if (verbose_)  std::cout << Info() << "Reject outlier events. sigma=" << sigma << std::endl;
+        LayerVector variables1, variables2, variables3;
+        Accumulator::Vector variables(nvariables_), parameters;
 
-    // Bookkeepers
-    nRead = 0, nKept = 0;
-
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
+        for (unsigned ient=0; ient<block.size; ++ient) {
+            getVariables(block, ient, 0, variables1, variables2, variables3);
+            getParameters(block, ient, parameters);
 
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
+            // Apply DeltaR correction (cheating version)
+            const double simC = -0.5 * (0.003 * 3.8 * parameters(3));  // 1/(2 x radius of curvature)
+            const double simT = parameters(1);
+            variables1 += simC * variables3;
+            variables2 += simT * variables3;
 
-        if (!keepEvents_.at(ievt)) {
-            ++nRead;
-            continue;
-        }
-
-        double simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
-        double simCotTheta     = std::sinh(reader.vp_eta->front());
-
-        // _____________________________________________________________________
-        // Reject outliers
-
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
-
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
-
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
+            variables << variables1, variables2;
+            partial.at(getSegment(block, ient)).fill(variables);
         }
-        //setVariableToZero(variables1, variables2, variables3, po_.hitBits);
+    });
 
-        // Apply DeltaR correction (cheating version)
-        const double simC = -0.5 * (0.003 * 3.8 * simChargeOverPt);  // 1/(2 x radius of curvature)
-        const double simT = simCotTheta;
-        variables1 += simC * variables3;
-        variables2 += simT * variables3;
+    std::vector<Eigen::VectorXd> means(nsegments_);
+    std::vector<Eigen::VectorXd> sqrtEigenvalues(nsegments_);
+    std::vector<Eigen::MatrixXd> V(nsegments_);
 
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
+    for (unsigned iseg=0; iseg<nsegments_; ++iseg) {
+        if (accumulators.at(iseg).getEntries() < 2)
+            std::cout << Warning() << "Too few events in pt segment " << iseg << ": " << accumulators.at(iseg).getEntries() << std::endl;
 
-        // Transform coordinates to principal components (cheating version)
-        Eigen::VectorXd principals = Eigen::VectorXd::Zero(nvariables_);
-        principals = V * (variables - means);
+        means.at(iseg) = accumulators.at(iseg).getMeans();
+        const Eigen::MatrixXd covariances = accumulators.at(iseg).getCovariances();
 
+         // Find eigenvectors of covariance matrix (cheating version)
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigensolver(covariances);
+        sqrtEigenvalues.at(iseg) = Eigen::VectorXd::Zero(nvariables_);
         for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            assert(sqrtEigenvalues(ivar) > 0.);
-            if (principals(ivar)/sqrtEigenvalues(ivar) > sigma) {
-                keepEvents_.at(ievt) = false;
-
-                //std::cout << ievt << " " << ivar << " " << principals(ivar) << " " << sqrtEigenvalues(ivar) << " " << principals(ivar)/sqrtEigenvalues(ivar) << std::endl;
-            }
+            sqrtEigenvalues.at(iseg)(ivar) = std::sqrt(std::max(0., eigensolver.eigenvalues()(ivar)));
         }
 
-        if (keepEvents_.at(ievt))
-            ++nKept;
-        ++nRead;
+        // Find matrix V (cheating version)
+        // V is the orthogonal transformation from coordinates space to principal components space
+        // The principal components are constraints + rotated track parameters
+        V.at(iseg) = (eigensolver.eigenvectors()).transpose();
     }
 
-    if (verbose_)  std::cout << Info() << Form("Read: %7ld, kept: %7ld", nRead, nKept) << std::endl;
-    return 0;
-}
+    // _________________________________________________________________________
+    // Loop again to reject outliers
 
-// _____________________________________________________________________________
-// Loop over all events and solve for C & T
-int MatrixBuilder::loopEventsAndSolveCT(TTStubReader& reader) {
+    const float sigma = 5.;
+    if (sigma >= 10.)
+        return 0;
 
-    // Mean vector and covariance matrix
-    Eigen::VectorXd means = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::MatrixXd covariances = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
+    if (verbose_)  std::cout << Info() << "Reject outlier events. sigma=" << sigma << std::endl;
 
-    Eigen::VectorXd meansC = Eigen::VectorXd::Zero(1);
-    Eigen::MatrixXd covariancesC = Eigen::MatrixXd::Zero(1, nvariables_/2);
+    parallelFor(cache_.nblocks(), po_.threads, [&](unsigned iblock) {
+        MatrixEventCache::Block buffer;
+        const MatrixEventCache::Block& block = cache_.getBlock(iblock, buffer);
+        const unsigned long offset = (unsigned long) iblock * MatrixEventCache::BLOCK_SIZE;
 
-    Eigen::VectorXd meansT = Eigen::VectorXd::Zero(1);
-    Eigen::MatrixXd covariancesT = Eigen::MatrixXd::Zero(1, nvariables_/2);
+        LayerVector variables1, variables2, variables3;
+        Accumulator::Vector variables(nvariables_), principals(nvariables_), parameters;
 
-    // Bookkeepers
-    long int nRead = 0, nKept = 0;
+        for (unsigned ient=0; ient<block.size; ++ient) {
+            const unsigned iseg = getSegment(block, ient);
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
+            getVariables(block, ient, 0, variables1, variables2, variables3);
+            getParameters(block, ient, parameters);
 
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
+            // Apply DeltaR correction (cheating version)
+            const double simC = -0.5 * (0.003 * 3.8 * parameters(3));  // 1/(2 x radius of curvature)
+            const double simT = parameters(1);
+            variables1 += simC * variables3;
+            variables2 += simT * variables3;
 
-        if (!keepEvents_.at(ievt)) {
-            ++nRead;
-            continue;
-        }
+            variables << variables1, variables2;
 
-        // _____________________________________________________________________
-        // Calculate means and covariances for C&T
+            // Transform coordinates to principal components (cheating version)
+            principals.noalias() = V.at(iseg) * (variables - means.at(iseg));
 
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
+            for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
+                assert(sqrtEigenvalues.at(iseg)(ivar) > 0.);
+                if (principals(ivar)/sqrtEigenvalues.at(iseg)(ivar) > sigma) {
+                    keepEvents_.at(offset + ient) = false;
+                }
+            }
+        }
+    });
 
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
+    nKept = std::count(keepEvents_.begin(), keepEvents_.end(), true);
 
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
-        }
-        setVariableToZero(variables1, variables2, variables3, po_.hitBits);
+    if (verbose_)  std::cout << Info() << Form("Read: %7ld, kept: %7ld", (long int) cache_.size(), nKept) << std::endl;
+    return 0;
+}
 
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
+// _____________________________________________________________________________
+// Loop over all events and solve for C & T
+int MatrixBuilder::loopEventsAndSolveCT() {
 
-        // Get sim info
-        double simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
-        double simCotTheta     = std::sinh(reader.vp_eta->front());
+    // Mean vector and covariance matrix, with C and T appended to the variables
+    const unsigned nhitbits = hitBitsList_.size();
 
-        // Update mean vectors
-        long int nTracks = nKept + 1;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            means(ivar) += (variables(ivar) - means(ivar))/nTracks;
-        }
+    const AccumulatorSet accumulators = parallelAccumulate(cache_.nblocks(), po_.threads, AccumulatorSet(nslots(), Accumulator(nvariables_ + 2)),
+                                                           [&](unsigned iblock, AccumulatorSet& partial) {
+        MatrixEventCache::Block buffer;
+        const MatrixEventCache::Block& block = cache_.getBlock(iblock, buffer);
+        const unsigned long offset = (unsigned long) iblock * MatrixEventCache::BLOCK_SIZE;
 
-        const double simC = -0.5 * (0.003 * 3.8 * simChargeOverPt);  // 1/(2 x radius of curvature)
-        const double simT = simCotTheta;
-        meansC(0) += (simC - meansC(0))/nTracks;
-        meansT(0) += (simT - meansT(0))/nTracks;
+        LayerVector variables1, variables2, variables3;
+        Accumulator::Vector variables(nvariables_ + 2), parameters;
 
-        // Update covariance matrices
-        if (nTracks > 1) {
-            for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-                for (unsigned jvar=0; jvar<nvariables_; ++jvar) {
-                    covariances(ivar, jvar) += (variables(ivar) - means(ivar)) * (variables(jvar) - means(jvar)) / (nTracks-1) - covariances(ivar, jvar)/nTracks;
-                }
-            }
+        for (unsigned ient=0; ient<block.size; ++ient) {
+            if (!keepEvents_.at(offset + ient))
+                continue;
 
-            for (unsigned ipar=0; ipar<1; ++ipar) {
-                for (unsigned jvar=0; jvar<nvariables_/2; ++jvar) {
-                    unsigned kvar = jvar;
-                    covariancesC(ipar, jvar) += (simC - meansC(ipar)) * (variables(kvar) - means(kvar)) / (nTracks-1) - covariancesC(ipar, jvar)/nTracks;
+            const unsigned iseg = getSegment(block, ient);
+            getParameters(block, ient, parameters);
 
-                    kvar = jvar + nvariables_/2;
-                    covariancesT(ipar, jvar) += (simT - meansT(ipar)) * (variables(kvar) - means(kvar)) / (nTracks-1) - covariancesT(ipar, jvar)/nTracks;
-                }
-            }
-        }
+            const double simC = -0.5 * (0.003 * 3.8 * parameters(3));  // 1/(2 x radius of curvature)
+            const double simT = parameters(1);
 
-        ++nKept;
-        ++nRead;
-    }
+            for (unsigned ihb=0; ihb<nhitbits; ++ihb) {
 
-    if (verbose_>1) {
-        std::cout << Info() << "means: " << std::endl;
-        std::cout << means << std::endl << std::endl;
-        std::cout << Info() << "covariances: " << std::endl;
-        std::cout << covariances << std::endl << std::endl;
-    }
+                // _____________________________________________________________
+                // Calculate means and covariances for C&T
 
-    // Find solutions for C & T
-    Eigen::MatrixXd covariances_phi = covariances.block(0,0,nvariables_/2,nvariables_/2);
-    setCovarianceToUnit(covariances_phi, nvariables_/2, po_.hitBits);
-
-    Eigen::MatrixXd covariances_z = covariances.block(nvariables_/2,nvariables_/2,nvariables_/2,nvariables_/2);
-    setCovarianceToUnit(covariances_z, nvariables_/2, po_.hitBits);
-
-    if (verbose_>1) {
-        //std::cout << Info() << "covariances_phi: " << std::endl;
-        //std::cout << covariances_phi << std::endl << std::endl;
-        //std::cout << Info() << "covariances_z: " << std::endl;
-        //std::cout << covariances_z << std::endl << std::endl;
-        std::cout << Info() << "covariancesC: " << std::endl;
-        std::cout << covariancesC << std::endl << std::endl;
-        std::cout << Info() << "covariancesT: " << std::endl;
-        std::cout << covariancesT << std::endl << std::endl;
-    }
+                getVariables(block, ient, hitBitsList_.at(ihb), variables1, variables2, variables3);
 
-    Eigen::MatrixXd solutionsC = Eigen::MatrixXd::Zero(1,nvariables_/2);
-    //solutionsC = covariancesC*(covariances_phi.inverse());
-    solutionsC = (covariances_phi.colPivHouseholderQr().solve(covariancesC.transpose())).transpose();
-
-    Eigen::MatrixXd solutionsT = Eigen::MatrixXd::Zero(1,nvariables_/2);
-    //solutionsT = covariancesT*(covariances_z.inverse());
-    solutionsT = (covariances_z.colPivHouseholderQr().solve(covariancesT.transpose())).transpose();
-
-    // Set PCAMatrix
-    mat_.nvariables  = nvariables_;
-    mat_.nparameters = nparameters_;
-    mat_.meansR      = meansR_;
-
-    mat_.meansC = meansC;  // incorrect: should be using delta of C
-    mat_.meansT = meansT;  // incorrect: should be using delta of T
-    mat_.solutionsC = solutionsC;
-    mat_.solutionsT = solutionsT;
-
-    if (verbose_>1) {
-        std::cout << Info() << "meansC: " << std::endl;
-        std::cout << mat_.meansC << std::endl << std::endl;
-        std::cout << Info() << "solutionsC: " << std::endl;
-        std::cout << mat_.solutionsC << std::endl << std::endl;
-        std::cout << Info() << "meansT: " << std::endl;
-        std::cout << mat_.meansT << std::endl << std::endl;
-        std::cout << Info() << "solutionsT: " << std::endl;
-        std::cout << mat_.solutionsT << std::endl << std::endl;
+                variables << variables1, variables2, simC, simT;
+                partial.at(iseg * nhitbits + ihb).fill(variables);
+            }
+        }
+    });
+
+    for (unsigned islot=0; islot<nslots(); ++islot) {
+        const Accumulator& accumulator = accumulators.at(islot);
+        const unsigned hitBits = hitBitsList_.at(islot % nhitbits);
+        PCAMatrix& mat = mats_.at(islot);
+
+        if (verbose_>1)  printSlot(islot);
+
+        const Eigen::VectorXd means = accumulator.getMeans().head(nvariables_);
+        const Eigen::MatrixXd covariances = accumulator.getCovariances().topLeftCorner(nvariables_, nvariables_);
+
+        Eigen::VectorXd meansC = Eigen::VectorXd::Zero(1);
+        Eigen::MatrixXd covariancesC = Eigen::MatrixXd::Zero(1, nvariables_/2);
+        meansC(0) = accumulator.getMeans()(nvariables_);
+        covariancesC = accumulator.getCovariances().block(nvariables_, 0, 1, nvariables_/2);
+
+        Eigen::VectorXd meansT = Eigen::VectorXd::Zero(1);
+        Eigen::MatrixXd covariancesT = Eigen::MatrixXd::Zero(1, nvariables_/2);
+        meansT(0) = accumulator.getMeans()(nvariables_ + 1);
+        covariancesT = accumulator.getCovariances().block(nvariables_ + 1, nvariables_/2, 1, nvariables_/2);
+
+        if (verbose_>1) {
+            std::cout << Info() << "means: " << std::endl;
+            std::cout << means << std::endl << std::endl;
+            std::cout << Info() << "covariances: " << std::endl;
+            std::cout << covariances << std::endl << std::endl;
+        }
+
+        // Find solutions for C & T
+        Eigen::MatrixXd covariances_phi = covariances.block(0,0,nvariables_/2,nvariables_/2);
+        setCovarianceToUnit(covariances_phi, nvariables_/2, hitBits);
+
+        Eigen::MatrixXd covariances_z = covariances.block(nvariables_/2,nvariables_/2,nvariables_/2,nvariables_/2);
+        setCovarianceToUnit(covariances_z, nvariables_/2, hitBits);
+
+        if (verbose_>1) {
+            //std::cout << Info() << "covariances_phi: " << std::endl;
+            //std::cout << covariances_phi << std::endl << std::endl;
+            //std::cout << Info() << "covariances_z: " << std::endl;
+            //std::cout << covariances_z << std::endl << std::endl;
+            std::cout << Info() << "covariancesC: " << std::endl;
+            std::cout << covariancesC << std::endl << std::endl;
+            std::cout << Info() << "covariancesT: " << std::endl;
+            std::cout << covariancesT << std::endl << std::endl;
+        }
+
+        Eigen::MatrixXd solutionsC = Eigen::MatrixXd::Zero(1,nvariables_/2);
+        //solutionsC = covariancesC*(covariances_phi.inverse());
+        solutionsC = (covariances_phi.colPivHouseholderQr().solve(covariancesC.transpose())).transpose();
+
+        Eigen::MatrixXd solutionsT = Eigen::MatrixXd::Zero(1,nvariables_/2);
+        //solutionsT = covariancesT*(covariances_z.inverse());
+        solutionsT = (covariances_z.colPivHouseholderQr().solve(covariancesT.transpose())).transpose();
+
+        // Set PCAMatrix
+        mat.nvariables  = nvariables_;
+        mat.nparameters = nparameters_;
+        mat.meansR      = meansR_;
+
+        mat.meansC = meansC;  // incorrect: should be using delta of C
+        mat.meansT = meansT;  // incorrect: should be using delta of T
+        mat.solutionsC = solutionsC;
+        mat.solutionsT = solutionsT;
+
+        if (verbose_>1) {
+            std::cout << Info() << "meansC: " << std::endl;
+            std::cout << mat.meansC << std::endl << std::endl;
+            std::cout << Info() << "solutionsC: " << std::endl;
+            std::cout << mat.solutionsC << std::endl << std::endl;
+            std::cout << Info() << "meansT: " << std::endl;
+            std::cout << mat.meansT << std::endl << std::endl;
+            std::cout << Info() << "solutionsT: " << std::endl;
+            std::cout << mat.solutionsT << std::endl << std::endl;
+        }
     }
     return 0;
 }
 
 // _____________________________________________________________________________
 // Loop over all events and solve for eigenvectors
-int MatrixBuilder::loopEventsAndSolveEigenvectors(TTStubReader& reader) {
+int MatrixBuilder::loopEventsAndSolveEigenvectors() {
 
     // Mean vector and covariance matrix
-    Eigen::VectorXd means = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::MatrixXd covariances = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
+    const unsigned nhitbits = hitBitsList_.size();
 
-    // Bookkeepers
-    long int nRead = 0, nKept = 0;
+    const AccumulatorSet accumulators = parallelAccumulate(cache_.nblocks(), po_.threads, AccumulatorSet(nslots(), Accumulator(nvariables_)),
+                                                           [&](unsigned iblock, AccumulatorSet& partial) {
+        MatrixEventCache::Block buffer;
+        const MatrixEventCache::Block& block = cache_.getBlock(iblock, buffer);
+        const unsigned long offset = (unsigned long) iblock * MatrixEventCache::BLOCK_SIZE;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
+        LayerVector variables1, variables2, variables3;
+        Accumulator::Vector variables(nvariables_);
 
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
+        for (unsigned ient=0; ient<block.size; ++ient) {
+            if (!keepEvents_.at(offset + ient))
+                continue;
 
-        if (!keepEvents_.at(ievt)) {
-            ++nRead;
-            continue;
-        }
+            const unsigned iseg = getSegment(block, ient);
 
-        // _____________________________________________________________________
-        // Calculate means and covariances for V
+            for (unsigned ihb=0; ihb<nhitbits; ++ihb) {
+                const unsigned islot = iseg * nhitbits + ihb;
+                const PCAMatrix& mat = mats_.at(islot);
 
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
+                // _____________________________________________________________
+                // Calculate means and covariances for V
 
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
+                getVariables(block, ient, hitBitsList_.at(ihb), variables1, variables2, variables3);
 
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
+                // Apply DeltaR correction
+                variables1 += ((mat.solutionsC * variables1)(0,0)) * variables3;
+                variables2 += ((mat.solutionsT * variables2)(0,0)) * variables3;
+
+                variables << variables1, variables2;
+                partial.at(islot).fill(variables);
+            }
         }
-        setVariableToZero(variables1, variables2, variables3, po_.hitBits);
+    });
 
-        // Apply DeltaR correction
-        variables1 += ((mat_.solutionsC * variables1)(0,0)) * variables3;
-        variables2 += ((mat_.solutionsT * variables2)(0,0)) * variables3;
+    for (unsigned islot=0; islot<nslots(); ++islot) {
+        const Accumulator& accumulator = accumulators.at(islot);
+        const unsigned hitBits = hitBitsList_.at(islot % nhitbits);
+        PCAMatrix& mat = mats_.at(islot);
 
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
+        if (verbose_>1)  printSlot(islot);
 
-        // Update mean vector
-        long int nTracks = nKept + 1;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            means(ivar) += (variables(ivar) - means(ivar))/nTracks;
-        }
+        const Eigen::VectorXd means = accumulator.getMeans();
+        const Eigen::MatrixXd covariances = accumulator.getCovariances();
 
-        // Update covariance matrix
-        if (nTracks > 1) {
-            for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-                for (unsigned jvar=0; jvar<nvariables_; ++jvar) {
-                    covariances(ivar, jvar) += (variables(ivar) - means(ivar)) * (variables(jvar) - means(jvar)) / (nTracks-1) - covariances(ivar, jvar)/nTracks;
-                }
-            }
+        if (verbose_>1) {
+            std::cout << Info() << "means: " << std::endl;
+            std::cout << means << std::endl << std::endl;
+            std::cout << Info() << "covariances: " << std::endl;
+            std::cout << covariances << std::endl << std::endl;
         }
 
-        ++nKept;
-        ++nRead;
-    }
-
-    if (verbose_>1) {
-        std::cout << Info() << "means: " << std::endl;
-        std::cout << means << std::endl << std::endl;
-        std::cout << Info() << "covariances: " << std::endl;
-        std::cout << covariances << std::endl << std::endl;
-    }
-
-    // Find eigenvectors of covariance matrix
-    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigensolver(covariances);
-    Eigen::VectorXd sqrtEigenvalues = Eigen::VectorXd::Zero(nvariables_);
-    for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-        sqrtEigenvalues(ivar) = std::sqrt(std::max(0., eigensolver.eigenvalues()(ivar)));
-    }
+        // Find eigenvectors of covariance matrix
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigensolver(covariances);
+        Eigen::VectorXd sqrtEigenvalues = Eigen::VectorXd::Zero(nvariables_);
+        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
+            sqrtEigenvalues(ivar) = std::sqrt(std::max(0., eigensolver.eigenvalues()(ivar)));
+        }
 
-    // Find matrix V
-    // V is the orthogonal transformation from coordinates space to principal components space
-    // The principal components are constraints + rotated track parameters
-    Eigen::MatrixXd V = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
-    V = (eigensolver.eigenvectors()).transpose();
+        // Find matrix V
+        // V is the orthogonal transformation from coordinates space to principal components space
+        // The principal components are constraints + rotated track parameters
+        Eigen::MatrixXd V = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
+        V = (eigensolver.eigenvectors()).transpose();
 
-    setRotationToZero(V, nvariables_, po_.hitBits);
+        setRotationToZero(V, nvariables_, hitBits);
 
-    // Set PCA matrix
-    mat_.sqrtEigenvalues = sqrtEigenvalues;
-    mat_.V = V;
+        // Set PCA matrix
+        mat.sqrtEigenvalues = sqrtEigenvalues;
+        mat.computeInvSqrtEigenvalues();
+        mat.V = V;
 
-    if (verbose_>1) {
-        std::cout << Info() << "sqrt(eigenvalues): " << std::endl;
-        std::cout << mat_.sqrtEigenvalues << std::endl << std::endl;
-        std::cout << Info() << "eigenvectors^T: " << std::endl;
-        std::cout << mat_.V << std::endl << std::endl;
+        if (verbose_>1) {
+            std::cout << Info() << "sqrt(eigenvalues): " << std::endl;
+            std::cout << mat.sqrtEigenvalues << std::endl << std::endl;
+            std::cout << Info() << "eigenvectors^T: " << std::endl;
+            std::cout << mat.V << std::endl << std::endl;
+        }
     }
     return 0;
 }
 
 // _____________________________________________________________________________
 // Loop over all events and solve for D
-int MatrixBuilder::loopEventsAndSolveD(TTStubReader& reader) {
+int MatrixBuilder::loopEventsAndSolveD() {
 
     // Mean vector and covariance matrix for principal components and track parameters
-    Eigen::VectorXd meansV = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::MatrixXd covariancesV = Eigen::MatrixXd::Zero(nvariables_, nvariables_);
+    const unsigned nhitbits = hitBitsList_.size();
 
-    Eigen::VectorXd meansP = Eigen::VectorXd::Zero(nparameters_);
-    Eigen::MatrixXd covariancesPV = Eigen::MatrixXd::Zero(nparameters_, nvariables_);
+    const AccumulatorSet accumulators = parallelAccumulate(cache_.nblocks(), po_.threads, AccumulatorSet(nslots(), Accumulator(nvariables_ + nparameters_)),
+                                                           [&](unsigned iblock, AccumulatorSet& partial) {
+        MatrixEventCache::Block buffer;
+        const MatrixEventCache::Block& block = cache_.getBlock(iblock, buffer);
+        const unsigned long offset = (unsigned long) iblock * MatrixEventCache::BLOCK_SIZE;
 
-    // Bookkeepers
-    long int nRead = 0, nKept = 0;
+        LayerVector variables1, variables2, variables3;
+        Accumulator::Vector variables(nvariables_), principals(nvariables_), parameters;
+        Accumulator::Vector principalsAndParameters(nvariables_ + nparameters_);
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
-
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
-
-        if (!keepEvents_.at(ievt)) {
-            ++nRead;
-            continue;
-        }
+        for (unsigned ient=0; ient<block.size; ++ient) {
+            if (!keepEvents_.at(offset + ient))
+                continue;
 
-        // _____________________________________________________________________
-        // Calculate V covariance matrix and PV covariance matrix
+            const unsigned iseg = getSegment(block, ient);
+            getParameters(block, ient, parameters);
 
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
+            for (unsigned ihb=0; ihb<nhitbits; ++ihb) {
+                const unsigned islot = iseg * nhitbits + ihb;
+                const PCAMatrix& mat = mats_.at(islot);
 
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
+                // _____________________________________________________________
+                // Calculate V covariance matrix and PV covariance matrix
 
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
-        }
-        setVariableToZero(variables1, variables2, variables3, po_.hitBits);
+                getVariables(block, ient, hitBitsList_.at(ihb), variables1, variables2, variables3);
 
-        // Apply DeltaR correction
-        variables1 += ((mat_.solutionsC * variables1)(0,0)) * variables3;
-        variables2 += ((mat_.solutionsT * variables2)(0,0)) * variables3;
+                // Apply DeltaR correction
+                variables1 += ((mat.solutionsC * variables1)(0,0)) * variables3;
+                variables2 += ((mat.solutionsT * variables2)(0,0)) * variables3;
 
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
+                variables << variables1, variables2;
 
-        Eigen::VectorXd parameters = Eigen::VectorXd::Zero(nparameters_);
+                // Transform coordinates to principal components
+                principals.noalias() = mat.V * variables;  // not using deltas of variables here!
 
-        // Get sim info
-        double simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
-        double simCotTheta     = std::sinh(reader.vp_eta->front());
-        double simPhi          = reader.vp_phi->front();
-        double simVz           = reader.vp_vz->front();
-        {
-            unsigned ipar = 0;
-            parameters(ipar++) = simPhi;
-            parameters(ipar++) = simCotTheta;
-            parameters(ipar++) = simVz;
-            parameters(ipar++) = simChargeOverPt;
+                principalsAndParameters << principals, parameters;
+                partial.at(islot).fill(principalsAndParameters);
+            }
         }
+    });
 
-        // Transform coordinates to principal components
-        Eigen::VectorXd principals = Eigen::VectorXd::Zero(nvariables_);
-        principals = mat_.V * variables;  // not using deltas of variables here!
+    for (unsigned islot=0; islot<nslots(); ++islot) {
+        const Accumulator& accumulator = accumulators.at(islot);
+        const unsigned hitBits = hitBitsList_.at(islot % nhitbits);
+        PCAMatrix& mat = mats_.at(islot);
 
-        // Update mean vectors
-        long int nTracks = nKept + 1;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            meansV(ivar) += (principals(ivar) - meansV(ivar))/nTracks;
-        }
+        if (verbose_>1)  printSlot(islot);
 
-        for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
-            meansP(ipar) += (parameters(ipar) - meansP(ipar))/nTracks;
-        }
+        const Eigen::VectorXd meansV = accumulator.getMeans().head(nvariables_);
+        const Eigen::VectorXd meansP = accumulator.getMeans().tail(nparameters_);
+        Eigen::MatrixXd covariancesV = accumulator.getCovariances().topLeftCorner(nvariables_, nvariables_);
+        const Eigen::MatrixXd covariancesPV = accumulator.getCovariances().bottomLeftCorner(nparameters_, nvariables_);
 
-        // Update covariance matrices
-        if (nTracks > 1) {
-            for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-                for (unsigned jvar=0; jvar<nvariables_; ++jvar) {
-                    covariancesV(ivar, jvar) += (principals(ivar) - meansV(ivar)) * (principals(jvar) - meansV(jvar)) / (nTracks-1) - covariancesV(ivar, jvar)/nTracks;
-                }
-            }
+        setCovarianceToUnit(covariancesV, nvariables_, hitBits);
 
-            for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
-                for (unsigned jvar=0; jvar<nvariables_; ++jvar) {
-                    covariancesPV(ipar, jvar) += (parameters(ipar) - meansP(ipar)) * (principals(jvar) - meansV(jvar)) / (nTracks-1) - covariancesPV(ipar, jvar)/nTracks;
-                }
-            }
+        if (verbose_>1) {
+            std::cout << Info() << "meansV: " << std::endl;
+            std::cout << meansV << std::endl << std::endl;
+            std::cout << Info() << "meansP: " << std::endl;
+            std::cout << meansP << std::endl << std::endl;
+            std::cout << Info() << "covariancesV: " << std::endl;
+            std::cout << covariancesV << std::endl << std::endl;
+            std::cout << Info() << "covariancesPV: " << std::endl;
+            std::cout << covariancesPV << std::endl << std::endl;
         }
 
-        ++nKept;
-        ++nRead;
-    }
-
-    setCovarianceToUnit(covariancesV, nvariables_, po_.hitBits);
-
-    if (verbose_>1) {
-        std::cout << Info() << "meansV: " << std::endl;
-        std::cout << meansV << std::endl << std::endl;
-        std::cout << Info() << "meansP: " << std::endl;
-        std::cout << meansP << std::endl << std::endl;
-        std::cout << Info() << "covariancesV: " << std::endl;
-        std::cout << covariancesV << std::endl << std::endl;
-        std::cout << Info() << "covariancesPV: " << std::endl;
-        std::cout << covariancesPV << std::endl << std::endl;
-    }
-
-    // Find matrix D
-    // D is the transformation from principal components to track parameters
-    Eigen::MatrixXd D = Eigen::MatrixXd::Zero(nparameters_, nvariables_);
-    //D = covariancesPV * covariancesV.inverse();
-    D = (covariancesV.colPivHouseholderQr().solve(covariancesPV.transpose())).transpose();
+        // Find matrix D
+        // D is the transformation from principal components to track parameters
+        Eigen::MatrixXd D = Eigen::MatrixXd::Zero(nparameters_, nvariables_);
+        //D = covariancesPV * covariancesV.inverse();
+        D = (covariancesV.colPivHouseholderQr().solve(covariancesPV.transpose())).transpose();
 
-    Eigen::MatrixXd DV = Eigen::MatrixXd::Zero(nparameters_, nvariables_);
-    DV = D * mat_.V;
+        Eigen::MatrixXd DV = Eigen::MatrixXd::Zero(nparameters_, nvariables_);
+        DV = D * mat.V;
 
-    // Set PCAMatrix
-    mat_.D = D;
-    mat_.DV = DV;
+        // Set PCAMatrix
+        mat.D = D;
+        mat.DV = DV;
 
-    if (verbose_>1) {
-        std::cout << Info() << "covariancesPV * covariancesV^{-1}: " << std::endl;
-        std::cout << mat_.D << std::endl << std::endl;
-        std::cout << Info() << "covariancesPV * covariancesV^{-1} * eigenvectors^T: " << std::endl;
-        std::cout << mat_.DV << std::endl << std::endl;
+        if (verbose_>1) {
+            std::cout << Info() << "covariancesPV * covariancesV^{-1}: " << std::endl;
+            std::cout << mat.D << std::endl << std::endl;
+            std::cout << Info() << "covariancesPV * covariancesV^{-1} * eigenvectors^T: " << std::endl;
+            std::cout << mat.DV << std::endl << std::endl;
+        }
     }
     return 0;
 }
 
 // _____________________________________________________________________________
 // Loop over all events and evaluate biases and resolutions
-int MatrixBuilder::loopEventsAndEval(TTStubReader& reader) {
-
-    // Get mean values
-    Eigen::VectorXd meansX = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::VectorXd meansV = Eigen::VectorXd::Zero(nvariables_);
-    Eigen::VectorXd meansP = Eigen::VectorXd::Zero(nparameters_);
+int MatrixBuilder::loopEventsAndEval() {
 
     // Statistics
-    std::vector<Statistics> statCT(2);
-    std::vector<Statistics> statX(nvariables_);
-    std::vector<Statistics> statV(nvariables_);
-    std::vector<Statistics> statP(nparameters_);
-    std::vector<Statistics> statP100GeV(nparameters_);
-
-    // Bookkeepers
-    long int nRead = 0, nKept = 0;
+    const unsigned nhitbits = hitBitsList_.size();
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
+    // Compute the fit results of a cached event
+    auto evaluate = [&](const MatrixEventCache::Block& block, const unsigned ient, const unsigned islot,
+                        Accumulator::Vector& variables, Accumulator::Vector& principals,
+                        Accumulator::Vector& parameters, Accumulator::Vector& parameters_fit,
+                        Accumulator::Vector& errCT) {
+        const PCAMatrix& mat = mats_.at(islot);
 
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
+        LayerVector variables1, variables2, variables3;
+        getVariables(block, ient, hitBitsList_.at(islot % nhitbits), variables1, variables2, variables3);
+        getParameters(block, ient, parameters);
 
-        if (!keepEvents_.at(ievt)) {
-            ++nRead;
-            continue;
-        }
+        // Apply DeltaR correction
+        variables1 += ((mat.solutionsC * variables1)(0,0)) * variables3;
+        variables2 += ((mat.solutionsT * variables2)(0,0)) * variables3;
 
-        // _____________________________________________________________________
-        // Start collecting statistics
+        variables << variables1, variables2;
 
-        Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables2 = Eigen::VectorXd::Zero(nvariables_/2);
-        Eigen::VectorXd variables3 = Eigen::VectorXd::Zero(nvariables_/2);
+        // Transform coordinates to principal components
+        principals.noalias() = mat.V * variables;  // not using deltas of variables here!
 
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
+        // Transform coordinates to parameters
+        parameters_fit.noalias() = mat.DV * variables;  // not using deltas of variables here!
 
-            variables1(istub) = stub_phi;
-            variables2(istub) = stub_z;
-            variables3(istub) = meansR_(istub) - stub_r;
-        }
-        setVariableToZero(variables1, variables2, variables3, po_.hitBits);
+        const double simC = -0.5 * (0.003 * 3.8 * parameters(3));  // 1/(2 x radius of curvature)
+        const double simT = parameters(1);
+        errCT(0) = ((mat.solutionsC * variables1)(0,0)) - simC;
+        errCT(1) = ((mat.solutionsT * variables2)(0,0)) - simT;
+    };
 
-        // Apply DeltaR correction
-        variables1 += ((mat_.solutionsC * variables1)(0,0)) * variables3;
-        variables2 += ((mat_.solutionsT * variables2)(0,0)) * variables3;
+    const EvalStatisticsSet stats = parallelAccumulate(cache_.nblocks(), po_.threads, EvalStatisticsSet(nslots(), EvalStatistics(nvariables_, nparameters_)),
+                                                       [&](unsigned iblock, EvalStatisticsSet& partial) {
+        MatrixEventCache::Block buffer;
+        const MatrixEventCache::Block& block = cache_.getBlock(iblock, buffer);
+        const unsigned long offset = (unsigned long) iblock * MatrixEventCache::BLOCK_SIZE;
 
-        Eigen::VectorXd variables = Eigen::VectorXd::Zero(nvariables_);
-        variables << variables1, variables2;
+        Accumulator::Vector variables(nvariables_), principals(nvariables_), parameters, parameters_fit(nparameters_), errCT(2);
 
-        Eigen::VectorXd parameters = Eigen::VectorXd::Zero(nparameters_);
+        for (unsigned ient=0; ient<block.size; ++ient) {
+            if (!keepEvents_.at(offset + ient))
+                continue;
 
-        // Get sim info
-        double simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
-        double simCotTheta     = std::sinh(reader.vp_eta->front());
-        double simPhi          = reader.vp_phi->front();
-        double simVz           = reader.vp_vz->front();
-        {
-            unsigned ipar = 0;
-            parameters(ipar++) = simPhi;
-            parameters(ipar++) = simCotTheta;
-            parameters(ipar++) = simVz;
-            parameters(ipar++) = simChargeOverPt;
-        }
+            const unsigned iseg = getSegment(block, ient);
 
-        // Transform coordinates to principal components
-        Eigen::VectorXd principals = Eigen::VectorXd::Zero(nvariables_);
-        principals = mat_.V * variables;  // not using deltas of variables here!
+            for (unsigned ihb=0; ihb<nhitbits; ++ihb) {
+                const unsigned islot = iseg * nhitbits + ihb;
+                EvalStatistics& stat = partial.at(islot);
 
-        // Transform coordinates to parameters
-        Eigen::VectorXd parameters_fit = Eigen::VectorXd::Zero(nparameters_);
-        parameters_fit = mat_.DV * variables;  // not using deltas of variables here!
+                // _____________________________________________________________
+                // Start collecting statistics
 
-        // Update mean vectors
-        long int nTracks = nKept + 1;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            meansX(ivar) += (variables(ivar) - meansX(ivar))/nTracks;
-        }
+                evaluate(block, ient, islot, variables, principals, parameters, parameters_fit, errCT);
 
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            meansV(ivar) += (principals(ivar) - meansV(ivar))/nTracks;
-        }
+                stat.statCT.fill(errCT);
+                stat.statX.fill(variables);
+                stat.statV.fill(principals);
+                stat.statP.fill(parameters_fit - parameters);
 
-        for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
-            meansP(ipar) += (parameters_fit(ipar) - parameters(ipar) - meansP(ipar))/nTracks;
+                if (std::abs(parameters(3)) < 1.0/100.) {
+                    stat.statP100GeV.fill(parameters_fit - parameters);
+                }
+            }
         }
+    });
 
-        // Collect statistics and fill histograms
-        const double simC = -0.5 * (0.003 * 3.8 * simChargeOverPt);  // 1/(2 x radius of curvature)
-        const double simT = simCotTheta;
-        statCT.at(0).fill(((mat_.solutionsC * variables1)(0,0)) - simC);
-        statCT.at(1).fill(((mat_.solutionsT * variables2)(0,0)) - simT);
+    // Fill histograms (only when building a single matrix)
+    if (po_.speedup<1 && !po_.matrixGrid) {
+        MatrixEventCache::Block buffer;
+        Accumulator::Vector variables(nvariables_), principals(nvariables_), parameters, parameters_fit(nparameters_), errCT(2);
+        const Eigen::VectorXd meansV = stats.at(0).statV.getMeans();
 
         TString hname;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            statX.at(ivar).fill(variables(ivar));
-            statV.at(ivar).fill(principals(ivar));
+        for (unsigned iblock=0; iblock<cache_.nblocks(); ++iblock) {
+            const MatrixEventCache::Block& block = cache_.getBlock(iblock, buffer);
+            const unsigned long offset = (unsigned long) iblock * MatrixEventCache::BLOCK_SIZE;
 
-            if (po_.speedup<1) {
-                hname = Form("var%i", ivar);
-                histograms_[hname]->Fill(variables(ivar));
+            for (unsigned ient=0; ient<block.size; ++ient) {
+                if (!keepEvents_.at(offset + ient))
+                    continue;
 
-                hname = Form("pc%i", ivar);
-                histograms_[hname]->Fill(principals(ivar));
+                evaluate(block, ient, 0, variables, principals, parameters, parameters_fit, errCT);
 
-                hname = Form("npc%i", ivar);
-                //assert(mat_.sqrtEigenvalues(ivar) > 0.);
-                histograms_[hname]->Fill((principals(ivar)- meansV(ivar)) / mat_.sqrtEigenvalues(ivar));
-            }
-        }
+                for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
+                    hname = Form("var%i", ivar);
+                    histograms_[hname]->Fill(variables(ivar));
 
-        for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
-            statP.at(ipar).fill(parameters_fit(ipar) - parameters(ipar));
+                    hname = Form("pc%i", ivar);
+                    histograms_[hname]->Fill(principals(ivar));
 
-            if (std::abs(simChargeOverPt) < 1.0/100.) {
-                statP100GeV.at(ipar).fill(parameters_fit(ipar) - parameters(ipar));
-            }
+                    hname = Form("npc%i", ivar);
+                    //assert(mats_.at(0).sqrtEigenvalues(ivar) > 0.);
+                    histograms_[hname]->Fill((principals(ivar)- meansV(ivar)) / mats_.at(0).sqrtEigenvalues(ivar));
+                }
 
-            if (po_.speedup<1) {
-                hname = Form("par%i", ipar);
-                histograms_[hname]->Fill(parameters(ipar));
+                for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
+                    hname = Form("par%i", ipar);
+                    histograms_[hname]->Fill(parameters(ipar));
 
-                hname = Form("fitpar%i", ipar);
-                histograms_[hname]->Fill(parameters_fit(ipar));
+                    hname = Form("fitpar%i", ipar);
+                    histograms_[hname]->Fill(parameters_fit(ipar));
 
-                hname = Form("errpar%i", ipar);
-                histograms_[hname]->Fill(parameters_fit(ipar) - parameters(ipar));
+                    hname = Form("errpar%i", ipar);
+                    histograms_[hname]->Fill(parameters_fit(ipar) - parameters(ipar));
+                }
             }
         }
-
-        ++nKept;
-        ++nRead;
     }
 
-    if (verbose_>1) {
-        std::ios::fmtflags flags = std::cout.flags();
-        std::cout << std::setprecision(4);
-        std::cout << Info() << "statX: " << std::endl;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            std::cout << "variable " << ivar << ": " << statX.at(ivar).getEntries() << " " << statX.at(ivar).getMean() << " " << statX.at(ivar).getSigma() << std::endl;
-        }
-        std::cout << Info() << "statV: " << std::endl;
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            std::cout << "principal " << ivar << ": " << statV.at(ivar).getEntries() << " " << statV.at(ivar).getMean() << " " << statV.at(ivar).getSigma() << std::endl;
+    for (unsigned islot=0; islot<nslots(); ++islot) {
+        const EvalStatistics& stat = stats.at(islot);
+        PCAMatrix& mat = mats_.at(islot);
+
+        if (verbose_>1)  printSlot(islot);
+
+        if (verbose_>1) {
+            std::ios::fmtflags flags = std::cout.flags();
+            std::cout << std::setprecision(4);
+            std::cout << Info() << "statX: " << std::endl;
+            for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
+                std::cout << "variable " << ivar << ": " << stat.statX.getEntries() << " " << stat.statX.getMean(ivar) << " " << stat.statX.getSigma(ivar) << std::endl;
+            }
+            std::cout << Info() << "statV: " << std::endl;
+            for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
+                std::cout << "principal " << ivar << ": " << stat.statV.getEntries() << " " << stat.statV.getMean(ivar) << " " << stat.statV.getSigma(ivar) << std::endl;
+            }
+            std::cout << Info() << "statCT: " << std::endl;
+            for (unsigned ipar=0; ipar<2; ++ipar) {
+                std::cout << "parameter " << ipar << ": " << stat.statCT.getEntries() << " " << stat.statCT.getMean(ipar) << " " << stat.statCT.getSigma(ipar) << std::endl;
+            }
+            std::cout << Info() << "statP: " << std::endl;
+            for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
+                std::cout << "parameter " << ipar << ": " << stat.statP.getEntries() << " " << stat.statP.getMean(ipar) << " " << stat.statP.getSigma(ipar) << std::endl;
+            }
+            std::cout << Info() << "statP100GeV: " << std::endl;
+            for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
+                std::cout << "parameter " << ipar << ": " << stat.statP100GeV.getEntries() << " " << stat.statP100GeV.getMean(ipar) << " " << stat.statP100GeV.getSigma(ipar) << std::endl;
+            }
+            std::cout.flags(flags);
         }
-        std::cout << Info() << "statCT: " << std::endl;
-        for (unsigned ipar=0; ipar<2; ++ipar) {
-            std::cout << "parameter " << ipar << ": " << statCT.at(ipar).getEntries() << " " << statCT.at(ipar).getMean() << " " << statCT.at(ipar).getSigma() << std::endl;
+
+        // Set PCAMatrix
+        mat.meansX = stat.statX.getMeans();  // after DeltaR correction
+        mat.meansV = stat.statV.getMeans();
+        mat.meansP = stat.statP.getMeans();
+
+        if (verbose_>1) {
+            std::cout << Info() << "meansX: " << std::endl;
+            std::cout << mat.meansX << std::endl << std::endl;
+            std::cout << Info() << "meansV: " << std::endl;
+            std::cout << mat.meansV << std::endl << std::endl;
+            std::cout << Info() << "meansP: " << std::endl;
+            std::cout << mat.meansP << std::endl << std::endl;
         }
-        std::cout << Info() << "statP: " << std::endl;
-        for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
-            std::cout << "parameter " << ipar << ": " << statP.at(ipar).getEntries() << " " << statP.at(ipar).getMean() << " " << statP.at(ipar).getSigma() << std::endl;
+    }
+    return 0;
+}
+
+// _____________________________________________________________________________
+// Write matrices
+int MatrixBuilder::writeMatrices(TString out) {
+    if (!po_.matrixGrid) {
+        PCAMatrix& mat = mats_.front();
+        if (verbose_) {
+            std::cout << Info() << "The matrices are:" << std::endl;
+            mat.print();
         }
-        std::cout << Info() << "statP100GeV: " << std::endl;
-        for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
-            std::cout << "parameter " << ipar << ": " << statP100GeV.at(ipar).getEntries() << " " << statP100GeV.at(ipar).getMean() << " " << statP100GeV.at(ipar).getSigma() << std::endl;
+        mat.write(out.Data());
+        return 0;
+    }
+
+    // Write the full set of matrices into the output directory
+    const unsigned nhitbits = hitBitsList_.size();
+    for (unsigned islot=0; islot<nslots(); ++islot) {
+        PCAMatrix& mat = mats_.at(islot);
+        mat.filename = Form("%s/matrices_tt%u_pt%u_hb%u.txt", out.Data(), po_.tower, islot / nhitbits, hitBitsList_.at(islot % nhitbits));
+        if (verbose_>1) {
+            std::cout << Info() << "The matrices are:" << std::endl;
+            mat.print();
         }
-        std::cout.flags(flags);
+        mat.write(mat.filename);
     }
+    if (verbose_)  std::cout << Info() << "Wrote " << nslots() << " matrices to " << out << std::endl;
 
-    // Set PCAMatrix
-    mat_.meansX = meansX;  // after DeltaR correction
-    mat_.meansV = meansV;
-    mat_.meansP = meansP;
-
-    if (verbose_>1) {
-        std::cout << Info() << "meansX: " << std::endl;
-        std::cout << mat_.meansX << std::endl << std::endl;
-        std::cout << Info() << "meansV: " << std::endl;
-        std::cout << mat_.meansV << std::endl << std::endl;
-        std::cout << Info() << "meansP: " << std::endl;
-        std::cout << mat_.meansP << std::endl << std::endl;
+    return writeBundle(Form("%s/matrices_tt%u.bin", out.Data(), po_.tower));
+}
+
+// _____________________________________________________________________________
+// Write the binary bundle of all the matrices
+int MatrixBuilder::writeBundle(TString out) {
+    if (nsegments_ != PCA_NSEGMENTS || hitBitsList_.size() != PCA_NHITBITS) {
+        std::cout << Error() << "The matrix bundle requires all invPt segments and hit bits." << std::endl;
+        return 1;
     }
+
+    PCAMatrixBundle::write(out.Data(), po_.tower, nsegments_, hitBitsList_.size(), mats_);
+    if (verbose_)  std::cout << Info() << "Wrote the matrix bundle " << out << std::endl;
+
     return 0;
 }
 
 // _____________________________________________________________________________
-// Write matrices
-int MatrixBuilder::writeMatrices(TString out) {
-    if (verbose_) {
-        std::cout << Info() << "The matrices are:" << std::endl;
-        mat_.print();
+// Read the text matrices of all invPt segments and hit bits
+int MatrixBuilder::readMatrices(TString src) {
+    const unsigned nhitbits = hitBitsList_.size();
+    for (unsigned islot=0; islot<nslots(); ++islot) {
+        PCAMatrix& mat = mats_.at(islot);
+        mat.read(Form("%s/matrices_tt%u_pt%u_hb%u.txt", src.Data(), po_.tower, islot / nhitbits, hitBitsList_.at(islot % nhitbits)));
+
+        if (mat.nvariables != nvariables_ || mat.nparameters != nparameters_) {
+            std::cout << Error() << "Unexpected dimensions in " << mat.filename << std::endl;
+            return 1;
+        }
     }
-    mat_.write(out.Data());
+    if (verbose_)  std::cout << Info() << "Read " << nslots() << " matrices from " << src << std::endl;
 
     return 0;
 }
@@ -962,6 +944,9 @@ int MatrixBuilder::writeMatrices(TString out) {
 // _____________________________________________________________________________
 // Write histograms
 int MatrixBuilder::writeHistograms(TString out) {
+    if (po_.matrixGrid)
+        return 0;
+
     TFile* outfile = TFile::Open(out.ReplaceAll(".txt",".root"), "RECREATE");
     for (std::map<TString, TH1F *>::const_iterator it=histograms_.begin();
          it!=histograms_.end(); ++it) {
@@ -980,6 +965,19 @@ int MatrixBuilder::run() {
     int exitcode = 0;
     Timing(1);
 
+    // Only convert existing text matrices into a binary bundle
+    if (po_.matrixBundle) {
+        exitcode = readMatrices(po_.input);
+        if (exitcode)  return exitcode;
+        Timing();
+
+        exitcode = writeBundle(po_.output);
+        if (exitcode)  return exitcode;
+        Timing();
+
+        return exitcode;
+    }
+
     exitcode = bookHistograms();
     if (exitcode)  return exitcode;
     Timing();
@@ -0,0 +1,105 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/MatrixEventCache.h"
+using namespace slhcl1tt;
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+
+// _____________________________________________________________________________
+MatrixEventCache::MatrixEventCache(unsigned long maxEventsInMemory)
+: maxBlocksInMemory_(std::max(1ul, maxEventsInMemory / BLOCK_SIZE)), size_(0), spillFile_(0) {}
+
+MatrixEventCache::~MatrixEventCache() {
+    clear();
+}
+
+// _____________________________________________________________________________
+void MatrixEventCache::clear() {
+    for (unsigned i=0; i<blocks_.size(); ++i) {
+        delete blocks_.at(i);
+    }
+    blocks_.clear();
+    offsets_.clear();
+    size_ = 0;
+
+    if (spillFile_) {
+        std::fclose(spillFile_);
+        spillFile_ = 0;
+    }
+}
+
+// _____________________________________________________________________________
+void MatrixEventCache::push_back(const float * stubs_r, const float * stubs_phi, const float * stubs_z,
+                                 float simChargeOverPt, float simCotTheta, float simPhi, float simVz) {
+    if (blocks_.empty() || blocks_.back()->size == BLOCK_SIZE) {
+        // Spill the last full block if the memory budget is used up
+        if (blocks_.size() - nspilled() >= maxBlocksInMemory_) {
+            spill(blocks_.back());
+            blocks_.back() = 0;
+        }
+        blocks_.push_back(new Block());
+        blocks_.back()->data.assign(NCOLUMNS * BLOCK_SIZE, 0.);
+        offsets_.push_back(-1);
+    }
+
+    Block& block = *blocks_.back();
+    const unsigned i = block.size;
+    for (unsigned istub=0; istub<NSTUBS; ++istub) {
+        block.column(STUB_R   + istub)[i] = stubs_r[istub];
+        block.column(STUB_PHI + istub)[i] = stubs_phi[istub];
+        block.column(STUB_Z   + istub)[i] = stubs_z[istub];
+    }
+    block.column(SIM_CHARGEOVERPT)[i] = simChargeOverPt;
+    block.column(SIM_COTTHETA)    [i] = simCotTheta;
+    block.column(SIM_PHI)         [i] = simPhi;
+    block.column(SIM_VZ)          [i] = simVz;
+
+    ++block.size;
+    ++size_;
+}
+
+// _____________________________________________________________________________
+unsigned MatrixEventCache::nspilled() const {
+    unsigned n = 0;
+    for (unsigned i=0; i<blocks_.size(); ++i) {
+        if (blocks_.at(i) == 0)
+            ++n;
+    }
+    return n;
+}
+
+// _____________________________________________________________________________
+const MatrixEventCache::Block& MatrixEventCache::getBlock(unsigned iblock, Block& buffer) const {
+    if (blocks_.at(iblock))
+        return *blocks_.at(iblock);
+
+    // Read back from the spill file; spilled blocks are always full
+    assert(spillFile_ != 0);
+    buffer.data.resize(NCOLUMNS * BLOCK_SIZE);
+    std::lock_guard<std::mutex> lock(spillMutex_);
+    if (std::fseek(spillFile_, offsets_.at(iblock), SEEK_SET) != 0 ||
+        std::fread(&buffer.data[0], sizeof(float), buffer.data.size(), spillFile_) != buffer.data.size()) {
+        throw std::runtime_error("Failed to read back the spilled event cache.");
+    }
+    buffer.size = BLOCK_SIZE;
+    return buffer;
+}
+
+// _____________________________________________________________________________
+void MatrixEventCache::spill(Block * block) {
+    assert(block != 0 && block->size == BLOCK_SIZE);
+
+    if (!spillFile_) {
+        spillFile_ = std::tmpfile();
+        if (!spillFile_)
+            throw std::runtime_error("Failed to create the spill file for the event cache.");
+    }
+
+    std::fseek(spillFile_, 0, SEEK_END);
+    offsets_.back() = std::ftell(spillFile_);
+    if (std::fwrite(&block->data[0], sizeof(float), block->data.size(), spillFile_) != block->data.size()) {
+        throw std::runtime_error("Failed to spill the event cache.");
+    }
+    delete block;
+}
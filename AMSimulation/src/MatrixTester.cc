@@ -1,7 +1,8 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/MatrixTester.h"
 
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTStubReader.h"
-#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Statistics.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/MatrixEventCache.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ParallelFor.h"
 #include <iomanip>
 #include <fstream>
 
@@ -14,6 +15,7 @@ int MatrixTester::testMatrices(TString src) {
     // _________________________________________________________________________
     // For reading
     TTStubReader reader(verbose_);
+    reader.setReadAhead(po_.readCacheSize, po_.readAhead);
     if (reader.init(src, false)) {
         std::cout << Error() << "Failed to initialize TTStubReader." << std::endl;
         return 1;
@@ -28,8 +30,13 @@ int MatrixTester::testMatrices(TString src) {
 
     if (verbose_)  std::cout << Info() << "Begin event filtering" << std::endl;
 
-    // Event decisions
-    std::vector<bool> keepEvents;
+    // Events that pass the filter
+    MatrixEventCache cache;
+
+    if (po_.nLayers != MatrixEventCache::NSTUBS) {
+        std::cout << Error() << "The event cache expects " << MatrixEventCache::NSTUBS << " layers." << std::endl;
+        return 1;
+    }
 
     // Bookkeepers
     long int nRead = 0, nKept = 0;
@@ -45,10 +52,9 @@ int MatrixTester::testMatrices(TString src) {
         // Apply track invPt requirement
         assert(reader.vp_pt->size() == 1);
         double simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
-        //double simCotTheta     = std::sinh(reader.vp_eta->front());
+        double simCotTheta     = std::sinh(reader.vp_eta->front());
         if (simChargeOverPt < po_.minInvPt || po_.maxInvPt < simChargeOverPt) {
             ++nRead;
-            keepEvents.push_back(false);
             continue;
         }
 
@@ -62,14 +68,16 @@ int MatrixTester::testMatrices(TString src) {
         }
         if (ngoodstubs != po_.nLayers) {
             ++nRead;
-            keepEvents.push_back(false);
             continue;
         }
         assert(nstubs == po_.nLayers);
 
+        // Store the event in the cache
+        cache.push_back(&reader.vb_r->front(), &reader.vb_phi->front(), &reader.vb_z->front(),
+                        simChargeOverPt, simCotTheta, reader.vp_phi->front(), reader.vp_vz->front());
+
         ++nKept;
         ++nRead;
-        keepEvents.push_back(true);
     }
 
     if (nRead == 0) {
@@ -85,129 +93,108 @@ int MatrixTester::testMatrices(TString src) {
 
     if (verbose_)  std::cout << Info() << "Begin first loop on tracks" << std::endl;
 
-    // Containers
-    std::vector<TTTrack2> tracks;
-    tracks.reserve(300);
-
     // Statistics
-    std::vector<Statistics> statV(nvariables_);
-    std::vector<Statistics> statP(nparameters_);
-
-    // Bookkeepers
-    nRead = 0, nKept = 0;
+    struct TestStatistics {
+        TestStatistics(unsigned nvariables, unsigned nparameters)
+        : statV(nvariables), statP(nparameters) {}
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
-
-        const unsigned nstubs = reader.vb_modId->size();
-        if (verbose_>1 && ievt%100000==0)  std::cout << Debug() << Form("... Processing event: %7lld, keeping: %7ld", ievt, nKept) << std::endl;
-
-        if (!keepEvents.at(ievt)) {
-            ++nRead;
-            continue;
+        void merge(const TestStatistics& other) {
+            statV.merge(other.statV);
+            statP.merge(other.statP);
         }
 
-        // _____________________________________________________________________
-        // Start fitting tracks
+        Accumulator statV, statP;
+    };
 
-        tracks.clear();
-        int fitstatus = 0;
+    const unsigned nblocks = cache.nblocks();
+    std::vector<TestStatistics> partials(nblocks, TestStatistics(nvariables_, nparameters_));
 
-        // Create and set TTRoadComb
-        TTRoadComb acomb;
-        acomb.roadRef    = 0;
-        acomb.combRef    = 0;
-        acomb.patternRef = 0;
-        acomb.ptSegment  = 0;
-        acomb.hitBits    = 0;
+    parallelFor(nblocks, po_.threads, [&](unsigned iblock) {
+        MatrixEventCache::Block buffer;
+        const MatrixEventCache::Block& block = cache.getBlock(iblock, buffer);
+        TestStatistics& stat = partials.at(iblock);
 
-        acomb.stubRefs.clear();
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            acomb.stubRefs.push_back(istub);
-        }
+        Accumulator::Vector principals(nvariables_), parameters(nparameters_), parameters_fit(nparameters_);
 
-        acomb.stubs_r   .clear();
-        acomb.stubs_phi .clear();
-        acomb.stubs_z   .clear();
-        acomb.stubs_bool.clear();
-
-        for (unsigned istub=0; istub<acomb.stubRefs.size(); ++istub) {
-            const unsigned stubRef = acomb.stubRefs.at(istub);
-            if (stubRef != 999999) {
-                acomb.stubs_r   .push_back(reader.vb_r   ->at(stubRef));
-                acomb.stubs_phi .push_back(reader.vb_phi ->at(stubRef));
-                acomb.stubs_z   .push_back(reader.vb_z   ->at(stubRef));
-                acomb.stubs_bool.push_back(true);
-            } else {
-                acomb.stubs_r   .push_back(0.);
-                acomb.stubs_phi .push_back(0.);
-                acomb.stubs_z   .push_back(0.);
-                acomb.stubs_bool.push_back(false);
-            }
-        }
+        for (unsigned ient=0; ient<block.size; ++ient) {
 
-        // _____________________________________________________________________
-        // Fit
-        TTTrack2 atrack;
-        fitstatus = fitterPCA_->fit(acomb, atrack);
+            // _________________________________________________________________
+            // Start fitting tracks
 
-        atrack.setTower     (po_.tower);
-        atrack.setRoadRef   (acomb.roadRef);
-        atrack.setCombRef   (acomb.combRef);
-        atrack.setPatternRef(acomb.patternRef);
-        atrack.setPtSegment (acomb.ptSegment);
-        atrack.setHitBits   (acomb.hitBits);
-        atrack.setStubRefs  (acomb.stubRefs);
-        tracks.push_back(atrack);
+            int fitstatus = 0;
 
-        if (verbose_>2)  std::cout << Debug() << "... track: " << 0 << " status: " << fitstatus << std::endl;
+            // Create and set TTRoadComb
+            TTRoadComb acomb;
+            acomb.roadRef    = 0;
+            acomb.combRef    = 0;
+            acomb.patternRef = 0;
+            acomb.ptSegment  = 0;
+            acomb.hitBits    = 0;
 
+            acomb.stubRefs.clear();
+            for (unsigned istub=0; istub<MatrixEventCache::NSTUBS; ++istub) {
+                acomb.stubRefs.push_back(istub);
+            }
 
-        std::vector<float> principals(nvariables_);
-        std::vector<double> parameters(nparameters_);
-        std::vector<double> parameters_fit(nparameters_);
+            acomb.stubs_r   .clear();
+            acomb.stubs_phi .clear();
+            acomb.stubs_z   .clear();
+            acomb.stubs_bool.clear();
 
-        // _____________________________________________________________________
-        // Get sim info
-        double simCotTheta     = std::sinh(reader.vp_eta->front());
-        double simChargeOverPt = float(reader.vp_charge->front())/reader.vp_pt->front();
-        double simPhi          = reader.vp_phi->front();
-        double simVz           = reader.vp_vz->front();
-        //double simC = -0.5 * (0.003 * 3.8 * simChargeOverPt);  // 1/(2 x radius of curvature)
-        //double simT = simCotTheta;
-        {
-            unsigned ipar = 0;
-            parameters.at(ipar++) = simPhi;
-            parameters.at(ipar++) = simCotTheta;
-            parameters.at(ipar++) = simVz;
-            parameters.at(ipar++) = simChargeOverPt;
-        }
-
-        // _____________________________________________________________________
-        // Get fit info
-        {
-            unsigned ipar = 0;
-            parameters_fit.at(ipar++) = atrack.phi0();
-            parameters_fit.at(ipar++) = atrack.cottheta();
-            parameters_fit.at(ipar++) = atrack.z0();
-            parameters_fit.at(ipar++) = atrack.invPt();
-
-            assert(atrack.principals().size() == nvariables_);
-            principals = atrack.principals();
-        }
+            for (unsigned istub=0; istub<acomb.stubRefs.size(); ++istub) {
+                acomb.stubs_r   .push_back(block.r(istub)  [ient]);
+                acomb.stubs_phi .push_back(block.phi(istub)[ient]);
+                acomb.stubs_z   .push_back(block.z(istub)  [ient]);
+                acomb.stubs_bool.push_back(true);
+            }
 
+            // _________________________________________________________________
+            // Fit
+            TTTrack2 atrack;
+            fitstatus = fitterPCA_->fit(acomb, atrack);
+
+            if (verbose_>2)  std::cout << Debug() << "... track: " << 0 << " status: " << fitstatus << std::endl;
+
+            // _________________________________________________________________
+            // Get sim info
+            double simChargeOverPt = block.column(MatrixEventCache::SIM_CHARGEOVERPT)[ient];
+            double simCotTheta     = block.column(MatrixEventCache::SIM_COTTHETA)    [ient];
+            double simPhi          = block.column(MatrixEventCache::SIM_PHI)         [ient];
+            double simVz           = block.column(MatrixEventCache::SIM_VZ)          [ient];
+            //double simC = -0.5 * (0.003 * 3.8 * simChargeOverPt);  // 1/(2 x radius of curvature)
+            //double simT = simCotTheta;
+            {
+                unsigned ipar = 0;
+                parameters(ipar++) = simPhi;
+                parameters(ipar++) = simCotTheta;
+                parameters(ipar++) = simVz;
+                parameters(ipar++) = simChargeOverPt;
+            }
 
-        for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            statV.at(ivar).fill(principals.at(ivar));
-        }
+            // _________________________________________________________________
+            // Get fit info
+            {
+                unsigned ipar = 0;
+                parameters_fit(ipar++) = atrack.phi0();
+                parameters_fit(ipar++) = atrack.cottheta();
+                parameters_fit(ipar++) = atrack.z0();
+                parameters_fit(ipar++) = atrack.invPt();
+
+                const TTConstSpan<float> principals_vec = atrack.principals();
+                assert(principals_vec.size() == nvariables_);
+                for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
+                    principals(ivar) = principals_vec.at(ivar);
+                }
+            }
 
-        for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
-            statP.at(ipar).fill(parameters_fit.at(ipar) - parameters.at(ipar));
+            stat.statV.fill(principals);
+            stat.statP.fill(parameters_fit - parameters);
         }
+    });
 
-        ++nKept;
-        ++nRead;
+    TestStatistics stat(nvariables_, nparameters_);
+    for (unsigned iblock=0; iblock<nblocks; ++iblock) {
+        stat.merge(partials.at(iblock));
     }
 
     if (verbose_>1) {
@@ -215,11 +202,11 @@ int MatrixTester::testMatrices(TString src) {
         std::cout << std::setprecision(4);
         std::cout << Info() << "statV: " << std::endl;
         for (unsigned ivar=0; ivar<nvariables_; ++ivar) {
-            std::cout << "principal " << ivar << ": " << statV.at(ivar).getEntries() << " " << statV.at(ivar).getMean() << " " << statV.at(ivar).getSigma() << std::endl;
+            std::cout << "principal " << ivar << ": " << stat.statV.getEntries() << " " << stat.statV.getMean(ivar) << " " << stat.statV.getSigma(ivar) << std::endl;
         }
         std::cout << Info() << "statP: " << std::endl;
         for (unsigned ipar=0; ipar<nparameters_; ++ipar) {
-            std::cout << "parameter " << ipar << ": " << statP.at(ipar).getEntries() << " " << statP.at(ipar).getMean() << " " << statP.at(ipar).getSigma() << std::endl;
+            std::cout << "parameter " << ipar << ": " << stat.statP.getEntries() << " " << stat.statP.getMean(ipar) << " " << stat.statP.getSigma(ipar) << std::endl;
         }
         std::cout.flags(flags);
     }
@@ -20,6 +20,7 @@ int NTupleMaker::readRoads(TString src) {
         std::cout << Error() << "Failed to read " << src << std::endl;
         return 1;
     }
+    SetReadAhead(chain_roads_, po_.readCacheSize, po_.readAhead);
     return 0;
 }
 
@@ -40,6 +41,7 @@ int NTupleMaker::readTracks(TString src) {
         std::cout << Error() << "Failed to read " << src << std::endl;
         return 1;
     }
+    SetReadAhead(chain_tracks_, po_.readCacheSize, po_.readAhead);
     return 0;
 }
 
@@ -72,6 +74,7 @@ int NTupleMaker::readFile(TString src) {
             return 1;
         }
     }
+    SetReadAhead(chain_, po_.readCacheSize, po_.readAhead);
     return 0;
 }
 
@@ -92,10 +92,20 @@ int PCAMatrix::read(const std::string txt) {
     DV = Eigen::MatrixXd::Zero(nparameters, nvariables);
     DV = D * V;
 
+    computeInvSqrtEigenvalues();
+
     infile.close();
     return 0;
 }
 
+void PCAMatrix::computeInvSqrtEigenvalues() {
+    invSqrtEigenvalues = Eigen::VectorXd::Zero(sqrtEigenvalues.size());
+    for (unsigned ivar=0; ivar<sqrtEigenvalues.size(); ++ivar) {
+        if (sqrtEigenvalues(ivar) > 0.)
+            invSqrtEigenvalues(ivar) = 1.0 / sqrtEigenvalues(ivar);
+    }
+}
+
 int PCAMatrix::write(const std::string txt) {
 
     // Write to a file
@@ -0,0 +1,174 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PCAMatrixBundle.h"
+using namespace slhcl1tt;
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const char magic[8] = {'P','C','A','M','A','T','R','X'};
+
+template<typename Derived>
+void copyTo(const Eigen::MatrixBase<Derived>& m, double * dst, unsigned ld) {
+    for (unsigned i=0; i<m.rows(); ++i) {
+        for (unsigned j=0; j<m.cols(); ++j) {
+            dst[i * ld + j] = m(i, j);
+        }
+    }
+}
+
+template<typename Derived>
+void copyFrom(const double * src, unsigned ld, Eigen::MatrixBase<Derived>& m) {
+    for (unsigned i=0; i<m.rows(); ++i) {
+        for (unsigned j=0; j<m.cols(); ++j) {
+            m(i, j) = src[i * ld + j];
+        }
+    }
+}
+}
+
+
+// _____________________________________________________________________________
+int PCAMatrixBundle::open(const std::string bin) {
+    close();
+
+    int fd = ::open(bin.c_str(), O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(Header)) {
+        ::close(fd);
+        std::cout << "Unable to read " << bin << std::endl;
+        throw std::runtime_error("Unable to read matrix bundle.");
+    }
+
+    length_ = st.st_size;
+    data_ = ::mmap(0, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data_ == MAP_FAILED) {
+        data_ = 0;
+        std::cout << "Unable to map " << bin << std::endl;
+        throw std::runtime_error("Unable to map matrix bundle.");
+    }
+
+    header_  = static_cast<const Header *>(data_);
+    records_ = reinterpret_cast<const Record *>(static_cast<const char *>(data_) + sizeof(Header));
+
+    if (std::memcmp(header_->magic, magic, sizeof(magic)) != 0 ||
+        header_->version != VERSION ||
+        header_->headerSize != sizeof(Header) ||
+        header_->recordSize != sizeof(Record) ||
+        length_ != sizeof(Header) + size() * sizeof(Record)) {
+        close();
+        std::cout << "Incompatible matrix bundle " << bin << std::endl;
+        throw std::runtime_error("Incompatible matrix bundle.");
+    }
+    return 0;
+}
+
+void PCAMatrixBundle::close() {
+    if (data_)
+        ::munmap(data_, length_);
+    data_ = 0;
+    length_ = 0;
+    header_ = 0;
+    records_ = 0;
+}
+
+// _____________________________________________________________________________
+int PCAMatrixBundle::write(const std::string bin, unsigned tower, unsigned nsegments, unsigned nhitbits,
+                           const std::vector<PCAMatrix>& matrices) {
+    assert(matrices.size() == nsegments * nhitbits);
+
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version     = VERSION;
+    header.headerSize  = sizeof(Header);
+    header.recordSize  = sizeof(Record);
+    header.tower       = tower;
+    header.nsegments   = nsegments;
+    header.nhitbits    = nhitbits;
+    header.nvariables  = matrices.empty() ? 0 : matrices.front().nvariables;
+    header.nparameters = matrices.empty() ? 0 : matrices.front().nparameters;
+
+    std::vector<Record> records(matrices.size());
+    std::memset(records.data(), 0, records.size() * sizeof(Record));
+
+    for (unsigned i=0; i<matrices.size(); ++i) {
+        const PCAMatrix& mat = matrices.at(i);
+        Record& rec = records.at(i);
+
+        if (mat.nvariables > MAX_NVARIABLES || mat.nparameters > MAX_NPARAMETERS ||
+            mat.nvariables != header.nvariables || mat.nparameters != header.nparameters) {
+            std::cout << "Matrix " << mat.filename << " does not fit in the bundle" << std::endl;
+            throw std::runtime_error("Unable to write matrix bundle.");
+        }
+
+        rec.nvariables  = mat.nvariables;
+        rec.nparameters = mat.nparameters;
+
+        copyTo(mat.meansR.transpose(), rec.meansR, 0);
+        rec.meansC = mat.meansC(0);
+        rec.meansT = mat.meansT(0);
+        copyTo(mat.solutionsC, rec.solutionsC, 0);
+        copyTo(mat.solutionsT, rec.solutionsT, 0);
+
+        copyTo(mat.sqrtEigenvalues.transpose(), rec.sqrtEigenvalues, 0);
+        copyTo(mat.meansX.transpose(), rec.meansX, 0);
+        copyTo(mat.meansV.transpose(), rec.meansV, 0);
+        copyTo(mat.meansP.transpose(), rec.meansP, 0);
+        copyTo(mat.V , rec.V [0], MAX_NVARIABLES);
+        copyTo(mat.D , rec.D [0], MAX_NVARIABLES);
+        copyTo(mat.DV, rec.DV[0], MAX_NVARIABLES);
+    }
+
+    std::ofstream outfile(bin.c_str(), std::ios::binary);
+    if (!outfile) {
+        std::cout << "Unable to open " << bin << std::endl;
+        throw std::runtime_error("Unable to open output file.");
+    }
+
+    outfile.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    outfile.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(Record));
+    outfile.close();
+    return 0;
+}
+
+// _____________________________________________________________________________
+void PCAMatrixBundle::get(unsigned i, PCAMatrix& mat) const {
+    assert(i < size());
+    const Record& rec = record(i);
+    const unsigned nvariables  = rec.nvariables;
+    const unsigned nparameters = rec.nparameters;
+
+    mat.nvariables  = nvariables;
+    mat.nparameters = nparameters;
+
+    mat.meansR = Eigen::Map<const Eigen::VectorXd>(rec.meansR, nvariables/2);
+    mat.meansC = Eigen::VectorXd::Constant(1, rec.meansC);
+    mat.meansT = Eigen::VectorXd::Constant(1, rec.meansT);
+    mat.solutionsC = Eigen::Map<const Eigen::MatrixXd>(rec.solutionsC, 1, nvariables/2);
+    mat.solutionsT = Eigen::Map<const Eigen::MatrixXd>(rec.solutionsT, 1, nvariables/2);
+
+    mat.sqrtEigenvalues = Eigen::Map<const Eigen::VectorXd>(rec.sqrtEigenvalues, nvariables);
+    mat.meansX = Eigen::Map<const Eigen::VectorXd>(rec.meansX, nvariables);
+    mat.meansV = Eigen::Map<const Eigen::VectorXd>(rec.meansV, nvariables);
+    mat.meansP = Eigen::Map<const Eigen::VectorXd>(rec.meansP, nparameters);
+
+    mat.V  = Eigen::MatrixXd::Zero(nvariables , nvariables);
+    mat.D  = Eigen::MatrixXd::Zero(nparameters, nvariables);
+    mat.DV = Eigen::MatrixXd::Zero(nparameters, nvariables);
+    copyFrom(rec.V [0], MAX_NVARIABLES, mat.V);
+    copyFrom(rec.D [0], MAX_NVARIABLES, mat.D);
+    copyFrom(rec.DV[0], MAX_NVARIABLES, mat.DV);
+
+    mat.computeInvSqrtEigenvalues();
+}
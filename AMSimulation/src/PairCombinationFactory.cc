@@ -3,100 +3,186 @@ using namespace slhcl1tt;
 
 #include <iostream>
 
-float PairCombinationFactory::Coarsener(float DeltaS, int precision, int layer){ //maximum precision is 4, minimum 2
-  float Coarsed=0.;
-  if(layer<3) Coarsed = DeltaS-((int)(2*DeltaS)%(int)pow(2,3-(precision-1)))/2.;
-  else        Coarsed = DeltaS-((int)(2*DeltaS)%(int)pow(2,4-precision))/2.;
-  return Coarsed;
+namespace {
+//DDS precision, maximum is 4, minimum 2
+const int precision = 4;
+
+//pairwise DDS cut of the layer pairs (0,1), (1,2), (2,3), (3,4), (4,5)
+const float cuts[5] = {1.5, 2.5, 3.0, 2.0, 2.0};
+
+//layer searched at each depth
+const unsigned layerOrder[6] = {1, 0, 3, 2, 5, 4};
+
+//mask of the first n stubs
+inline uint64_t firstStubs(unsigned n) {
+  return n >= 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+}
+}
+
+PairCombinationFactory::PairCombinationFactory() : verbose_(true), depth_(-1), ntruncated_(0) {
+  //coarsening as a power of two per layer
+  for(unsigned layer=0; layer<6; ++layer){
+    if(layer<3) coarsening_[layer] = 1 << (3-(precision-1));
+    else        coarsening_[layer] = 1 << (4-precision);
+  }
+}
+
+float PairCombinationFactory::Coarsener(float DeltaS, int layer) const {
+  return DeltaS-((int)(2*DeltaS)%coarsening_[layer])/2.;
+}
+
+uint64_t PairCombinationFactory::Candidates(unsigned depth) const {
+  const unsigned a1 = chosen_[0], a3 = chosen_[2], a5 = chosen_[4];
+  uint64_t mask = 0, pairs = 0;
+  switch(depth){
+  case 0: //all stubs of layer 1
+    return firstStubs(nstubs_[1]);
+  case 1: //stubs of layer 0 compatible with a1
+    return up_[0][a1];
+  case 2: //stubs of layer 3 compatible with a stub of layer 2 compatible with a1
+    pairs = down_[1][a1];
+    for(; pairs; pairs &= pairs-1) mask |= down_[2][__builtin_ctzll(pairs)];
+    return mask;
+  case 3: //stubs of layer 2 compatible with a1 and a3
+    return down_[1][a1] & up_[2][a3];
+  case 4: //stubs of layer 5 compatible with a stub of layer 4 compatible with a3
+    pairs = down_[3][a3];
+    for(; pairs; pairs &= pairs-1) mask |= down_[4][__builtin_ctzll(pairs)];
+    return mask;
+  case 5: //stubs of layer 4 compatible with a3 and a5
+    return down_[3][a3] & up_[4][a5];
+  default:
+    return 0;
+  }
+}
+
+void PairCombinationFactory::start(const std::vector<std::vector<unsigned> >& groups, const std::vector<std::vector<float> >& DeltaS, bool FiveOfSix) {
+  depth_=-1; //no combination
+
+  unsigned ngroups = groups.size(); //number of layers
+  if(ngroups!=6) return; //catch less than 6 layers present
+
+  //compose all the layer information: stub address and coarsened DeltaS value, 0 is innermost, 5 is outermost
+  bool truncated=false;
+  for(unsigned layer=0; layer<6; ++layer){
+    unsigned n=0;
+    //add a dummy to empty layers, and in front of nonempty layers if 5/6 permutations are desired
+    if(groups[layer].empty() || FiveOfSix){
+      stubs_[layer][n]=PairCombinationFactory::BAD;
+      deltaS_[layer][n]=Coarsener(999.,layer);
+      ++n;
+    }
+    unsigned j=0;
+    for(; j<groups[layer].size() && n<MAX_STUBS; ++j, ++n){
+      stubs_[layer][n]=groups[layer][j];
+      deltaS_[layer][n]=Coarsener(DeltaS[layer][j],layer);
+    }
+    if(j<groups[layer].size()) truncated=true; //stubs dropped
+    nstubs_[layer]=n;
+  }
+  if(truncated) ++ntruncated_;
+
+  buildMasks();
 }
 
-std::vector<PairAssignment> PairCombinationFactory::Stage1Pair(std::vector<std::pair<unsigned, float> > first, std::vector<std::pair<unsigned, float> > second, float cut)
-{  
-  //initialize pair assignment struct, loop and filter pairs
-  std::vector<PairAssignment> PairedOnes;
-  for(unsigned i=0; i<first.size(); ++i){
-    for(unsigned j=0; j<second.size(); ++j){
-      bool Survivor=true;
-      if(first[i].first==PairCombinationFactory::BAD && second[j].first==PairCombinationFactory::BAD) Survivor=false; //catch double dummy cases
-      else if(fabs(first[i].second-second[j].second)>cut && !(first[i].first==PairCombinationFactory::BAD || second[j].first==PairCombinationFactory::BAD) ) Survivor=false; //pairwise DDS cut, spares any pair with only a single dummy
-      PairedOnes.push_back(PairAssignment(first[i].first,second[j].first,Survivor));
+void PairCombinationFactory::start(const std::vector<std::vector<unsigned> >& groups, const std::vector<float>& stubDeltaS, bool FiveOfSix, unsigned maxStubs) {
+  depth_=-1; //no combination
+
+  unsigned ngroups = groups.size(); //number of layers
+  if(ngroups!=6) return; //catch less than 6 layers present
+
+  //same as above, with the DeltaS of each stub looked up by its stubRef, and
+  //at most maxStubs stubs per layer besides the dummy
+  bool truncated=false;
+  for(unsigned layer=0; layer<6; ++layer){
+    unsigned n=0;
+    if(groups[layer].empty() || FiveOfSix){
+      stubs_[layer][n]=PairCombinationFactory::BAD;
+      deltaS_[layer][n]=Coarsener(999.,layer);
+      ++n;
     }
+    unsigned j=0;
+    for(; j<groups[layer].size() && j<maxStubs && n<MAX_STUBS; ++j, ++n){
+      const unsigned stubRef=groups[layer][j];
+      stubs_[layer][n]=stubRef;
+      deltaS_[layer][n]=Coarsener(stubDeltaS.at(stubRef),layer);
+    }
+    if(j<groups[layer].size() && j<maxStubs) truncated=true; //stubs dropped beyond maxStubs
+    nstubs_[layer]=n;
   }
-  //give back assignment map
-  return PairedOnes;
+  if(truncated) ++ntruncated_;
+
+  buildMasks();
 }
 
-//combination(stubAddresses,pass)
-std::vector<std::vector<unsigned> > PairCombinationFactory::CombinationBuilder(std::vector<PairAssignment> Layer10, std::vector<PairAssignment> Layer12, std::vector<PairAssignment> Layer32, std::vector<PairAssignment> Layer34, std::vector<PairAssignment> Layer54, unsigned l0, unsigned l2, unsigned l4)
-{
-  //initialize return object
-  std::vector<std::vector<unsigned> >  Combinations;
-  //loop over all permutations
-  for(unsigned i=0; i<Layer10.size(); ++i){
-    for(unsigned j=0; j<Layer32.size(); ++j){
-      for(unsigned k=0; k<Layer54.size(); ++k){
-	if(!(Layer10[i].SurvivingPair * Layer32[j].SurvivingPair * Layer54[k].SurvivingPair)) continue; //3-logic part
-	//5-logic stub position lookup
-	int pos12=i/l0*l2+j%l2;
-	int pos34=j/l2*l4+k%l4;
-	if(!(Layer12[pos12].SurvivingPair * Layer34[pos34].SurvivingPair)) continue; //5-logic extension
-	std::vector<unsigned> layers={Layer10[i].Stub2Address, Layer10[i].Stub1Address, Layer32[j].Stub2Address, Layer32[j].Stub1Address, Layer54[k].Stub2Address, Layer54[k].Stub1Address};
-
-	//catch >1 dummy cases, always put dummy in the first position per layer!
-	unsigned dummyCounter=0;
-	for(unsigned l=0; l<layers.size(); ++l) if(layers[l]==PairCombinationFactory::BAD) ++dummyCounter;
-	if(dummyCounter>1) continue;
-
-	//build combination object
-	Combinations.push_back(layers);
+void PairCombinationFactory::buildMasks() {
+  //build the compatibility masks of the layer pairs
+  for(unsigned p=0; p<5; ++p){
+    const unsigned first=p, second=p+1;
+    for(unsigned j=0; j<nstubs_[second]; ++j) up_[p][j]=0;
+    for(unsigned i=0; i<nstubs_[first]; ++i){
+      const bool dummy1=(stubs_[first][i]==PairCombinationFactory::BAD);
+      uint64_t mask=0;
+      for(unsigned j=0; j<nstubs_[second]; ++j){
+        const bool dummy2=(stubs_[second][j]==PairCombinationFactory::BAD);
+        if(dummy1 && dummy2) continue; //catch double dummy cases
+        if(!dummy1 && !dummy2 && fabs(deltaS_[first][i]-deltaS_[second][j])>cuts[p]) continue; //pairwise DDS cut, spares any pair with only a single dummy
+        mask |= uint64_t(1) << j;
+        up_[p][j] |= uint64_t(1) << i;
       }
+      down_[p][i]=mask;
     }
   }
-  return Combinations;
+
+  depth_=0;
+  remaining_[0]=Candidates(0);
 }
 
-std::vector<std::vector<unsigned> > PairCombinationFactory::combine(const std::vector<std::vector<unsigned> >& groups, std::vector<std::vector<float> > DeltaS, bool FiveOfSix) {
-        std::vector<std::vector<unsigned> > combinations;
-        std::vector<std::vector<unsigned> > CombinationBase=groups;
-
-        unsigned ngroups = groups.size(); //number of layers
-	std::vector<std::vector<std::pair<unsigned, float> > > Layer; //0 is innermost, 5 is outermost
-
-	//check for empty layers, add 1 dummy to nonempty layers
-	for(unsigned i=0; i<ngroups; ++i){
-	  if(!CombinationBase[i].size()){
-	    CombinationBase[i].push_back(PairCombinationFactory::BAD);
-	    DeltaS[i].push_back(999.);
-	  }
-	  else if(FiveOfSix){
-	    CombinationBase[i].insert(CombinationBase[i].begin(),PairCombinationFactory::BAD); //only insert dummies in full layers, if 5/6 permutations are desired
-	    DeltaS[i].insert(DeltaS[i].begin(),999.);
-	  }
-	}
-
-	if(ngroups!=6) return combinations; //catch less than 6 layers present
-	for(unsigned layer=0; layer<6; ++layer){ //compose all the layer information
-	  std::vector<std::pair<unsigned, float> > OneLayer;
-	  Layer.push_back(OneLayer);
-	  for(unsigned j=0; j<CombinationBase[layer].size(); ++j) Layer[layer].push_back(std::make_pair(CombinationBase[layer][j], Coarsener(DeltaS[layer][j],4,layer))); //pushes back stub iterator and coarsened DeltaS value
-	}
-	
-	//build layer pairs & pass cut values
-	std::vector<PairAssignment> Layer01=Stage1Pair(Layer[1],Layer[0],1.5);
-	std::vector<PairAssignment> Layer12=Stage1Pair(Layer[1],Layer[2],2.5);
-	std::vector<PairAssignment> Layer23=Stage1Pair(Layer[3],Layer[2],3.0);
-	std::vector<PairAssignment> Layer34=Stage1Pair(Layer[3],Layer[4],2.0);
-	std::vector<PairAssignment> Layer45=Stage1Pair(Layer[5],Layer[4],2.0);
-
-	//build the actual combinations
-	combinations = CombinationBuilder(Layer01,Layer12,Layer23,Layer34,Layer45,CombinationBase[0].size(),CombinationBase[2].size(),CombinationBase[4].size());
-	//for(unsigned c=0; c<combinations.size(); ++c) std::cout<<combinations[c][0]<<","<<combinations[c][1]<<","<<combinations[c][2]<<","<<combinations[c][3]<<","<<combinations[c][4]<<","<<combinations[c][5]<<std::endl;  //combination verbose
-        return combinations;
+bool PairCombinationFactory::next(std::vector<unsigned>& combination) {
+  while(depth_>=0){
+    uint64_t& remaining=remaining_[depth_];
+    if(!remaining){ //go back up
+      --depth_;
+      continue;
+    }
+
+    //take the next candidate at this depth
+    const unsigned i=__builtin_ctzll(remaining);
+    remaining &= remaining-1;
+
+    //catch >1 dummy cases
+    const unsigned ndummies=(depth_ ? ndummies_[depth_-1] : 0) + (stubs_[layerOrder[depth_]][i]==PairCombinationFactory::BAD);
+    if(ndummies>1) continue;
+
+    chosen_[depth_]=i;
+    ndummies_[depth_]=ndummies;
+
+    if(depth_<5){ //go down
+      ++depth_;
+      remaining_[depth_]=Candidates(depth_);
+      continue;
+    }
+
+    //build combination object
+    combination.resize(6);
+    for(unsigned d=0; d<6; ++d) combination[layerOrder[d]]=stubs_[layerOrder[d]][chosen_[d]];
+    return true;
+  }
+  return false;
+}
+
+std::vector<std::vector<unsigned> > PairCombinationFactory::combine(const std::vector<std::vector<unsigned> >& groups, const std::vector<std::vector<float> >& DeltaS, bool FiveOfSix) {
+  std::vector<std::vector<unsigned> > combinations;
+  std::vector<unsigned> combination;
+
+  //build the actual combinations
+  start(groups, DeltaS, FiveOfSix);
+  while(next(combination)) combinations.push_back(combination);
+  //for(unsigned c=0; c<combinations.size(); ++c) std::cout<<combinations[c][0]<<","<<combinations[c][1]<<","<<combinations[c][2]<<","<<combinations[c][3]<<","<<combinations[c][4]<<","<<combinations[c][5]<<std::endl;  //combination verbose
+  return combinations;
 }
 
 // _____________________________________________________________________________
 void PairCombinationFactory::print() {
     std::cout << std::endl;
 }
-
-
@@ -1,35 +1,89 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ParameterDuplicateRemoval.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Helper.h"
 using namespace slhcl1tt;
 
+#include <cmath>
+
+namespace{
+  //grid cells, slightly larger than the windows of TrackCloud::Matches so
+  //that the rounding of the coordinates can't miss a neighbouring cell
+  const double EtaCell = 0.0601 * (1. + 1e-4);
+  const int    NPhiCells = std::floor(2.*M_PI / (0.00576 * (1. + 1e-4)));
+  const double PhiCell = 2.*M_PI / NPhiCells;
+
+  //cell of a track without finite coordinates: such a track never matches a cloud
+  const uint64_t NoCell = ~uint64_t(0);
+
+  inline uint64_t CellKey(int etaBin, int phiBin){
+    return (uint64_t(uint32_t(etaBin)) << 32) | uint32_t((phiBin + NPhiCells) % NPhiCells);
+  }
+
+  inline bool FindBins(float Eta, float Phi, int& etaBin, int& phiBin){
+    if(!std::isfinite(Eta) || !std::isfinite(Phi)) return false;
+    etaBin = std::floor(Eta / EtaCell);
+    phiBin = std::min(NPhiCells-1, int(std::floor((TVector2::Phi_mpi_pi(Phi) + M_PI) / PhiCell)));
+    return true;
+  }
+}
+
 void ParameterDuplicateRemoval::ReduceTracks(std::vector<TTTrack2>& Tracks){
-  std::vector<TrackCloud> Clouds; //container for merged tracks
+  Clouds.clear();
+  CloudCells.clear();
+  Grid.clear();
+
   for(unsigned t=0; t<Tracks.size(); ++t){
-    if(Clouds.size()==0){ //start a new cloud, if there isn't any, yet
-      TrackCloud element;
-      Clouds.push_back(element);
-      Clouds[0].Add(t,Tracks.at(t).stubRefs(),Tracks.at(t).chi2()/Tracks.at(t).ndof(),Tracks.at(t).eta(),Tracks.at(t).phi0());
+    const TTTrack2& track = Tracks[t];
+    const float Chi2 = track.chi2()/track.ndof();
+    const float Eta = track.eta();
+    const float Phi = track.phi0();
+    const float Pt = track.pt();
+
+    //find the first cloud that accepts the track, among the neighbouring cells
+    unsigned c = Clouds.size();
+    int etaBin = 0, phiBin = 0;
+    const bool Binned = FindBins(Eta, Phi, etaBin, phiBin);
+    if(Binned){
+      for(int i=-1; i<=1; ++i){
+        for(int j=-1; j<=1; ++j){
+          auto range = Grid.equal_range(CellKey(etaBin+i, phiBin+j));
+          for(auto it = range.first; it != range.second; ++it){
+            if(it->second < c && Clouds[it->second].Matches(Eta, Phi, Pt)) c = it->second;
+          }
+        }
+      }
+    }
+
+    //start a new cloud, if none accepts the track
+    if(c == Clouds.size()){
+      Clouds.push_back(TrackCloud());
+      CloudCells.push_back(NoCell);
     }
-    else{
-      bool FoundCloud=false;
-      for(unsigned c=0; c<Clouds.size(); ++c){
-	FoundCloud=Clouds[c].Add(t,Tracks.at(t).stubRefs(),Tracks.at(t).chi2()/Tracks.at(t).ndof(),Tracks.at(t).eta(),Tracks.at(t).phi0());
-	if(FoundCloud) break;
-      }//end cloud loop
-      if(!FoundCloud){
-	TrackCloud element;
-	Clouds.push_back(element);
-	Clouds[Clouds.size()-1].Add(t,Tracks.at(t).stubRefs(),Tracks.at(t).chi2()/Tracks.at(t).ndof(),Tracks.at(t).eta(),Tracks.at(t).phi0());
+
+    TrackCloud& cloud = Clouds[c];
+    cloud.Add(t, track.stubRefs(), Chi2, Eta, Phi, Pt);
+
+    //move the cloud in the grid if its best track changed cell
+    const uint64_t cell = Binned ? CellKey(etaBin, phiBin) : NoCell;
+    if(cloud.BestTrack == t && CloudCells[c] != cell){
+      if(CloudCells[c] != NoCell){
+        auto range = Grid.equal_range(CloudCells[c]);
+        for(auto it = range.first; it != range.second; ++it){
+          if(it->second == c){
+            Grid.erase(it);
+            break;
+          }
+        }
       }
+      if(cell != NoCell) Grid.insert(std::make_pair(cell, c));
+      CloudCells[c] = cell;
     }
   }//end track loop
 
-  //new track collection of unique tracks
-  std::vector<TTTrack2> UniqueTracks;
+  //keep the best track of each cloud, in the order of the clouds
+  UniqueTracks.clear();
   for(unsigned c=0; c<Clouds.size(); ++c){
-    UniqueTracks.push_back(Tracks.at(Clouds[c].BestTrack));
-  }//end cloud loop 2
-  
-  Tracks.resize(UniqueTracks.size());
-  Tracks=UniqueTracks;
-  assert(Tracks.size() == UniqueTracks.size());
+    UniqueTracks.push_back(Clouds[c].BestTrack);
+  }
+
+  selectInPlace(Tracks, UniqueTracks, Done);
 }
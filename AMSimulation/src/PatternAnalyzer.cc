@@ -70,6 +70,7 @@ int PatternAnalyzer::makePatterns(TString src) {
     // _________________________________________________________________________
     // For reading
     TTStubReader reader(verbose_);
+    reader.setReadAhead(po_.readCacheSize, po_.readAhead);
     if (reader.init(src, false)) {
         std::cout << Error() << "Failed to initialize TTStubReader." << std::endl;
         return 1;
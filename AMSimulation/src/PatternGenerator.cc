@@ -21,6 +21,7 @@ int PatternGenerator::makePatterns(TString src) {
     // _________________________________________________________________________
     // For reading
     TTStubReader reader(verbose_);
+    reader.setReadAhead(po_.readCacheSize, po_.readAhead);
     if (reader.init(src, false)) {
         std::cout << Error() << "Failed to initialize TTStubReader." << std::endl;
         return 1;
@@ -1,9 +1,17 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PatternMatcher.h"
 
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/ParallelFor.h"
+
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/PatternBankReader.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTStubPlusTPReader.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTRoadReader.h"
 
+#include "TChain.h"
+#include "TFileCollection.h"
+#include "TFileMerger.h"
+#include "TThread.h"
+#include <cstdio>
+
 namespace {
 // Join 'layer' and 'superstrip' into one number
 unsigned simpleHash(unsigned layer, unsigned nss, unsigned ss) {
@@ -104,14 +112,95 @@ int PatternMatcher::loadPatterns(TString bank) {
 int PatternMatcher::makeRoads(TString src, TString out) {
     if (verbose_)  std::cout << Info() << "Reading " << nEvents_ << " events and matching patterns." << std::endl;
 
+    return matchEvents(src, out, nEvents_, hitBuffer_);
+}
+
+// _____________________________________________________________________________
+int PatternMatcher::makeRoadsPerFile(TString src, TString out) {
+    if (verbose_)  std::cout << Info() << "Reading " << nEvents_ << " events and matching patterns, one file per thread." << std::endl;
+
+    if (!src.EndsWith(".txt") || !out.EndsWith(".root")) {
+        std::cout << Error() << "Parallel files require a .txt input list and a .root output" << std::endl;
+        return 1;
+    }
+
+    // _________________________________________________________________________
+    // List the files and their numbers of events
+    TChain chain("ntupler/tree");
+    TFileCollection fc("fileinfolist", "", src);
+    if (!chain.AddFileInfoList((TCollection*) fc.GetList())) {
+        std::cout << Error() << "Failed to read " << src << std::endl;
+        return 1;
+    }
+    chain.GetEntries();  // opens every file once
+
+    std::vector<TString>   files;
+    std::vector<long long> nEvents;  // per file, up to the max number of events
+    const Long64_t * offsets = chain.GetTreeOffset();
+    for (int i=0; i<chain.GetNtrees() && offsets[i]<nEvents_; ++i) {
+        files.push_back(chain.GetListOfFiles()->At(i)->GetTitle());
+        nEvents.push_back(std::min(nEvents_, offsets[i+1]) - offsets[i]);
+    }
+
+    if (files.empty()) {
+        std::cout << Error() << "Failed to read any event." << std::endl;
+        return 1;
+    }
+
+    // _________________________________________________________________________
+    // Process the files, each into its own output
+    TThread::Initialize();
+
+    const TString prefix = out(0, out.Length() - 5);
+    std::vector<TString> parts(files.size());
+    for (unsigned i=0; i<files.size(); ++i)
+        parts.at(i) = prefix + Form("_part%u.root", i);
+
+    std::vector<int> exitcodes(files.size(), 0);
+    std::vector<HitBuffer> hitBuffers(po_.threads, hitBuffer_);
+
+    parallelForThread(files.size(), po_.threads, [&](unsigned i, unsigned ithread) {
+        if (nEvents.at(i) > 0)
+            exitcodes.at(i) = matchEvents(files.at(i), parts.at(i), nEvents.at(i), hitBuffers.at(ithread));
+    });
+
     // _________________________________________________________________________
-    // Get trigger tower reverse map
-    const std::map<unsigned, bool>& ttrmap = ttmap_ -> getTriggerTowerReverseMap(po_.tower);
+    // Merge the outputs in order
+    int exitcode = 0;
+    TFileMerger merger(kFALSE);
+    merger.SetFastMethod(kTRUE);
+    merger.SetPrintLevel(verbose_ > 1);
+    if (!merger.OutputFile(out, "RECREATE"))
+        exitcode = 1;
+
+    for (unsigned i=0; i<files.size() && !exitcode; ++i) {
+        if (exitcodes.at(i)) {
+            std::cout << Error() << "Failed to process " << files.at(i) << std::endl;
+            exitcode = exitcodes.at(i);
+        } else if (nEvents.at(i) > 0 && !merger.AddFile(parts.at(i), kFALSE)) {
+            exitcode = 1;
+        }
+    }
+
+    if (!exitcode && !merger.Merge()) {
+        std::cout << Error() << "Failed to merge into " << out << std::endl;
+        exitcode = 1;
+    }
 
+    for (unsigned i=0; i<parts.size(); ++i)
+        std::remove(parts.at(i).Data());
 
+    if (!exitcode && verbose_)  std::cout << Info() << "Merged " << files.size() << " files into " << out << std::endl;
+
+    return exitcode;
+}
+
+// _____________________________________________________________________________
+int PatternMatcher::matchEvents(TString src, TString out, long long nEvents, HitBuffer& hitBuffer) {
     // _________________________________________________________________________
     // For reading
     TTStubPlusTPReader reader(verbose_);
+    reader.setReadAhead(po_.readCacheSize, po_.readAhead);
     if (reader.init(src)) {
         std::cout << Error() << "Failed to initialize TTStubPlusTPReader." << std::endl;
         return 1;
@@ -128,8 +217,6 @@ int PatternMatcher::makeRoads(TString src, TString out) {
     // _________________________________________________________________________
     // Loop over all events
 
-    const unsigned nss = arbiter_ -> nsuperstripsPerLayer();
-
     // Containers
     std::vector<TTRoad> roads;
     roads.reserve(300);
@@ -137,204 +224,259 @@ int PatternMatcher::makeRoads(TString src, TString out) {
     // Bookkeepers
     long int nRead = 0, nKept = 0;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
+    for (long long ievt=0; ievt<nEvents; ++ievt) {
         if (reader.loadTree(ievt) < 0)  break;
         reader.getEntry(ievt);
 
-        const unsigned nstubs = reader.vb_modId->size();
         if (verbose_>1 && ievt%100==0)  std::cout << Debug() << Form("... Processing event: %7lld, triggering: %7ld", ievt, nKept) << std::endl;
-        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # stubs: " << nstubs << std::endl;
 
-        if (!nstubs) {  // skip if no stub
-            ++nRead;
-            writer.fill(std::vector<TTRoad>());
-            continue;
-        }
-
-        if (nstubs > 500000) {
-            std::cout << Error() << "Way too many stubs: " << nstubs << std::endl;
+        if (matchEvent(reader, ievt, hitBuffer, roads))
             return 1;
-        }
 
+        if (! roads.empty())
+            ++nKept;
 
-        // _____________________________________________________________________
-        // Skip stubs
-
-        std::vector<bool> stubsNotInTower;  // true: not in this trigger tower
-        std::vector<bool> stubsInOverlapping(nstubs,false);  // true: stub is in overlapping region and has TO BE removed
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-        	unsigned moduleId = reader.vb_modId   ->at(istub);
-
-        	// Skip if not in this trigger tower
-        	bool isNotInTower = (ttrmap.find(moduleId) == ttrmap.end());
-        	stubsNotInTower.push_back(isNotInTower);
-
-        	// RR // Skip if in overlapping regions
-          if (removeOverlap_) {
-        	float    stub_coordx = reader.vb_coordx->at(istub);
-        	float    stub_coordy = reader.vb_coordy->at(istub);
-        	std::map<unsigned,ModuleOverlap>::iterator it_mo = momap_->moduleOverlap_map_.find(moduleId);
-        	if (it_mo != momap_->moduleOverlap_map_.end()) {
-        		float minx = it_mo->second.x1;
-        		if (stub_coordx < minx) {
-        			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t" << moduleId << "\t x1: " <<  stub_coordx << std::endl;
-        			stubsInOverlapping.at(istub)=true;
-        			continue;
-        		}
-        		float maxx = it_mo->second.x2;
-        		if (stub_coordx > maxx) {
-        			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t x2: " <<  stub_coordx << std::endl;
-        			stubsInOverlapping.at(istub)=true;
-        			continue;
-        		}
-        		float miny = it_mo->second.y1;
-        		if (stub_coordy < miny) {
-        			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t y1: " <<  stub_coordy << std::endl;
-        			stubsInOverlapping.at(istub)=true;
-        			continue;
-        		}
-        		float maxy = it_mo->second.y2;
-        		if (stub_coordy > maxy) {
-        			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t y2: " <<  stub_coordy << std::endl;
-        			stubsInOverlapping.at(istub)=true;
-        			continue;
-        		}
-        	}
-        }
-        } // endif removeOverlap_
-        // Null stub information for those that are not in this trigger tower
-        reader.nullStubs(stubsNotInTower);
+        writer.fill(roads);
+        ++nRead;
+    }
 
-        // _____________________________________________________________________
-        // Skip tracking particles
+    if (nRead == 0) {
+        std::cout << Error() << "Failed to read any event." << std::endl;
+        return 1;
+    }
 
-        std::vector<bool> trkPartsNotPrimary;  // true: not primary
+    if (verbose_)  std::cout << Info() << Form("Read: %7ld, triggered: %7ld", nRead, nKept) << std::endl;
 
-        const unsigned nparts = reader.vp2_primary->size();
-        for (unsigned ipart=0; ipart<nparts; ++ipart) {
+    long long nentries = writer.writeTree();
+    assert(nentries == nRead);
 
-            // Skip if not primary
-            bool  primary         = reader.vp2_primary->at(ipart);
-            int   simCharge       = reader.vp2_charge->at(ipart);
-            trkPartsNotPrimary.push_back(!(simCharge!=0 && primary));
-        }
+    return 0;
+}
 
-        // Null trkPart information for those that are not primary
-        reader.nullParticles(trkPartsNotPrimary);
+// _____________________________________________________________________________
+void PatternMatcher::flagStubs(long long ievt, const std::vector<unsigned>& modId, const std::vector<float>& coordx, const std::vector<float>& coordy,
+                               std::vector<bool>& stubsNotInTower, std::vector<bool>& stubsSkipped) const {
+    const unsigned nstubs = modId.size();
+    stubsNotInTower.assign(nstubs, false);
+    stubsSkipped.assign(nstubs, false);
+
+    for (unsigned istub=0; istub<nstubs; ++istub) {
+    	unsigned moduleId = modId.at(istub);
+
+    	// Skip if not in this trigger tower
+    	bool isNotInTower = (ttrmap_.find(moduleId) == ttrmap_.end());
+    	stubsNotInTower.at(istub) = isNotInTower;
+    	if (isNotInTower)
+    	    stubsSkipped.at(istub)=true;
+
+    	// RR // Skip if in overlapping regions
+      if (removeOverlap_) {
+    	float    stub_coordx = coordx.at(istub);
+    	float    stub_coordy = coordy.at(istub);
+    	std::map<unsigned,ModuleOverlap>::const_iterator it_mo = momap_->moduleOverlap_map_.find(moduleId);
+    	if (it_mo != momap_->moduleOverlap_map_.end()) {
+    		float minx = it_mo->second.x1;
+    		if (stub_coordx < minx) {
+    			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t" << moduleId << "\t x1: " <<  stub_coordx << std::endl;
+    			stubsSkipped.at(istub)=true;
+    			continue;
+    		}
+    		float maxx = it_mo->second.x2;
+    		if (stub_coordx > maxx) {
+    			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t x2: " <<  stub_coordx << std::endl;
+    			stubsSkipped.at(istub)=true;
+    			continue;
+    		}
+    		float miny = it_mo->second.y1;
+    		if (stub_coordy < miny) {
+    			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t y1: " <<  stub_coordy << std::endl;
+    			stubsSkipped.at(istub)=true;
+    			continue;
+    		}
+    		float maxy = it_mo->second.y2;
+    		if (stub_coordy > maxy) {
+    			if (verbose_>2)  std::cout << Info() << "Removing stub in module " << ievt << "\t"  << moduleId << "\t y2: " <<  stub_coordy << std::endl;
+    			stubsSkipped.at(istub)=true;
+    			continue;
+    		}
+    	}
+    }
+    } // endif removeOverlap_
+}
 
+// _____________________________________________________________________________
+void PatternMatcher::selectStubs(TTStubPlusTPReader& reader, long long ievt, std::vector<bool>& stubsSkipped) const {
+    const unsigned nstubs = reader.vb_modId->size();
+    if (!nstubs) {
+        stubsSkipped.clear();
+        return;
+    }
 
-        // _____________________________________________________________________
-        // Start pattern recognition
-        hitBuffer_.reset();
+    // _________________________________________________________________________
+    // Skip stubs
 
-        // Loop over reconstructed stubs
-        for (unsigned istub=0; istub<nstubs; ++istub) {
-            bool isNotInTower = stubsNotInTower.at(istub);
-            if (isNotInTower)
-                continue;
-            if ((removeOverlap_) && stubsInOverlapping.at(istub))
-                continue;
+    std::vector<bool> stubsNotInTower;  // true: not in this trigger tower
+    flagStubs(ievt, *reader.vb_modId, *reader.vb_coordx, *reader.vb_coordy, stubsNotInTower, stubsSkipped);
 
-            unsigned moduleId = reader.vb_modId   ->at(istub);
-            float    strip    = reader.vb_coordx  ->at(istub);  // in full-strip unit
-            float    segment  = reader.vb_coordy  ->at(istub);  // in full-strip unit
+    // Null stub information for those that are not in this trigger tower
+    reader.nullStubs(stubsNotInTower);
 
-            float    stub_r   = reader.vb_r       ->at(istub);
-            float    stub_phi = reader.vb_phi     ->at(istub);
-            float    stub_z   = reader.vb_z       ->at(istub);
-            float    stub_ds  = reader.vb_trigBend->at(istub);  // in full-strip unit
+    // _________________________________________________________________________
+    // Skip tracking particles
 
-            // Find superstrip ID
-            unsigned ssId = 0;
-            if (!arbiter_ -> useGlobalCoord()) {  // local coordinates
-                ssId = arbiter_ -> superstripLocal(moduleId, strip, segment);
+    std::vector<bool> trkPartsNotPrimary;  // true: not primary
 
-            } else {                              // global coordinates
-                ssId = arbiter_ -> superstripGlobal(moduleId, stub_r, stub_phi, stub_z, stub_ds);
-            }
+    const unsigned nparts = reader.vp2_primary->size();
+    for (unsigned ipart=0; ipart<nparts; ++ipart) {
 
-            unsigned lay16    = compressLayer(decodeLayer(moduleId));
-            unsigned ssIdHash = simpleHash(lay16, nss, ssId);
+        // Skip if not primary
+        bool  primary         = reader.vp2_primary->at(ipart);
+        int   simCharge       = reader.vp2_charge->at(ipart);
+        trkPartsNotPrimary.push_back(!(simCharge!=0 && primary));
+    }
 
-            // Push into hit buffer
-            hitBuffer_.insert(ssIdHash, istub);
+    // Null trkPart information for those that are not primary
+    reader.nullParticles(trkPartsNotPrimary);
+}
 
-            if (verbose_>2) {
-                std::cout << Debug() << "... ... stub: " << istub << " moduleId: " << moduleId << " strip: " << strip << " segment: " << segment << " r: " << stub_r << " phi: " << stub_phi << " z: " << stub_z << " ds: " << stub_ds << std::endl;
-                std::cout << Debug() << "... ... stub: " << istub << " ssId: " << ssId << " ssIdHash: " << ssIdHash << std::endl;
-            }
+// _____________________________________________________________________________
+int PatternMatcher::findSuperstrips(const std::vector<unsigned>& modId, const std::vector<float>& coordx, const std::vector<float>& coordy,
+                                    const std::vector<float>& r, const std::vector<float>& phi, const std::vector<float>& z, const std::vector<float>& ds,
+                                    const std::vector<bool>& stubsSkipped, std::vector<unsigned>& ssIdHashes) const {
+    const unsigned nss = arbiter_ -> nsuperstripsPerLayer();
+
+    const unsigned nstubs = modId.size();
+    if (nstubs > 500000) {
+        std::cout << Error() << "Way too many stubs: " << nstubs << std::endl;
+        return 1;
+    }
+
+    ssIdHashes.assign(nstubs, 0);
+
+    // Loop over reconstructed stubs
+    for (unsigned istub=0; istub<nstubs; ++istub) {
+        if (stubsSkipped.at(istub))
+            continue;
+
+        unsigned moduleId = modId .at(istub);
+        float    strip    = coordx.at(istub);  // in full-strip unit
+        float    segment  = coordy.at(istub);  // in full-strip unit
+
+        float    stub_r   = r     .at(istub);
+        float    stub_phi = phi   .at(istub);
+        float    stub_z   = z     .at(istub);
+        float    stub_ds  = ds    .at(istub);  // in full-strip unit
+
+        // Find superstrip ID
+        unsigned ssId = 0;
+        if (!arbiter_ -> useGlobalCoord()) {  // local coordinates
+            ssId = arbiter_ -> superstripLocal(moduleId, strip, segment);
+
+        } else {                              // global coordinates
+            ssId = arbiter_ -> superstripGlobal(moduleId, stub_r, stub_phi, stub_z, stub_ds);
         }
 
-        hitBuffer_.freeze(po_.maxStubs);
+        unsigned lay16    = compressLayer(decodeLayer(moduleId));
+        unsigned ssIdHash = simpleHash(lay16, nss, ssId);
+        ssIdHashes.at(istub) = ssIdHash;
 
-        // _____________________________________________________________________
-        // Perform associative memory lookup
-        const std::vector<unsigned>& firedPatterns = associativeMemory_.lookup(hitBuffer_, po_.nLayers, po_.maxMisses);
+        if (verbose_>2) {
+            std::cout << Debug() << "... ... stub: " << istub << " moduleId: " << moduleId << " strip: " << strip << " segment: " << segment << " r: " << stub_r << " phi: " << stub_phi << " z: " << stub_z << " ds: " << stub_ds << std::endl;
+            std::cout << Debug() << "... ... stub: " << istub << " ssId: " << ssId << " ssIdHash: " << ssIdHash << std::endl;
+        }
+    }
+    return 0;
+}
 
+// _____________________________________________________________________________
+void PatternMatcher::findRoads(const std::vector<unsigned>& ssIdHashes, const std::vector<bool>& stubsSkipped, HitBuffer& hitBuffer, std::vector<TTRoad>& roads) {
+    const unsigned nss = arbiter_ -> nsuperstripsPerLayer();
 
-        // _____________________________________________________________________
-        // Create roads
-        roads.clear();
+    roads.clear();
+    if (ssIdHashes.empty())  // skip if no stub
+        return;
 
-        // Collect stubs
-        for (std::vector<unsigned>::const_iterator it = firedPatterns.begin(); it != firedPatterns.end(); ++it) {
-            // Create and set TTRoad
-            TTRoad aroad;
-            aroad.patternRef   = (*it);
-            aroad.tower        = po_.tower;
-            aroad.nstubs       = 0;
-            aroad.patternInvPt = 0.;
+    // _________________________________________________________________________
+    // Start pattern recognition
+    hitBuffer.reset();
 
-            // Retrieve the superstripIds and other attributes
-            pattern_type pattHash;
-            associativeMemory_.retrieve(aroad.patternRef, pattHash, aroad.patternInvPt);
+    // Push into hit buffer
+    for (unsigned istub=0; istub<ssIdHashes.size(); ++istub) {
+        if (!stubsSkipped.at(istub))
+            hitBuffer.insert(ssIdHashes.at(istub), istub);
+    }
 
-            aroad.superstripIds.clear();
-            aroad.stubRefs.clear();
+    hitBuffer.freeze(po_.maxStubs);
 
-            aroad.superstripIds.resize(po_.nLayers);
-            aroad.stubRefs.resize(po_.nLayers);
+    // _________________________________________________________________________
+    // Perform associative memory lookup
+    const std::vector<unsigned>& firedPatterns = associativeMemory_.lookup(hitBuffer, po_.nLayers, po_.maxMisses);
 
-            for (unsigned layer=0; layer<po_.nLayers; ++layer) {
-                const unsigned ssIdHash = pattHash.at(layer);
-                const unsigned ssId     = simpleHashUndo(layer, nss, ssIdHash);
 
-                if (hitBuffer_.isHit(ssIdHash)) {
-                    const std::vector<unsigned>& stubRefs = hitBuffer_.getHits(ssIdHash);
-                    aroad.superstripIds.at(layer) = ssId;
-                    aroad.stubRefs     .at(layer) = stubRefs;
-                    aroad.nstubs                 += stubRefs.size();
+    // _________________________________________________________________________
+    // Create roads
 
-                } else {
-                    aroad.superstripIds.at(layer) = ssId;
-                }
-            }
+    // Collect stubs
+    for (std::vector<unsigned>::const_iterator it = firedPatterns.begin(); it != firedPatterns.end(); ++it) {
+        // Create and set TTRoad
+        TTRoad aroad;
+        aroad.patternRef   = (*it);
+        aroad.tower        = po_.tower;
+        aroad.nstubs       = 0;
+        aroad.patternInvPt = 0.;
+
+        // Retrieve the superstripIds and other attributes
+        pattern_type pattHash;
+        associativeMemory_.retrieve(aroad.patternRef, pattHash, aroad.patternInvPt);
+
+        aroad.superstripIds.clear();
+        aroad.stubRefs.clear();
 
-            roads.push_back(aroad);  // save aroad
+        aroad.superstripIds.resize(po_.nLayers);
+        aroad.stubRefs.resize(po_.nLayers);
 
-            if (verbose_>2)  std::cout << Debug() << "... ... road: " << roads.size() - 1 << " " << aroad << std::endl;
+        for (unsigned layer=0; layer<po_.nLayers; ++layer) {
+            const unsigned ssIdHash = pattHash.at(layer);
+            const unsigned ssId     = simpleHashUndo(layer, nss, ssIdHash);
+
+            if (hitBuffer.isHit(ssIdHash)) {
+                const std::vector<unsigned>& stubRefs = hitBuffer.getHits(ssIdHash);
+                aroad.superstripIds.at(layer) = ssId;
+                aroad.stubRefs     .at(layer) = stubRefs;
+                aroad.nstubs                 += stubRefs.size();
 
-            if (roads.size() >= (unsigned) po_.maxRoads)
-                break;
+            } else {
+                aroad.superstripIds.at(layer) = ssId;
+            }
         }
 
-        if (! roads.empty())
-            ++nKept;
+        roads.push_back(aroad);  // save aroad
 
-        writer.fill(roads);
-        ++nRead;
-    }
+        if (verbose_>2)  std::cout << Debug() << "... ... road: " << roads.size() - 1 << " " << aroad << std::endl;
 
-    if (nRead == 0) {
-        std::cout << Error() << "Failed to read any event." << std::endl;
-        return 1;
+        if (roads.size() >= (unsigned) po_.maxRoads)
+            break;
     }
+}
 
-    if (verbose_)  std::cout << Info() << Form("Read: %7ld, triggered: %7ld", nRead, nKept) << std::endl;
+// _____________________________________________________________________________
+int PatternMatcher::matchEvent(TTStubPlusTPReader& reader, long long ievt, HitBuffer& hitBuffer, std::vector<TTRoad>& roads) {
+    const unsigned nstubs = reader.vb_modId->size();
+    if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # stubs: " << nstubs << std::endl;
 
-    long long nentries = writer.writeTree();
-    assert(nentries == nRead);
+    roads.clear();
+    if (!nstubs)  // skip if no stub
+        return 0;
+
+    std::vector<bool> stubsSkipped;  // true: not in this trigger tower, or in overlapping region
+    std::vector<unsigned> ssIdHashes;
+    selectStubs(reader, ievt, stubsSkipped);
+
+    if (findSuperstrips(*reader.vb_modId, *reader.vb_coordx, *reader.vb_coordy, *reader.vb_r, *reader.vb_phi, *reader.vb_z, *reader.vb_trigBend,
+                        stubsSkipped, ssIdHashes))
+        return 1;
 
+    findRoads(ssIdHashes, stubsSkipped, hitBuffer, roads);
     return 0;
 }
 
@@ -349,7 +491,10 @@ int PatternMatcher::run() {
     if (exitcode)  return exitcode;
     Timing();
 
-    exitcode = makeRoads(po_.input, po_.output);
+    if (po_.parallelFiles)
+        exitcode = makeRoadsPerFile(po_.input, po_.output);
+    else
+        exitcode = makeRoads(po_.input, po_.output);
     if (exitcode)  return exitcode;
     Timing();
 
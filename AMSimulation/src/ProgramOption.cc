@@ -25,6 +25,9 @@ std::ostream& operator<<(std::ostream& o, const ProgramOption& po) {
       << "  verbose: "      << po.verbose
       << "  speedup: "      << po.speedup
       << "  maxEvents: "    << po.maxEvents
+      << "  threads: "      << po.threads
+      << "  readCacheSize: "<< po.readCacheSize
+      << "  readAhead: "    << po.readAhead
 
       << "  nLayers: "      << po.nLayers
       << "  nFakers: "      << po.nFakers
@@ -51,15 +54,25 @@ std::ostream& operator<<(std::ostream& o, const ProgramOption& po) {
       << "  maxMisses: "    << po.maxMisses
       << "  maxStubs: "     << po.maxStubs
       << "  maxRoads: "     << po.maxRoads
+      << "  parallelFiles: "<< po.parallelFiles
 
       << "  view: "         << po.view
       << "  hitBits: "      << po.hitBits
+      << "  matrixGrid: "   << po.matrixGrid
+      << "  matrixBundle: " << po.matrixBundle
 
       << "  maxChi2: "      << po.maxChi2
       << "  CutPrincipals: "<< po.CutPrincipals
+      << "  earlyReject: "  << po.earlyReject
       << "  minNdof: "      << po.minNdof
       << "  maxCombs: "     << po.maxCombs
       << "  maxTracks: "    << po.maxTracks
+      << "  fwStubBits: "   << po.fwStubBits
+      << "  fwConstBits: "  << po.fwConstBits
+      << "  parallelRoads: "<< po.parallelRoads
+      << "  fitCache: "     << po.fitCache
+      << "  downdate: "     << po.downdate
+      << "  pipeline: "     << po.pipeline
 
       << "  oldCB: "        << po.oldCB
       << "  FiveOfSix: "    << po.FiveOfSix
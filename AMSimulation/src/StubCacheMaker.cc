@@ -0,0 +1,83 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/StubCacheMaker.h"
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/StubCache.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTStubPlusTPReader.h"
+
+
+// _____________________________________________________________________________
+int StubCacheMaker::makeCache(TString src, TString out) {
+    if (verbose_)  std::cout << Info() << "Reading " << nEvents_ << " events and caching them." << std::endl;
+
+    if (src.EndsWith(".cache")) {
+        std::cout << Error() << "Input source is already a stub cache" << std::endl;
+        return 1;
+    }
+
+    // _________________________________________________________________________
+    // For reading
+    TTStubPlusTPReader reader(verbose_);
+    reader.setReadAhead(po_.readCacheSize, po_.readAhead);
+    if (reader.init(src)) {
+        std::cout << Error() << "Failed to initialize TTStubPlusTPReader." << std::endl;
+        return 1;
+    }
+
+    // For writing
+    StubCacheWriter writer(verbose_);
+    if (writer.init(out, src)) {
+        std::cout << Error() << "Failed to initialize StubCacheWriter." << std::endl;
+        return 1;
+    }
+    reader.connectCache(writer);
+
+
+    // _________________________________________________________________________
+    // Loop over all events
+
+    // Bookkeepers
+    long int nRead = 0, nStubs = 0;
+
+    for (long long ievt=0; ievt<nEvents_; ++ievt) {
+        if (reader.loadTree(ievt) < 0)  break;
+        reader.getEntry(ievt);
+
+        if (verbose_>1 && ievt%50000==0)  std::cout << Debug() << Form("... Processing event: %7lld, stubs: %10ld", ievt, nStubs) << std::endl;
+
+        if (writer.fill()) {
+            std::cout << Error() << "Failed to cache event " << ievt << std::endl;
+            return 1;
+        }
+
+        ++nRead;
+        nStubs += reader.vb_modId->size();
+    }
+
+    if (nRead == 0) {
+        std::cout << Error() << "Failed to read any event." << std::endl;
+        return 1;
+    }
+
+    if (verbose_)  std::cout << Info() << Form("Read: %7ld, stubs: %10ld", nRead, nStubs) << std::endl;
+
+    long long nentries = writer.write();
+    if (nentries != nRead) {
+        std::cout << Error() << "Failed to write " << out << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// _____________________________________________________________________________
+// Main driver
+int StubCacheMaker::run() {
+    int exitcode = 0;
+    Timing(1);
+
+    exitcode = makeCache(po_.input, po_.output);
+    if (exitcode)  return exitcode;
+    Timing();
+
+    return exitcode;
+}
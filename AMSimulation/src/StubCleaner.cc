@@ -62,6 +62,7 @@ int StubCleaner::cleanStubs(TString src, TString out) {
     // _________________________________________________________________________
     // For reading
     TTStubReader reader(verbose_);
+    reader.setReadAhead(po_.readCacheSize, po_.readAhead);
     if (reader.init(src, false)) {
         std::cout << Error() << "Failed to initialize TTStubReader." << std::endl;
         return 1;
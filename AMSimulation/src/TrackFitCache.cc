@@ -0,0 +1,67 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitCache.h"
+using namespace slhcl1tt;
+
+#include <cassert>
+#include <cstring>
+
+
+// _____________________________________________________________________________
+uint64_t TrackFitCache::getKey(const TTRoadComb& acomb) const {
+    uint32_t ptSegment = 0;
+    std::memcpy(&ptSegment, &acomb.ptSegment, sizeof(ptSegment));
+
+    uint64_t key = 14695981039346656037ULL;
+    key = (key ^ acomb.hitBits) * 1099511628211ULL;
+    key = (key ^ ptSegment) * 1099511628211ULL;
+    for (unsigned i=0; i<acomb.stubRefs.size(); ++i)
+        key = (key ^ acomb.stubRefs[i]) * 1099511628211ULL;
+    return key;
+}
+
+bool TrackFitCache::isSame(const TTRoadComb& acomb1, const TTRoadComb& acomb2) const {
+    return acomb1.hitBits == acomb2.hitBits && acomb1.ptSegment == acomb2.ptSegment && acomb1.stubRefs == acomb2.stubRefs;
+}
+
+// _____________________________________________________________________________
+void TrackFitCache::select(const std::vector<TTRoadComb>& acombs, std::vector<TTRoadComb>& uniques) {
+    const unsigned ncombs = acombs.size();
+
+    index_.clear();
+    sources_.resize(ncombs);
+    uniques.clear();
+
+    for (unsigned icomb=0; icomb<ncombs; ++icomb) {
+        const TTRoadComb& acomb = acombs[icomb];
+        const uint64_t key = getKey(acomb);
+
+        unsigned source = uniques.size();
+        std::pair<std::unordered_multimap<uint64_t, unsigned>::const_iterator,
+                  std::unordered_multimap<uint64_t, unsigned>::const_iterator> range = index_.equal_range(key);
+        for (; range.first != range.second; ++range.first) {
+            if (isSame(uniques[range.first->second], acomb)) {
+                source = range.first->second;
+                break;
+            }
+        }
+
+        if (source == uniques.size()) {
+            index_.insert(std::make_pair(key, source));
+            uniques.push_back(acomb);
+        } else {
+            ++nhits_;
+        }
+        sources_[icomb] = source;
+    }
+    ncombinations_ += ncombs;
+}
+
+// _____________________________________________________________________________
+void TrackFitCache::expand(const std::vector<TTTrack2>& uniqueTracks, std::vector<TTTrack2>& atracks) const {
+    const unsigned ncombs = sources_.size();
+
+    atracks.resize(ncombs);
+    for (unsigned icomb=0; icomb<ncombs; ++icomb) {
+        assert(sources_[icomb] < uniqueTracks.size());
+        atracks[icomb] = uniqueTracks[sources_[icomb]];
+    }
+}
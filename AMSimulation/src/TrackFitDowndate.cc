@@ -0,0 +1,139 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitDowndate.h"
+using namespace slhcl1tt;
+
+#include <cassert>
+#include <cstring>
+
+
+// _____________________________________________________________________________
+uint64_t TrackFitDowndate::getKey(const TTRoadComb& acomb, unsigned layer) const {
+    uint32_t ptSegment = 0;
+    std::memcpy(&ptSegment, &acomb.ptSegment, sizeof(ptSegment));
+
+    uint64_t key = 14695981039346656037ULL;
+    key = (key ^ layer) * 1099511628211ULL;
+    key = (key ^ acomb.roadRef) * 1099511628211ULL;
+    key = (key ^ ptSegment) * 1099511628211ULL;
+    for (unsigned i=0; i<acomb.stubRefs.size(); ++i) {
+        if (i != layer)
+            key = (key ^ acomb.stubRefs[i]) * 1099511628211ULL;
+    }
+    return key;
+}
+
+bool TrackFitDowndate::isSame(const TTRoadComb& acomb1, const TTRoadComb& acomb2, unsigned layer) const {
+    if (acomb1.roadRef != acomb2.roadRef || acomb1.ptSegment != acomb2.ptSegment || acomb1.stubRefs.size() != acomb2.stubRefs.size())
+        return false;
+    for (unsigned i=0; i<acomb1.stubRefs.size(); ++i) {
+        if (i != layer && acomb1.stubRefs[i] != acomb2.stubRefs[i])
+            return false;
+    }
+    return true;
+}
+
+// _____________________________________________________________________________
+void TrackFitDowndate::addFull(const TTRoadComb& acomb, unsigned& nfulls, std::vector<TTRoadComb>& fulls) const {
+    if (nfulls < fulls.size())
+        fulls[nfulls] = acomb;
+    else
+        fulls.push_back(acomb);
+    ++nfulls;
+}
+
+// _____________________________________________________________________________
+void TrackFitDowndate::select(const std::vector<TTRoadComb>& acombs, std::vector<TTRoadComb>& fulls) {
+    const unsigned ncombs = acombs.size();
+
+    sources_.resize(ncombs);
+    derived_.assign(ncombs, false);
+
+    // The combinations are copied over the previous ones, to reuse their vectors
+    unsigned nfulls = 0;
+
+    // The 6/6 combinations first, as they may come after their 5/6 ones
+    for (unsigned icomb=0; icomb<ncombs; ++icomb) {
+        const TTRoadComb& acomb = acombs[icomb];
+        if (acomb.hitBits != 0 || acomb.stubRefs.size() != 6)
+            continue;
+
+        sources_[icomb] = nfulls;
+        addFull(acomb, nfulls, fulls);
+    }
+    const unsigned nsixes = nfulls;
+
+    // Hash table with open addressing, at most half full
+    unsigned nslots = 16;
+    while (nslots < 2 * 6 * nsixes)
+        nslots *= 2;
+    index_.assign(nslots, std::make_pair(uint64_t(0), nsixes));
+    for (unsigned isix=0; isix<nsixes; ++isix) {
+        for (unsigned layer=0; layer<6; ++layer) {
+            const uint64_t key = getKey(fulls[isix], layer);
+            unsigned slot = key & (nslots - 1);
+            while (index_[slot].second != nsixes)
+                slot = (slot + 1) & (nslots - 1);
+            index_[slot] = std::make_pair(key, isix);
+        }
+    }
+
+    for (unsigned icomb=0; icomb<ncombs; ++icomb) {
+        const TTRoadComb& acomb = acombs[icomb];
+        if (acomb.hitBits == 0 && acomb.stubRefs.size() == 6)
+            continue;
+
+        // Look for the first 6/6 combination of the road with the same stubs
+        unsigned source = nsixes;
+        if (1 <= acomb.hitBits && acomb.hitBits <= 6 && acomb.stubRefs.size() == 6) {
+            const unsigned layer = acomb.hitBits - 1;
+            const uint64_t key = getKey(acomb, layer);
+            const unsigned nslots = index_.size();
+            for (unsigned slot = key & (nslots - 1); index_[slot].second != nsixes; slot = (slot + 1) & (nslots - 1)) {
+                if (index_[slot].first == key && index_[slot].second < source && isSame(fulls[index_[slot].second], acomb, layer))
+                    source = index_[slot].second;
+            }
+        }
+
+        if (source == nsixes) {
+            sources_[icomb] = nfulls;
+            addFull(acomb, nfulls, fulls);
+        } else {
+            sources_[icomb] = source;
+            derived_[icomb] = true;
+        }
+    }
+    fulls.resize(nfulls);
+    ncombinations_ += ncombs;
+}
+
+// _____________________________________________________________________________
+int TrackFitDowndate::expand(TrackFitterAlgoBase& fitter, const std::vector<TTRoadComb>& acombs,
+                             const std::vector<TTTrack2>& fullTracks, std::vector<TTTrack2>& atracks) {
+    const unsigned ncombs = sources_.size();
+
+    atracks.resize(ncombs);
+    long int nderived = 0;
+    int status = expand(fitter, acombs, fullTracks, atracks, 0, ncombs, nderived);
+    nderived_ += nderived;
+    return status;
+}
+
+int TrackFitDowndate::expand(TrackFitterAlgoBase& fitter, const std::vector<TTRoadComb>& acombs,
+                             const std::vector<TTTrack2>& fullTracks, std::vector<TTTrack2>& atracks,
+                             unsigned begin, unsigned end, long int& nderived) const {
+    assert(acombs.size() == sources_.size() && atracks.size() == sources_.size() && end <= sources_.size());
+
+    int status = 0;
+    for (unsigned icomb=begin; icomb<end; ++icomb) {
+        assert(sources_[icomb] < fullTracks.size());
+        if (!derived_[icomb]) {
+            atracks[icomb] = fullTracks[sources_[icomb]];
+
+        } else if (fitter.fitFiveOfSix(acombs[icomb], fullTracks[sources_[icomb]], atracks[icomb])) {
+            ++nderived;
+
+        } else {
+            status |= fitter.fit(acombs[icomb], atracks[icomb]);
+        }
+    }
+    return status;
+}
@@ -1,13 +1,19 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitter.h"
 
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PatternMatcher.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/Pipeline.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTRoadReader.h"
 #include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/TTTrackReader.h"
 
+#include "TThread.h"
+
 
 namespace {
-unsigned getPtSegment(float invPt) {  // for PCA
-    return (invPt - PCA_MIN_INVPT) / (PCA_MAX_INVPT - PCA_MIN_INVPT) * PCA_NSEGMENTS;
-}
+// Number of combinations fitted at once when the roads of an event are fitted in parallel
+const unsigned combsPerTask = 64;
+
+// Maximum number of combinations fitted at once when an event is fitted by one thread
+const unsigned combsPerBlock = 4096;
 
 unsigned getHitBits(const std::vector<bool>& stubs_bool) {
     unsigned bitset = 0;
@@ -32,30 +38,483 @@ unsigned getHitBits(const std::vector<bool>& stubs_bool) {
 bool sortByPt(const TTTrack2& lhs, const TTTrack2& rhs) {
     return lhs.pt() > rhs.pt();
 }
+}
+
+
+// _____________________________________________________________________________
+// Copy an event from the reader
+void TrackFitter::readEvent(TTRoadReader& reader, long long ievt, RoadEvent& evt) const {
+    evt.patternRef   = *reader.vr_patternRef;
+    evt.patternInvPt = *reader.vr_patternInvPt;
+    evt.stubRefs     = *reader.vr_stubRefs;
+    readStubs(reader, ievt, evt);
+}
+
+// _____________________________________________________________________________
+// Copy an event from the reader, with the roads made by pattern recognition
+void TrackFitter::readEvent(const TTStubPlusTPReader& reader, long long ievt, const std::vector<TTRoad>& roads, RoadEvent& evt) const {
+    readRoads(roads, evt);
+    readStubs(reader, ievt, evt);
+}
+
+// _____________________________________________________________________________
+// Copy the roads of an event
+void TrackFitter::readRoads(const std::vector<TTRoad>& roads, RoadEvent& evt) const {
+    const unsigned nroads = roads.size();
+    evt.patternRef  .resize(nroads);
+    evt.patternInvPt.resize(nroads);
+    evt.stubRefs    .resize(nroads);
+    for (unsigned iroad=0; iroad<nroads; ++iroad) {
+        evt.patternRef  .at(iroad) = roads.at(iroad).patternRef;
+        evt.patternInvPt.at(iroad) = roads.at(iroad).patternInvPt;
+        evt.stubRefs    .at(iroad) = roads.at(iroad).stubRefs;
+    }
+}
+
+// _____________________________________________________________________________
+// Copy the stubs and particles of an event from the reader
+void TrackFitter::readStubs(const TTStubPlusTPReader& reader, long long ievt, RoadEvent& evt) const {
+    evt.ievt         = ievt;
+    evt.stubs_r      = *reader.vb_r;
+    evt.stubs_phi    = *reader.vb_phi;
+    evt.stubs_z      = *reader.vb_z;
+    if (po_.PDDS)
+        evt.stubs_trigBend = *reader.vb_trigBend;
+
+    evt.trkParts.clear();
+    if (po_.speedup<1) {
+        const unsigned nparts = reader.vp2_primary->size();
+        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # particles: " << nparts << std::endl;
+
+        for (unsigned ipart=0; ipart<nparts; ++ipart) {
+            bool  primary         = reader.vp2_primary->at(ipart);
+            int   simCharge       = reader.vp2_charge->at(ipart);
+
+            if (simCharge!=0 && primary) {
+                float simPt           = reader.vp2_pt->at(ipart);
+                float simEta          = reader.vp2_eta->at(ipart);
+                float simPhi          = reader.vp2_phi->at(ipart);
+                //float simVx           = reader.vp2_vx->at(ipart);
+                //float simVy           = reader.vp2_vy->at(ipart);
+                float simVz           = reader.vp2_vz->at(ipart);
+                int   simCharge       = reader.vp2_charge->at(ipart);
+                int   simPdgId        = reader.vp2_pdgId->at(ipart);
+
+                float simCotTheta     = std::sinh(simEta);
+                float simChargeOverPt = float(simCharge)/simPt;
+
+                evt.trkParts.emplace_back(TrackingParticle{  // using POD type constructor
+                    (int) ipart,
+                    simPdgId,
+                    simChargeOverPt,
+                    simPhi,
+                    simCotTheta,
+                    simVz,
+                    0.
+                });
+
+                if (verbose_>3)  std::cout << Debug() << "... ... part: " << ipart << " primary: " << primary << " " << evt.trkParts.back();
+            }
+        }
+    }
+}
+
+// _____________________________________________________________________________
+// Start the fit combinations of a road, returns false if the road is skipped
+bool TrackFitter::startCombinations(const RoadEvent& evt, unsigned iroad, Worker& worker) const {
+    const unsigned patternRef = evt.patternRef.at(iroad);
+    if (patternRef >= (unsigned) po_.maxPatterns)  return false;
+
+    // Get combinations of stubRefs, with at most maxStubs stubs per layer
+    const std::vector<std::vector<unsigned> >& stubRefs = evt.stubRefs.at(iroad);
+
+    //choose either the normal combination building or the 5/6 permutations per 6/6 road in addition and/or pairwise Delta Delta S cleaning (PDDS)
+    //the combinations are made one at a time, and only up to maxCombs of them
+    if (po_.oldCB) worker.combinationFactory.start(stubRefs, po_.maxStubs);
+    else if(po_.PDDS) worker.pairCombinationFactory.start(stubRefs, evt.stubs_trigBend, po_.FiveOfSix, po_.maxStubs);  //pass DeltaS information for each stub to the PDDS
+    else worker.combinationBuilderFactory->start(stubRefs, po_.maxStubs);
+
+    worker.icomb = 0;
+    return true;
+}
+
+// _____________________________________________________________________________
+// Make the next fit combinations of the road started by startCombinations(),
+// at most ncombs of them. The combinations are written into elements taken
+// from the spares of the worker, so their vectors are reused. Returns true if
+// the road has more combinations.
+bool TrackFitter::makeCombinations(const RoadEvent& evt, unsigned iroad, Worker& worker, std::vector<TTRoadComb>& acombs, unsigned ncombs) const {
+    const unsigned patternRef = evt.patternRef.at(iroad);
+    const std::vector<std::vector<unsigned> >& stubRefs = evt.stubRefs.at(iroad);
+
+    std::vector<unsigned>& combination = worker.combination;
+    const float ptSegment = getPtSegment(evt.patternInvPt.at(iroad));
+
+    // Loop over the combinations
+    unsigned& icomb = worker.icomb;
+    bool more = true;
+    for (unsigned n=0; n<ncombs; ++n, ++icomb) {
+        if (icomb < (unsigned) po_.maxCombs) {
+            if (po_.oldCB) more = worker.combinationFactory.next(combination);
+            else if(po_.PDDS) more = worker.pairCombinationFactory.next(combination);
+            else more = worker.combinationBuilderFactory->next(combination);
+        } else {
+            more = false;
+        }
+        if (!more)  break;
+
+        assert(combination.size() == stubRefs.size());
+
+        // Set the next TTRoadComb
+        if (worker.spareCombs.empty()) {
+            acombs.push_back(TTRoadComb());
+        } else {
+            acombs.push_back(std::move(worker.spareCombs.back()));
+            worker.spareCombs.pop_back();
+        }
+        TTRoadComb& acomb = acombs.back();
+        acomb.roadRef    = iroad;
+        acomb.combRef    = icomb;
+        acomb.patternRef = patternRef;
+        acomb.ptSegment  = ptSegment;
+        acomb.stubRefs   = combination;
+
+        const unsigned nstubs = combination.size();
+        acomb.stubs_r   .resize(nstubs);
+        acomb.stubs_phi .resize(nstubs);
+        acomb.stubs_z   .resize(nstubs);
+        acomb.stubs_bool.resize(nstubs);
+
+        for (unsigned istub=0; istub<nstubs; ++istub) {
+            const unsigned stubRef = combination[istub];
+            if (stubRef != CombinationFactory::BAD) {
+                acomb.stubs_r   [istub] = evt.stubs_r  .at(stubRef);
+                acomb.stubs_phi [istub] = evt.stubs_phi.at(stubRef);
+                acomb.stubs_z   [istub] = evt.stubs_z  .at(stubRef);
+                acomb.stubs_bool[istub] = true;
+            } else {
+                acomb.stubs_r   [istub] = 0.;
+                acomb.stubs_phi [istub] = 0.;
+                acomb.stubs_z   [istub] = 0.;
+                acomb.stubs_bool[istub] = false;
+            }
+        }
+
+        acomb.hitBits = getHitBits(acomb.stubs_bool);
+    }
+
+    if (verbose_>2 && !more) {
+        std::cout << Debug() << "... ... road: " << iroad << " # combinations: " << icomb << std::endl;
+    }
+    return more;
+}
 
-// principal component cut function
-bool PrincipalCuts(std::vector<float> princes){
-  bool pass=true;
-  const float Cuts6[12]={58.,33.,22.,12.,-1.,-1.,9.,3.,3.,3.,-1.,-1.};
-  const float Cuts5[10]={33.,22.,12.,-1.,-1.,3.,3.,3.,-1.,-1.};
-  if(princes.size()==12) for(unsigned i=0; i<princes.size(); ++i){
-    if(Cuts6[i]==-1) continue;
-    if(fabs(princes[i])>Cuts6[i]){
-      pass=false;
-      break;
-    }
-  }
-  else for(unsigned i=0; i<princes.size(); ++i){
-    if(Cuts5[i]==-1) continue;
-    if(fabs(princes[i])>Cuts5[i]){
-      pass=false;
-      break;
-    }
-  }
-  return pass;
+// _____________________________________________________________________________
+// Empty acombs, keeping its elements in the spares of the worker
+void TrackFitter::recycleCombinations(Worker& worker, std::vector<TTRoadComb>& acombs) const {
+    std::move(acombs.begin(), acombs.end(), std::back_inserter(worker.spareCombs));
+    acombs.clear();
 }
+
+// _____________________________________________________________________________
+// Fit the combinations, atracks[i] is the fit of acombs[i]. With the 5/6
+// downdate, the 5/6 combinations with a 6/6 combination of the same road
+// among acombs are derived from its fit. With the fit cache, the distinct
+// combinations left are fitted once.
+int TrackFitter::fitCombinations(Worker& worker, const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks) const {
+    const std::vector<TTRoadComb> * fulls = &acombs;
+    std::vector<TTTrack2> * fullTracks = &atracks;
+    if (po_.downdate) {
+        worker.fitDowndate.select(acombs, worker.fullCombs);
+        fulls = &worker.fullCombs;
+        fullTracks = &worker.fullTracks;
+    }
+
+    int fitstatus = 0;
+    if (po_.fitCache) {
+        worker.fitCache.select(*fulls, worker.uniqueCombs);
+        fitstatus = worker.fitter->fitBatch(worker.uniqueCombs, worker.uniqueTracks);
+        worker.fitCache.expand(worker.uniqueTracks, *fullTracks);
+    } else {
+        fitstatus = worker.fitter->fitBatch(*fulls, *fullTracks);
+    }
+
+    if (po_.downdate)
+        fitstatus |= worker.fitDowndate.expand(*worker.fitter, acombs, worker.fullTracks, atracks);
+    return fitstatus;
 }
 
+// _____________________________________________________________________________
+// Select the fitted tracks, in the order of the combinations
+void TrackFitter::selectTracks(const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks, int fitstatus, std::vector<TTTrack2>& tracks) const {
+    for (unsigned icomb=0; icomb<acombs.size(); ++icomb) {
+        const TTRoadComb& acomb = acombs.at(icomb);
+        TTTrack2& atrack = atracks.at(icomb);
+
+        if (verbose_>2) {
+            std::cout << Debug() << "... ... ... comb: " << acomb.combRef << " " << acomb;
+            std::cout << std::endl;
+        }
+
+        atrack.setTower     (po_.tower);
+        atrack.setRoadRef   (acomb.roadRef);
+        atrack.setCombRef   (acomb.combRef);
+        atrack.setPatternRef(acomb.patternRef);
+        atrack.setPtSegment (acomb.ptSegment);
+        atrack.setHitBits   (acomb.hitBits);
+        atrack.setStubRefs  (acomb.stubRefs);
+
+        if (selection_.pass(atrack))
+            tracks.push_back(atrack);
+
+        if (verbose_>2)  std::cout << Debug() << "... ... ... track: " << acomb.combRef << " status: " << fitstatus << " reduced chi2: " << atrack.chi2Red() << " invPt: " << atrack.invPt() << " phi0: " << atrack.phi0() << " cottheta: " << atrack.cottheta() << " z0: " << atrack.z0() << std::endl;
+    }
+}
+
+// _____________________________________________________________________________
+// Sort the tracks, find ghosts and duplicates, and associate them to the truth
+bool TrackFitter::finishEvent(const RoadEvent& evt, Worker& worker, std::vector<TTTrack2>& tracks) const {
+    const long long ievt = evt.ievt;
+
+    std::sort(tracks.begin(), tracks.end(), sortByPt);
+
+
+    if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # tracks: " << tracks.size() << std::endl;
+    if (verbose_>3) {
+        for (unsigned itrack=0; itrack!=tracks.size(); ++itrack) {
+            std::cout << "... ... track: " << itrack << " " << tracks.at(itrack) << std::endl;
+        }
+    }
+
+    // _________________________________________________________________________
+    // Find ghosts
+
+    worker.ghostBuster.flagGhostTracks(tracks);
+
+    const bool kept = !tracks.empty();
+
+    if (tracks.size() > (unsigned) po_.maxTracks)
+        tracks.resize(po_.maxTracks);
+
+
+
+    // -------------------------------------------------------------------------
+    // Classify tracks as duplicates or not (for duplicate removal)
+    // In the algorithm tracking particles are sorted by pT
+    // And AM tracks are sorted by logic and pT
+    // -------------------------------------------------------------------------
+    worker.duplicateRemoval.CheckTracks(tracks, po_.rmDuplicate);
+
+    //--------------------------------------------------------------------------
+    // Identify and flag duplicates by defining a track-parameter space
+    // inside of which anything is considered to be a single track
+    //--------------------------------------------------------------------------
+    if(po_.rmParDuplicate) worker.parameterDuplicateRemoval.ReduceTracks(tracks);
+
+
+
+
+    // _________________________________________________________________________
+    // Track categorization
+
+    if (po_.speedup<1) {
+        std::vector<TrackingParticle> trkParts = evt.trkParts;
+        worker.truthAssociator.associate(trkParts, tracks);
+    }
+
+    return kept;
+}
+
+// _____________________________________________________________________________
+// Fit the tracks of an event
+bool TrackFitter::processEvent(const RoadEvent& evt, Worker& worker, std::vector<TTTrack2>& tracks) const {
+    if (!fitEvent(evt, worker, tracks))
+        return false;
+
+    return finishEvent(evt, worker, tracks);
+}
+
+// _____________________________________________________________________________
+// Fit the combinations of an event and select the tracks. The combinations
+// are fitted in blocks of about combsPerBlock, so that the memory does not
+// grow with the number of combinations of the event. With the 5/6 downdate,
+// a road is not split over blocks, so that its 5/6 combinations are paired
+// with its 6/6 ones as when all the combinations are fitted at once. The fit
+// cache works within a block: the fit of a combination does not depend on
+// the others, so only the number of combinations fitted again depends on it.
+bool TrackFitter::fitEvent(const RoadEvent& evt, Worker& worker, std::vector<TTTrack2>& tracks) const {
+    const unsigned nroads = std::min((unsigned) evt.patternRef.size(), (unsigned) po_.maxRoads);
+    if (verbose_>2)  std::cout << Debug() << "... evt: " << evt.ievt << " # roads: " << evt.patternRef.size() << std::endl;
+
+    tracks.clear();
+    if (!nroads)  // skip if no road
+        return false;
+
+    // _________________________________________________________________________
+    // Track fitters taking fit combinations
+
+    std::vector<TTRoadComb>& acombs = worker.acombs;
+    recycleCombinations(worker, acombs);
+
+    const bool splitRoads = !po_.downdate;
+
+    // Loop over the roads
+    for (unsigned iroad=0; iroad<nroads; ++iroad) {
+        bool more = startCombinations(evt, iroad, worker);
+        while (more) {
+            const unsigned ncombs = splitRoads ? combsPerBlock - acombs.size() : combsPerBlock;
+            more = makeCombinations(evt, iroad, worker, acombs, ncombs);
+            if (acombs.size() >= combsPerBlock && (splitRoads || !more))
+                fitBlock(worker, acombs, tracks);
+        }
+    }
+
+    if (!acombs.empty())
+        fitBlock(worker, acombs, tracks);
+
+    return true;
+}
+
+// _____________________________________________________________________________
+// Fit a block of combinations at once, append the selected tracks, and empty
+// the block
+void TrackFitter::fitBlock(Worker& worker, std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& tracks) const {
+    int fitstatus = fitCombinations(worker, acombs, worker.atracks);
+
+    selectTracks(acombs, worker.atracks, fitstatus, tracks);
+
+    recycleCombinations(worker, acombs);
+}
+
+// _____________________________________________________________________________
+// Fit the tracks of an event using all the threads. The combinations of the
+// roads are made in parallel. The 5/6 downdate pairs and the distinct
+// combinations of the fit cache are found over the whole event, then the
+// combinations left to fit are packed into tasks of about the same size, so
+// that a road with many combinations is split over several threads. The
+// tasks are handed out one at a time to the threads that are free. The
+// tracks are collected in the same order as in processEvent().
+bool TrackFitter::processEventOverRoads(const RoadEvent& evt, std::vector<TTTrack2>& tracks) const {
+    const unsigned nroads = std::min((unsigned) evt.patternRef.size(), (unsigned) po_.maxRoads);
+    if (verbose_>2)  std::cout << Debug() << "... evt: " << evt.ievt << " # roads: " << evt.patternRef.size() << std::endl;
+
+    tracks.clear();
+    if (!nroads)  // skip if no road
+        return false;
+
+    const unsigned nthreads = workers_.size();
+
+    // Combinations of each road
+    std::vector<std::vector<TTRoadComb> > roadCombs(nroads);
+    parallelForThread(nroads, nthreads, [&](unsigned iroad, unsigned ithread) {
+        Worker& worker = *workers_.at(ithread);
+        if (startCombinations(evt, iroad, worker))
+            while (makeCombinations(evt, iroad, worker, roadCombs.at(iroad), combsPerBlock)) {}
+    });
+
+    // All the combinations of the event, in the order of the roads
+    Worker& worker = *workers_.front();
+    std::vector<TTRoadComb>& acombs = worker.acombs;
+    recycleCombinations(worker, acombs);
+    for (unsigned iroad=0; iroad<nroads; ++iroad) {
+        std::move(roadCombs.at(iroad).begin(), roadCombs.at(iroad).end(), std::back_inserter(acombs));
+        std::vector<TTRoadComb>().swap(roadCombs.at(iroad));
+    }
+
+    // The combinations to fit
+    std::vector<TTRoadComb> * fulls = &acombs;
+    if (po_.downdate) {
+        worker.fitDowndate.select(acombs, worker.fullCombs);
+        fulls = &worker.fullCombs;
+    }
+    if (po_.fitCache) {
+        worker.fitCache.select(*fulls, worker.uniqueCombs);
+        fulls = &worker.uniqueCombs;
+    }
+
+    // Pack them into tasks
+    std::vector<std::vector<TTRoadComb> > taskCombs(1);
+    for (unsigned icomb=0; icomb<fulls->size(); ++icomb) {
+        if (taskCombs.back().size() == combsPerTask)
+            taskCombs.push_back(std::vector<TTRoadComb>());
+        taskCombs.back().push_back(std::move(fulls->at(icomb)));
+    }
+
+    // Fit them
+    std::vector<std::vector<TTTrack2> > taskTracks(taskCombs.size());
+    std::vector<int> taskStatus(taskCombs.size());
+    parallelForThread(taskCombs.size(), nthreads, [&](unsigned itask, unsigned ithread) {
+        taskStatus.at(itask) = workers_.at(ithread)->fitter->fitBatch(taskCombs.at(itask), taskTracks.at(itask));
+    });
+
+    // Collect the tracks, and copy or derive them for all the combinations
+    std::vector<TTTrack2>& fullTracks = po_.downdate ? worker.fullTracks : worker.atracks;
+    std::vector<TTTrack2>& fitTracks = po_.fitCache ? worker.uniqueTracks : fullTracks;
+    fitTracks.clear();
+    int fitstatus = 0;
+    for (unsigned itask=0; itask<taskCombs.size(); ++itask) {
+        std::move(taskTracks.at(itask).begin(), taskTracks.at(itask).end(), std::back_inserter(fitTracks));
+        fitstatus = std::max(fitstatus, taskStatus.at(itask));
+    }
+
+    // Put the combinations back if they are all of acombs
+    if (fulls == &acombs) {
+        acombs.clear();
+        for (unsigned itask=0; itask<taskCombs.size(); ++itask)
+            std::move(taskCombs.at(itask).begin(), taskCombs.at(itask).end(), std::back_inserter(acombs));
+    }
+    std::vector<std::vector<TTRoadComb> >().swap(taskCombs);
+
+    if (po_.fitCache)
+        worker.fitCache.expand(worker.uniqueTracks, fullTracks);
+
+    if (po_.downdate) {
+        // The derived fits are done by the threads too, in ranges of combsPerTask
+        const unsigned ncombs = acombs.size();
+        const unsigned nranges = (ncombs + combsPerTask - 1) / combsPerTask;
+        std::vector<int> rangeStatus(nranges);
+        std::vector<long int> rangeDerived(nranges);
+        worker.atracks.resize(ncombs);
+        parallelForThread(nranges, nthreads, [&](unsigned irange, unsigned ithread) {
+            const unsigned begin = irange * combsPerTask, end = std::min(begin + combsPerTask, ncombs);
+            rangeStatus.at(irange) = worker.fitDowndate.expand(*workers_.at(ithread)->fitter, acombs, worker.fullTracks, worker.atracks, begin, end, rangeDerived.at(irange));
+        });
+        for (unsigned irange=0; irange<nranges; ++irange) {
+            fitstatus = std::max(fitstatus, rangeStatus.at(irange));
+            worker.fitDowndate.addDerived(rangeDerived.at(irange));
+        }
+    }
+
+    selectTracks(acombs, worker.atracks, fitstatus, tracks);
+
+    return finishEvent(evt, worker, tracks);
+}
+
+// _____________________________________________________________________________
+// Fit the tracks of a chunk of events in parallel
+void TrackFitter::processEvents(const std::vector<RoadEvent>& events, unsigned nevents, std::vector<std::vector<TTTrack2> >& tracks, std::vector<char>& kept) const {
+    const unsigned nthreads = workers_.size();
+
+    // Events with many roads are fitted one at a time, with their roads
+    // split over the threads
+    std::vector<unsigned> light, heavy;
+    for (unsigned i=0; i<nevents; ++i) {
+        if (nthreads > 1 && po_.parallelRoads > 0 && events.at(i).patternRef.size() >= (unsigned) po_.parallelRoads)
+            heavy.push_back(i);
+        else
+            light.push_back(i);
+    }
+
+    parallelForThread(light.size(), nthreads, [&](unsigned j, unsigned ithread) {
+        const unsigned i = light.at(j);
+        kept.at(i) = processEvent(events.at(i), *workers_.at(ithread), tracks.at(i));
+    });
+
+    for (unsigned j=0; j<heavy.size(); ++j) {
+        const unsigned i = heavy.at(j);
+        kept.at(i) = processEventOverRoads(events.at(i), tracks.at(i));
+    }
+}
 
 // _____________________________________________________________________________
 // Do track fitting
@@ -65,6 +524,7 @@ int TrackFitter::makeTracks(TString src, TString out) {
     // _________________________________________________________________________
     // For reading
     TTRoadReader reader(verbose_);
+    reader.setReadAhead(po_.readCacheSize, po_.readAhead);
 
     if (reader.init(src, prefixRoad_, suffix_)) {
         std::cout << Error() << "Failed to initialize TTRoadReader." << std::endl;
@@ -82,240 +542,364 @@ int TrackFitter::makeTracks(TString src, TString out) {
     // _________________________________________________________________________
     // Loop over all events
 
+    // The events are read in chunks by this thread, processed in parallel,
+    // then written in the input order
+    const unsigned nthreads = workers_.size();
+    const unsigned chunkSize = (nthreads > 1) ? 16 * nthreads : 1;
+
     // Containers
-    std::vector<TTTrack2> tracks;
-    tracks.reserve(300);
+    std::vector<RoadEvent> events(chunkSize);
+    std::vector<std::vector<TTTrack2> > tracks(chunkSize);
+    std::vector<char> kept(chunkSize);
+    for (unsigned i=0; i<chunkSize; ++i)
+        tracks.at(i).reserve(300);
 
     // Bookkeepers
     long int nRead = 0, nKept = 0;
 
-    for (long long ievt=0; ievt<nEvents_; ++ievt) {
-        if (reader.loadTree(ievt) < 0)  break;
-        reader.getEntry(ievt);
+    bool more = true;
+    long long ievt = 0;
+    while (more && ievt<nEvents_) {
+        unsigned nevents = 0;
+        for (; nevents<chunkSize && ievt<nEvents_; ++nevents, ++ievt) {
+            if (reader.loadTree(ievt) < 0) {
+                more = false;
+                break;
+            }
+            reader.getEntry(ievt);
+            readEvent(reader, ievt, events.at(nevents));
+
+            // The output tree shares the branches of the input chain, so they
+            // are kept with the event until it is written
+            if (chunkSize > 1)
+                reader.swapBuffers(events.at(nevents).branches);
+        }
 
-        const unsigned nroads = reader.vr_patternRef->size();
-        if (verbose_>1 && ievt%100==0)  std::cout << Debug() << Form("... Processing event: %7lld, fitting: %7ld", ievt, nKept) << std::endl;
-        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # roads: " << nroads << std::endl;
+        processEvents(events, nevents, tracks, kept);
 
-        if (!nroads) {  // skip if no road
-            writer.fill(std::vector<TTTrack2>());
+        for (unsigned i=0; i<nevents; ++i) {
+            if (verbose_>1 && events.at(i).ievt%100==0)  std::cout << Debug() << Form("... Processing event: %7lld, fitting: %7ld", events.at(i).ievt, nKept) << std::endl;
+
+            if (kept.at(i))
+                ++nKept;
+
+            if (chunkSize > 1)
+                reader.swapBuffers(events.at(i).branches);
+
+            writer.fill(tracks.at(i));
             ++nRead;
-            continue;
         }
+    }
 
-        tracks.clear();
-        int fitstatus = 0;
+    if (nRead == 0) {
+        std::cout << Error() << "Failed to read any event." << std::endl;
+        return 1;
+    }
 
+    if (verbose_)  std::cout << Info() << Form("Read: %7ld, triggered: %7ld", nRead, nKept) << std::endl;
 
-        // _____________________________________________________________________
-        // Track fitters taking fit combinations
+    printStatistics();
 
-        // Loop over the roads
-        for (unsigned iroad=0; iroad<nroads; ++iroad) {
-            if (iroad >= (unsigned) po_.maxRoads)  break;
+    // _________________________________________________________________________
+    // Write histograms
+    writeHistograms();
 
-            const unsigned patternRef = reader.vr_patternRef->at(iroad);
-            if (patternRef >= (unsigned) po_.maxPatterns)  continue;
+    long long nentries = writer.writeTree();
+    assert(nentries == nRead);
 
-            // Get combinations of stubRefs
-            std::vector<std::vector<unsigned> > stubRefs = reader.vr_stubRefs->at(iroad);
-	    std::vector<std::vector<float> > stubDeltaS; //pass DeltaS information for each stub to the PDDS
-            for (unsigned ilayer=0; ilayer<stubRefs.size(); ++ilayer) {
-	        std::vector<float> placeholderTemp;
-	        stubDeltaS.push_back(placeholderTemp);
-		if(po_.PDDS) for(unsigned istub=0; istub<stubRefs[ilayer].size(); ++istub) stubDeltaS[ilayer].push_back(reader.vb_trigBend->at(stubRefs[ilayer][istub]));
-		else for(unsigned istub=0; istub<stubRefs[ilayer].size(); ++istub) stubDeltaS[ilayer].push_back(0.); //default DDS is 0 to disable PDDS cleaning
-                if (stubRefs.at(ilayer).size() > (unsigned) po_.maxStubs){
-                    stubRefs.at(ilayer).resize(po_.maxStubs);
-		    stubDeltaS.at(ilayer).resize(po_.maxStubs);
-		}
-            }
-	    
-	    //choose either the normal combination building or the 5/6 permutations per 6/6 road in addition and/or pairwise Delta Delta S cleaning (PDDS)
-	    std::vector<std::vector<unsigned> > combinations;
-	    if (po_.oldCB) combinations = combinationFactory_.combine(stubRefs);
-            else if(po_.PDDS) combinations = pairCombinationFactory_.combine(stubRefs, stubDeltaS, po_.FiveOfSix);
-	    else combinations = combinationBuilderFactory_->combine(stubRefs);
+    return 0;
+}
 
-	    // std::cout << "combinations = " << combinations.size() << std::endl;
+// _____________________________________________________________________________
+// Do pattern recognition and track fitting, without writing the roads in
+// between unless roadOut is given
+int TrackFitter::makeRoadsAndTracks(PatternMatcher& matcher, TString src, TString out, TString roadOut) {
+    if (verbose_)  std::cout << Info() << "Reading " << nEvents_ << " events, matching patterns and fitting tracks." << std::endl;
 
-            for (unsigned icomb=0; icomb<combinations.size(); ++icomb)
-                assert(combinations.at(icomb).size() == reader.vr_stubRefs->at(iroad).size());
+    // _________________________________________________________________________
+    // For reading
+    TTStubPlusTPReader reader(verbose_);
+    reader.setReadAhead(po_.readCacheSize, po_.readAhead);
 
-            if (verbose_>2) {
-                std::cout << Debug() << "... ... road: " << iroad << " # combinations: " << combinations.size() << std::endl;
-            }
+    if (reader.init(src)) {
+        std::cout << Error() << "Failed to initialize TTStubPlusTPReader." << std::endl;
+        return 1;
+    }
 
-            // Loop over the combinations
-            for (unsigned icomb=0; icomb<combinations.size(); ++icomb) {
-                if (icomb >= (unsigned) po_.maxCombs)  break;
-
-                // Create and set TTRoadComb
-                TTRoadComb acomb;
-                acomb.roadRef    = iroad;
-                acomb.combRef    = icomb;
-                acomb.patternRef = patternRef;
-                acomb.ptSegment  = getPtSegment(reader.vr_patternInvPt->at(iroad));
-                acomb.stubRefs   = combinations.at(icomb);
-
-                acomb.stubs_r   .clear();
-                acomb.stubs_phi .clear();
-                acomb.stubs_z   .clear();
-                acomb.stubs_bool.clear();
-
-                for (unsigned istub=0; istub<acomb.stubRefs.size(); ++istub) {
-                    const unsigned stubRef = acomb.stubRefs.at(istub);
-                    if (stubRef != CombinationFactory::BAD) {
-                        acomb.stubs_r   .push_back(reader.vb_r   ->at(stubRef));
-                        acomb.stubs_phi .push_back(reader.vb_phi ->at(stubRef));
-                        acomb.stubs_z   .push_back(reader.vb_z   ->at(stubRef));
-                        acomb.stubs_bool.push_back(true);
-                    } else {
-                        acomb.stubs_r   .push_back(0.);
-                        acomb.stubs_phi .push_back(0.);
-                        acomb.stubs_z   .push_back(0.);
-                        acomb.stubs_bool.push_back(false);
-                    }
-                }
-
-                acomb.hitBits = getHitBits(acomb.stubs_bool);
-
-                if (verbose_>2) {
-                    std::cout << Debug() << "... ... ... comb: " << icomb << " " << acomb;
-                    std::cout << std::endl;
-                }
-
-                // _____________________________________________________________
-                // Fit
-                TTTrack2 atrack;
-                fitstatus = fitter_->fit(acomb, atrack);
-
-                atrack.setTower     (po_.tower);
-                atrack.setRoadRef   (acomb.roadRef);
-                atrack.setCombRef   (acomb.combRef);
-                atrack.setPatternRef(acomb.patternRef);
-                atrack.setPtSegment (acomb.ptSegment);
-                atrack.setHitBits   (acomb.hitBits);
-                atrack.setStubRefs  (acomb.stubRefs);
-
-                if(!po_.CutPrincipals){
-		  if (atrack.chi2Red() < po_.maxChi2)  // reduced chi^2 = chi^2 / ndof
-                    tracks.push_back(atrack);
-		}
-		else if(PrincipalCuts(atrack.principals())) tracks.push_back(atrack);
-
-                if (verbose_>2)  std::cout << Debug() << "... ... ... track: " << icomb << " status: " << fitstatus << " reduced chi2: " << atrack.chi2Red() << " invPt: " << atrack.invPt() << " phi0: " << atrack.phi0() << " cottheta: " << atrack.cottheta() << " z0: " << atrack.z0() << std::endl;
-            }
-        }  // loop over the roads
+    // _________________________________________________________________________
+    // For writing
+    std::unique_ptr<TTRoadWriter> roadWriter;
+    if (roadOut != "") {
+        roadWriter.reset(new TTRoadWriter(verbose_));
+        if (roadWriter->init(reader.getChain(), roadOut, prefixRoad_, suffix_)) {
+            std::cout << Error() << "Failed to initialize TTRoadWriter." << std::endl;
+            return 1;
+        }
+    }
+
+    // The histograms go to the directory of the last writer
+    TTTrackWriter writer(verbose_);
+    if (writer.init(reader.getChain(), out, prefixTrack_, suffix_)) {
+        std::cout << Error() << "Failed to initialize TTTrackWriter." << std::endl;
+        return 1;
+    }
 
-        std::sort(tracks.begin(), tracks.end(), sortByPt);
+    // _________________________________________________________________________
+    // Loop over all events
 
+    // The events are read and matched in chunks by this thread, fitted in
+    // parallel, then written in the input order
+    const unsigned nthreads = workers_.size();
+    const unsigned chunkSize = (nthreads > 1) ? 16 * nthreads : 1;
 
-        if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # tracks: " << tracks.size() << std::endl;
-        if (verbose_>3) {
-            for (unsigned itrack=0; itrack!=tracks.size(); ++itrack) {
-                std::cout << "... ... track: " << itrack << " " << tracks.at(itrack) << std::endl;
+    // Containers
+    std::vector<RoadEvent> events(chunkSize);
+    std::vector<std::vector<TTRoad> > roads(chunkSize);
+    std::vector<std::vector<TTTrack2> > tracks(chunkSize);
+    std::vector<char> kept(chunkSize);
+    for (unsigned i=0; i<chunkSize; ++i) {
+        roads.at(i).reserve(300);
+        tracks.at(i).reserve(300);
+    }
+
+    // Bookkeepers
+    long int nRead = 0, nTriggered = 0, nKept = 0;
+
+    bool more = true;
+    long long ievt = 0;
+    while (more && ievt<nEvents_) {
+        unsigned nevents = 0;
+        for (; nevents<chunkSize && ievt<nEvents_; ++nevents, ++ievt) {
+            if (reader.loadTree(ievt) < 0) {
+                more = false;
+                break;
             }
+            reader.getEntry(ievt);
+
+            if (matcher.matchEvent(reader, ievt, roads.at(nevents)))
+                return 1;
+
+            readEvent(reader, ievt, roads.at(nevents), events.at(nevents));
+
+            // The output trees share the branches of the input chain, so they
+            // are kept with the event until it is written
+            if (chunkSize > 1)
+                reader.swapBuffers(events.at(nevents).branches);
         }
 
-        // _____________________________________________________________________
-        // Find ghosts
+        processEvents(events, nevents, tracks, kept);
 
-        for (unsigned itrack=0; itrack<tracks.size(); ++itrack) {  // all tracks
-            for (unsigned jtrack=0; jtrack<itrack; ++jtrack) {  // only non ghost tracks
-                if (tracks.at(jtrack).isGhost())  continue;
+        for (unsigned i=0; i<nevents; ++i) {
+            if (verbose_>1 && events.at(i).ievt%100==0)  std::cout << Debug() << Form("... Processing event: %7lld, triggering: %7ld, fitting: %7ld", events.at(i).ievt, nTriggered, nKept) << std::endl;
 
-                bool isGhost = ghostBuster_.isGhostTrack(tracks.at(jtrack).stubRefs(), tracks.at(itrack).stubRefs());
-                if (isGhost) {
-                    tracks.at(itrack).setAsGhost();
-                }
-            }
+            if (!roads.at(i).empty())
+                ++nTriggered;
+            if (kept.at(i))
+                ++nKept;
+
+            if (chunkSize > 1)
+                reader.swapBuffers(events.at(i).branches);
+
+            if (roadWriter)
+                roadWriter->fill(roads.at(i));
+            writer.fill(tracks.at(i));
+            ++nRead;
         }
+    }
 
-        if (! tracks.empty())
-            ++nKept;
+    if (nRead == 0) {
+        std::cout << Error() << "Failed to read any event." << std::endl;
+        return 1;
+    }
+
+    if (verbose_)  std::cout << Info() << Form("Read: %7ld, triggered: %7ld, fitted: %7ld", nRead, nTriggered, nKept) << std::endl;
 
-        if (tracks.size() > (unsigned) po_.maxTracks)
-            tracks.resize(po_.maxTracks);
+    printStatistics();
 
+    // _________________________________________________________________________
+    // Write histograms
+    writeHistograms();
 
+    if (roadWriter) {
+        long long nentries = roadWriter->writeTree();
+        assert(nentries == nRead);
+    }
 
-	// ---------------------------------------------------------------------
-	// Classify tracks as duplicates or not (for duplicate removal)
-	// In the algorithm tracking particles are sorted by pT
-	// And AM tracks are sorted by logic and pT
-	// ---------------------------------------------------------------------
-	DuplicateRemoval flagDuplicates;
-	flagDuplicates.CheckTracks(tracks, po_.rmDuplicate);
+    long long nentries = writer.writeTree();
+    assert(nentries == nRead);
 
-	//----------------------------------------------------------------------
-	// Identify and flag duplicates by defining a track-parameter space 
-	// inside of which anything is considered to be a single track
-	//----------------------------------------------------------------------
-	ParameterDuplicateRemoval RemoveParameterDuplicates;
-	if(po_.rmParDuplicate) RemoveParameterDuplicates.ReduceTracks(tracks);
+    return 0;
+}
 
+// _____________________________________________________________________________
+// Same as makeRoadsAndTracks(), with the steps of the event loop run as a
+// pipeline of concurrent stages. The fitting stage has one thread per fitter,
+// the other stages one thread each. The output trees share the branches of
+// the input chain, so they are cloned from a second reader that is not read:
+// the reading stage moves the branches of an event to its item, and the
+// writing stage moves them to the second reader.
+int TrackFitter::makeRoadsAndTracksPipelined(PatternMatcher& matcher, TString src, TString out, TString roadOut) {
+    if (verbose_)  std::cout << Info() << "Reading " << nEvents_ << " events, matching patterns and fitting tracks in a pipeline." << std::endl;
 
+    TThread::Initialize();
 
+    // _________________________________________________________________________
+    // For reading
+    TTStubPlusTPReader reader(verbose_);
+    reader.setReadAhead(po_.readCacheSize, po_.readAhead);
 
-        // _____________________________________________________________________        // Track categorization
+    if (reader.init(src)) {
+        std::cout << Error() << "Failed to initialize TTStubPlusTPReader." << std::endl;
+        return 1;
+    }
 
-        if (po_.speedup<1) {
-            const unsigned nparts = reader.vp2_primary->size();
-            if (verbose_>2)  std::cout << Debug() << "... evt: " << ievt << " # particles: " << nparts << std::endl;
+    TTStubPlusTPReader writeReader(verbose_);
 
-            std::vector<TrackingParticle> trkParts;
-            for (unsigned ipart=0; ipart<nparts; ++ipart) {
-                bool  primary         = reader.vp2_primary->at(ipart);
-                int   simCharge       = reader.vp2_charge->at(ipart);
+    if (writeReader.init(src)) {
+        std::cout << Error() << "Failed to initialize TTStubPlusTPReader." << std::endl;
+        return 1;
+    }
 
-                if (simCharge!=0 && primary) {
-                    float simPt           = reader.vp2_pt->at(ipart);
-                    float simEta          = reader.vp2_eta->at(ipart);
-                    float simPhi          = reader.vp2_phi->at(ipart);
-                    //float simVx           = reader.vp2_vx->at(ipart);
-                    //float simVy           = reader.vp2_vy->at(ipart);
-                    float simVz           = reader.vp2_vz->at(ipart);
-                    int   simCharge       = reader.vp2_charge->at(ipart);
-                    int   simPdgId        = reader.vp2_pdgId->at(ipart);
-
-                    float simCotTheta     = std::sinh(simEta);
-                    float simChargeOverPt = float(simCharge)/simPt;
-
-                    trkParts.emplace_back(TrackingParticle{  // using POD type constructor
-                        (int) ipart,
-                        simPdgId,
-                        simChargeOverPt,
-                        simPhi,
-                        simCotTheta,
-                        simVz,
-                        0.
-                    });
-
-                    if (verbose_>3)  std::cout << Debug() << "... ... part: " << ipart << " primary: " << primary << " " << trkParts.back();
-                }
-            }
-            truthAssociator_.associate(trkParts, tracks);
+    // _________________________________________________________________________
+    // For writing
+    std::unique_ptr<TTRoadWriter> roadWriter;
+    if (roadOut != "") {
+        roadWriter.reset(new TTRoadWriter(verbose_));
+        if (roadWriter->init(writeReader.getChain(), roadOut, prefixRoad_, suffix_)) {
+            std::cout << Error() << "Failed to initialize TTRoadWriter." << std::endl;
+            return 1;
         }
+    }
 
-        writer.fill(tracks);
-        ++nRead;
+    // The histograms go to the directory of the last writer
+    TTTrackWriter writer(verbose_);
+    if (writer.init(writeReader.getChain(), out, prefixTrack_, suffix_)) {
+        std::cout << Error() << "Failed to initialize TTTrackWriter." << std::endl;
+        return 1;
     }
 
+    // Read one event so that the vectors of all the branches exist, as
+    // swapBuffers() skips the null ones
+    if (writeReader.loadTree(0) >= 0)
+        writeReader.getEntry(0);
+
+    // _________________________________________________________________________
+    // Loop over all events
+
+    const unsigned nthreads = workers_.size();
+
+    // Containers
+    std::vector<PipelineEvent> items(16 * nthreads);
+    for (unsigned i=0; i<items.size(); ++i) {
+        items.at(i).roads.reserve(300);
+        items.at(i).tracks.reserve(300);
+    }
+    std::vector<bool> stubsSkipped;
+
+    // Duplicate removal and truth association, the fitter is not used
+    Worker finisher(0, po_.FiveOfSix);
+
+    // Bookkeepers
+    long int nRead = 0, nTriggered = 0, nKept = 0;
+    long long ievt = 0;
+
+    Pipeline<PipelineEvent> pipeline(items);
+
+    pipeline.addStage("read", 1, [&](PipelineEvent& item, unsigned) -> int {
+        if (ievt >= nEvents_ || reader.loadTree(ievt) < 0)
+            return -1;
+        reader.getEntry(ievt);
+
+        readStubs(reader, ievt, item.evt);
+        item.stubs_modId    = *reader.vb_modId;
+        item.stubs_coordx   = *reader.vb_coordx;
+        item.stubs_coordy   = *reader.vb_coordy;
+        item.stubs_trigBend = *reader.vb_trigBend;
+        reader.swapBuffers(item.evt.branches);
+        ++ievt;
+        return 0;
+    });
+
+    pipeline.addStage("superstrip", 1, [&](PipelineEvent& item, unsigned) -> int {
+        const long long i = item.evt.ievt;
+        if (verbose_>2)  std::cout << Debug() << "... evt: " << i << " # stubs: " << item.stubs_modId.size() << std::endl;
+
+        matcher.flagStubs(i, item.stubs_modId, item.stubs_coordx, item.stubs_coordy, item.stubsNotInTower, item.stubsSkipped);
+        return matcher.findSuperstrips(item.stubs_modId, item.stubs_coordx, item.stubs_coordy, item.evt.stubs_r, item.evt.stubs_phi, item.evt.stubs_z, item.stubs_trigBend,
+                                       item.stubsSkipped, item.ssIdHashes);
+    });
+
+    pipeline.addStage("lookup", 1, [&](PipelineEvent& item, unsigned) -> int {
+        matcher.findRoads(item.ssIdHashes, item.stubsSkipped, item.roads);
+        readRoads(item.roads, item.evt);
+        return 0;
+    });
+
+    pipeline.addStage("fit", nthreads, [&](PipelineEvent& item, unsigned ithread) -> int {
+        item.fitted = fitEvent(item.evt, *workers_.at(ithread), item.tracks);
+        return 0;
+    });
+
+    pipeline.addStage("duplicate", 1, [&](PipelineEvent& item, unsigned) -> int {
+        item.kept = item.fitted && finishEvent(item.evt, finisher, item.tracks);
+        return 0;
+    });
+
+    pipeline.addStage("write", 1, [&](PipelineEvent& item, unsigned) -> int {
+        const long long i = item.evt.ievt;
+        if (verbose_>1 && i%100==0)  std::cout << Debug() << Form("... Processing event: %7lld, triggering: %7ld, fitting: %7ld", i, nTriggered, nKept) << std::endl;
+
+        if (!item.roads.empty())
+            ++nTriggered;
+        if (item.kept)
+            ++nKept;
+
+        // Same nulling of the stubs and particles as in the road file
+        writeReader.swapBuffers(item.evt.branches);
+        matcher.selectStubs(writeReader, i, stubsSkipped);
+
+        if (roadWriter)
+            roadWriter->fill(item.roads);
+        writer.fill(item.tracks);
+        ++nRead;
+        return 0;
+    }, true);
+
+    int exitcode = pipeline.run();
+    if (exitcode)
+        return exitcode;
+
     if (nRead == 0) {
         std::cout << Error() << "Failed to read any event." << std::endl;
         return 1;
     }
 
-    if (verbose_)  std::cout << Info() << Form("Read: %7ld, triggered: %7ld", nRead, nKept) << std::endl;
+    if (verbose_)  std::cout << Info() << Form("Read: %7ld, triggered: %7ld, fitted: %7ld", nRead, nTriggered, nKept) << std::endl;
+
+    // A stage with a load close to 100% is the bottleneck; its throughput is
+    // the number of events per second of its threads, without the waits
+    if (verbose_) {
+        std::cout << Info() << Form("Pipeline: %.2f s", pipeline.wall()) << std::endl;
 
+        const std::vector<Pipeline<PipelineEvent>::Statistics> stats = pipeline.statistics();
+        for (unsigned istage=0; istage<stats.size(); ++istage) {
+            const Pipeline<PipelineEvent>::Statistics& stat = stats.at(istage);
+            const double throughput = stat.busy > 0. ? stat.nthreads * stat.nitems / stat.busy : 0.;
+            const double load = pipeline.wall() > 0. ? 100. * stat.busy / (stat.nthreads * pipeline.wall()) : 0.;
+            std::cout << Info() << Form("  %-10s threads: %2u  events: %7lld  busy: %8.2f s  idle: %8.2f s  throughput: %9.1f /s  load: %5.1f%%",
+                                        stat.name.c_str(), stat.nthreads, stat.nitems, stat.busy, stat.idle, throughput, load) << std::endl;
+        }
+    }
+
+    printStatistics();
 
     // _________________________________________________________________________
     // Write histograms
+    writeHistograms();
 
-    for (std::map<TString, TH1F *>::const_iterator it=fitter_->histograms_.begin();
-         it!=fitter_->histograms_.end(); ++it) {
-        if (it->second)  it->second->SetDirectory(gDirectory);
+    if (roadWriter) {
+        long long nentries = roadWriter->writeTree();
+        assert(nentries == nRead);
     }
 
     long long nentries = writer.writeTree();
@@ -324,6 +908,55 @@ int TrackFitter::makeTracks(TString src, TString out) {
     return 0;
 }
 
+// _____________________________________________________________________________
+// Print the fit cache, 5/6 downdate and PDDS statistics
+void TrackFitter::printStatistics() const {
+    const unsigned nthreads = workers_.size();
+
+    if (verbose_ && po_.fitCache) {
+        long int ncombinations = 0, nhits = 0;
+        for (unsigned ithread=0; ithread<nthreads; ++ithread) {
+            ncombinations += workers_.at(ithread)->fitCache.ncombinations();
+            nhits         += workers_.at(ithread)->fitCache.nhits();
+        }
+        std::cout << Info() << Form("Fit cache: %ld of %ld combinations reused (%.1f%%)", nhits, ncombinations, ncombinations ? 100. * nhits / ncombinations : 0.) << std::endl;
+    }
+
+    if (verbose_ && po_.downdate) {
+        long int ncombinations = 0, nderived = 0;
+        for (unsigned ithread=0; ithread<nthreads; ++ithread) {
+            ncombinations += workers_.at(ithread)->fitDowndate.ncombinations();
+            nderived      += workers_.at(ithread)->fitDowndate.nderived();
+        }
+        std::cout << Info() << Form("5/6 downdate: %ld of %ld combinations derived (%.1f%%)", nderived, ncombinations, ncombinations ? 100. * nderived / ncombinations : 0.) << std::endl;
+    }
+
+    if (verbose_ && po_.PDDS && !po_.oldCB) {
+        long int ntruncated = 0;
+        for (unsigned ithread=0; ithread<nthreads; ++ithread) {
+            ntruncated += workers_.at(ithread)->pairCombinationFactory.ntruncated();
+        }
+        if (ntruncated)
+            std::cout << Warning() << Form("PDDS: %ld roads had stubs dropped beyond %u per layer", ntruncated, PairCombinationFactory::MAX_STUBS) << std::endl;
+    }
+}
+
+// _____________________________________________________________________________
+// Merge the histograms of the fitters into the current directory
+void TrackFitter::writeHistograms() {
+    const unsigned nthreads = workers_.size();
+
+    TrackFitterAlgoBase * fitter = workers_.front()->fitter.get();
+    for (unsigned ithread=1; ithread<nthreads; ++ithread) {
+        fitter->mergeHistograms(*workers_.at(ithread)->fitter);
+    }
+
+    for (std::map<TString, TH1F *>::const_iterator it=fitter->histograms_.begin();
+         it!=fitter->histograms_.end(); ++it) {
+        if (it->second)  it->second->SetDirectory(gDirectory);
+    }
+}
+
 
 // _____________________________________________________________________________
 // Main driver
@@ -337,3 +970,23 @@ int TrackFitter::run() {
 
     return exitcode;
 }
+
+// _____________________________________________________________________________
+// Main driver of the fused pattern recognition and track fitting
+int TrackFitter::run(PatternMatcher& matcher) {
+    int exitcode = 0;
+    Timing(1);
+
+    exitcode = matcher.loadPatterns(po_.bankfile);
+    if (exitcode)  return exitcode;
+    Timing();
+
+    if (po_.pipeline)
+        exitcode = makeRoadsAndTracksPipelined(matcher, po_.input, po_.output, po_.roadfile);
+    else
+        exitcode = makeRoadsAndTracks(matcher, po_.input, po_.output, po_.roadfile);
+    if (exitcode)  return exitcode;
+    Timing();
+
+    return exitcode;
+}
@@ -10,6 +10,8 @@ Souvik Das, University of Florida
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoATF.h"
 using namespace slhcl1tt;
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 int stubUncertaintyStripWidth(double r, double &d_phi, double &d_z)
@@ -59,50 +61,69 @@ int stubUncertaintyStripWidth(double r, double &d_phi, double &d_z)
   return 1;
 }
 
-int stubUncertaintyClusterWidth(double r, double &d_phi, double &d_z)
-{
-  
-  double d_z_PS=0.15/sqrt(12);
-  double d_z_SS=5/sqrt(12);
-  
-  if (fabs(r-22)<5)
-  {
-    d_phi=0.0086/r;
-    d_z=d_z_PS;
-  }
-  else if (fabs(r-34)<5)
-  {
-    d_phi=0.0082/r;
-    d_z=d_z_PS;
-  }
-  else if (fabs(r-50)<5)
-  {
-    d_phi=0.0115/r;
-    d_z=d_z_PS;
-  }
-  else if (fabs(r-67)<5)
-  {
-    d_phi=0.0176/r;
-    d_z=d_z_SS;
-  }
-  else if (fabs(r-88)<5)
-  {
-    d_phi=0.0228/r;
-    d_z=d_z_SS;
-  }
-  else if (fabs(r-107)<5)
-  {
-    d_phi=0.0280/r;
-    d_z=d_z_SS;
+namespace {
+// Cluster width uncertainties of the barrel layers, as a table by layer: the
+// layer radius, the phi uncertainty times r, and the z uncertainty. A stub is
+// in a layer if its r is within 5 cm of the layer radius.
+struct LayerUncertainty {
+  double r;
+  double rd_phi;
+  double d_z;
+};
+
+const double d_z_PS=0.15/std::sqrt(12.);
+const double d_z_SS=5/std::sqrt(12.);
+
+const unsigned NLAYERS=TrackFitterAlgoATF::NLAYERS;
+const LayerUncertainty clusterWidth[NLAYERS]={
+  { 22., 0.0086, d_z_PS},
+  { 34., 0.0082, d_z_PS},
+  { 50., 0.0115, d_z_PS},
+  { 67., 0.0176, d_z_SS},
+  { 88., 0.0228, d_z_SS},
+  {107., 0.0280, d_z_SS}
+};
+
+// The weights 1/d_phi^2 = r^2 * (1/rd_phi^2) and 1/d_z^2 of each layer, and
+// the layer of the window that contains [i, i+1) cm, or -1 (the windows do
+// not overlap each other, and their edges are whole numbers)
+const unsigned NRADII=120;
+struct LayerTable {
+  double w_phi[NLAYERS];
+  double w_z[NLAYERS];
+  int    layer[NRADII];
+
+  LayerTable() {
+    for (unsigned l=0; l<NLAYERS; ++l) {
+      w_phi[l]=1./(clusterWidth[l].rd_phi*clusterWidth[l].rd_phi);
+      w_z[l]=1./(clusterWidth[l].d_z*clusterWidth[l].d_z);
+    }
+    for (unsigned i=0; i<NRADII; ++i) {
+      layer[i]=-1;
+      for (unsigned l=0; l<NLAYERS; ++l)
+        if (std::abs(i+0.5-clusterWidth[l].r)<5) layer[i]=l;
+    }
   }
-  else
+};
+const LayerTable layerTable;
+
+// Weights of a stub; returns 0 if r is not in a layer
+inline int stubWeights(double r, double &w_phi, double &w_z)
+{
+  const int i=r;
+  const int l=(0<=i && i<(int) NRADII) ? layerTable.layer[i] : -1;
+  if (l<0 || !(std::abs(r-clusterWidth[l].r)<5))
   {
-    d_phi=-1;
-    d_z=-1;
+    w_phi=0;
+    w_z=0;
     return 0;
   }
+
+  w_phi=r*r*layerTable.w_phi[l];
+  w_z=layerTable.w_z[l];
   return 1;
 }
+}
 
 int stubUncertaintyFountain(double r, double &d_phi, double &d_z)
 {
@@ -198,44 +219,12 @@ int stubUncertaintyResidual(double r, double &d_phi, double &d_z)
   return 1;
 }
 
-int TrackFitterAlgoATF::fit(const TTRoadComb& acomb, TTTrack2& atrack)
+// _____________________________________________________________________________
+void TrackFitterAlgoATF::setTrack(const double * sums, unsigned nstubs, TTTrack2& atrack) const
 {
-  double A=0, B=0, C=0, D=0, E=0, F=0, G=0, H=0, I=0, J=0, K=0, L=0, M=0, P=0, Q=0;
-  unsigned nstubs = 0;
-  for (unsigned int i=0; i<acomb.stubs_phi.size(); ++i)
-  {
-    if (!acomb.stubs_bool.at(i))
-        continue;
-    ++nstubs;
+  const double A=sums[0], B=sums[1], C=sums[2], D=sums[3], E=sums[4], F=sums[5], G=sums[6], H=sums[7],
+               I=sums[8], J=sums[9], K=sums[10], L=sums[11], M=sums[12], P=sums[13], Q=sums[14];
 
-    double r=acomb.stubs_r.at(i);
-    double phi=acomb.stubs_phi.at(i);
-    double z=acomb.stubs_z.at(i);
-    
-    double d_phi=-1, d_z=-1;
-    if (!stubUncertaintyClusterWidth(r, d_phi, d_z)) {std::cout<<"ERROR: Unrecognized layer at r = "<<r<<std::endl; continue;}
-
-    double d_phi_sq=d_phi*d_phi;
-    double d_z_sq=d_z*d_z;
-
-    A+=phi/d_phi_sq;
-    B+=1./d_phi_sq;
-    C+=r/d_phi_sq;
-    D+=1./(r*d_phi_sq);
-    E+=r*phi/d_phi_sq;
-    F+=r*r/d_phi_sq;
-    G+=z*r/d_z_sq;
-    H+=r/d_z_sq;
-    I+=r*r/d_z_sq;
-    J+=phi/(r*d_phi_sq);
-    K+=1./(r*r*d_phi_sq);
-    L+=z/d_z_sq;
-    M+=1./d_z_sq;
-    
-    P+= phi*phi/d_phi_sq;
-    Q+= z*z/d_z_sq;
-  }
-  
   if (fiveParameters_)
   {  
     double denom1 = B*B*B - 2*B*C*D + D*D*F + C*C*K - B*F*K;
@@ -290,6 +279,46 @@ int TrackFitterAlgoATF::fit(const TTRoadComb& acomb, TTTrack2& atrack)
     
     atrack.setTrackParams(rinv, phi0, cottheta0, z0, 0, chi2, ndof, chi2_phi, chi2_z);
   }
+}
+
+// _____________________________________________________________________________
+int TrackFitterAlgoATF::fit(const TTRoadComb& acomb, TTTrack2& atrack)
+{
+  double A=0, B=0, C=0, D=0, E=0, F=0, G=0, H=0, I=0, J=0, K=0, L=0, M=0, P=0, Q=0;
+  unsigned nstubs = 0;
+  for (unsigned int i=0; i<acomb.stubs_phi.size(); ++i)
+  {
+    if (!acomb.stubs_bool.at(i))
+        continue;
+    ++nstubs;
+
+    double r=acomb.stubs_r.at(i);
+    double phi=acomb.stubs_phi.at(i);
+    double z=acomb.stubs_z.at(i);
+    
+    double w_phi=0, w_z=0;
+    if (!stubWeights(r, w_phi, w_z)) {std::cout<<"ERROR: Unrecognized layer at r = "<<r<<std::endl; continue;}
+    double r_inv=1./r;
+
+    A+=phi*w_phi;
+    B+=w_phi;
+    C+=r*w_phi;
+    D+=w_phi*r_inv;
+    E+=r*phi*w_phi;
+    F+=r*r*w_phi;
+    G+=z*r*w_z;
+    H+=r*w_z;
+    I+=r*r*w_z;
+    J+=phi*w_phi*r_inv;
+    K+=w_phi*r_inv*r_inv;
+    L+=z*w_z;
+    M+=w_z;
+    
+    P+=phi*phi*w_phi;
+    Q+=z*z*w_z;
+  }
 
+  const double sums[NSUMS] = {A, B, C, D, E, F, G, H, I, J, K, L, M, P, Q};
+  setTrack(sums, nstubs, atrack);
   return 0;
 }
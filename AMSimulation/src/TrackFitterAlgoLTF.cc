@@ -19,11 +19,7 @@ int TrackFitterAlgoLTF::fit(const TTRoadComb& acomb, TTTrack2& atrack) {
 
     atrack.setTrackParams(0.003 * 3.8 * pars[0], pars[1], pars[2], pars[3], 0, normChi2*ndof, ndof, 0, 0);
 
-    std::vector<float> principals_vec;
-    for (unsigned ivar=0; ivar<principals.size(); ++ivar) {
-        principals_vec.push_back(principals.at(ivar));
-    }
-    atrack.setPrincipals(principals_vec);
+    atrack.setPrincipals(principals.begin(), principals.end());
 
     return 0;
 }
@@ -1,7 +1,18 @@
 #include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoPCA.h"
 using namespace slhcl1tt;
 
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PCAMatrixBundle.h"
+
+#include <cmath>
 #include <iostream>
+#include <stdexcept>
+
+namespace {
+// The early rejection only rejects combinations that fail the selection by
+// more than this relative margin, so that it never drops a track that the
+// selection keeps because of a different rounding
+const double earlyRejectMargin = 1e-5;
+}
 
 
 // _____________________________________________________________________________
@@ -14,28 +25,164 @@ int TrackFitterAlgoPCA::bookHistograms() {
 // _____________________________________________________________________________
 int TrackFitterAlgoPCA::loadConstants() {
 
-    for (unsigned i=0; i<PCA_NSEGMENTS; ++i) {
-        for (unsigned j=0; j<PCA_NHITBITS; ++j) {
-            std::string filename = Form("matrix/matrices_tt%i_pt%i_hb%i.txt", tower_, i, j);
+    // Use the binary bundle if there is one, otherwise parse the text files
+    PCAMatrixBundle bundle;
+    std::string bin = Form("matrix/matrices_tt%i.bin", tower_);
+    if (bundle.open(datadir_ + bin) == 0) {
+        const PCAMatrixBundle::Header& header = bundle.header();
+        if (header.tower != tower_ || header.nsegments != PCA_NSEGMENTS || header.nhitbits != PCA_NHITBITS ||
+            header.nvariables != nvariables_ || header.nparameters != nparameters_) {
+            std::cout << "Incompatible matrix bundle " << datadir_ + bin << std::endl;
+            throw std::runtime_error("Incompatible matrix bundle.");
+        }
+
+        matrices.resize(bundle.size());
+        for (unsigned i=0; i<bundle.size(); ++i) {
+            bundle.get(i, matrices.at(i));
+            matrices.at(i).filename = datadir_ + bin;
+        }
+
+    } else {
+        for (unsigned i=0; i<PCA_NSEGMENTS; ++i) {
+            for (unsigned j=0; j<PCA_NHITBITS; ++j) {
+                std::string filename = Form("matrix/matrices_tt%i_pt%i_hb%i.txt", tower_, i, j);
 
-            PCAMatrix mat;
-            mat.read(datadir_ + filename);
-            assert(mat.nvariables == nvariables_ && mat.nparameters == nparameters_);
+                PCAMatrix mat;
+                mat.read(datadir_ + filename);
+                assert(mat.nvariables == nvariables_ && mat.nparameters == nparameters_);
 
-            matrices.push_back(mat);
+                matrices.push_back(mat);
+            }
         }
     }
 
+    // Make the fixed-size copies
+    if (view_ == XYZ && nvariables_ == 12 && (nparameters_ == 4 || nparameters_ == 5)) {
+        fixedMatrices.resize(matrices.size());
+        for (unsigned i=0; i<matrices.size(); ++i) {
+            const PCAMatrix& mat = matrices.at(i);
+            FixedMatrix& fmat = fixedMatrices.at(i);
+
+            fmat.meansR             = mat.meansR;
+            fmat.solutionsC         = mat.solutionsC;
+            fmat.solutionsT         = mat.solutionsT;
+            fmat.meansV             = mat.meansV;
+            fmat.invSqrtEigenvalues = mat.invSqrtEigenvalues;
+            fmat.V                  = mat.V;
+
+            fmat.meansP.setZero();
+            fmat.meansP.head(nparameters_) = mat.meansP;
+            fmat.DV.setZero();
+            fmat.DV.topRows(nparameters_) = mat.DV;
+        }
+
+        computeDowndateTerms();
+    }
+
     if (verbose_>2)
         print();
 
     return 0;
 }
 
+// _____________________________________________________________________________
+int TrackFitterAlgoPCA::computeDowndateTerms() {
+
+    // The chi2 of a 6/6 fit is the sum of the squares of the first
+    // (12 - nparameters) normalized principals
+    const unsigned nchi2 = nvariables_ - nparameters_;
+
+    downdateTerms.resize(PCA_NSEGMENTS * 6);
+    for (unsigned iseg=0; iseg<PCA_NSEGMENTS; ++iseg) {
+        const FixedMatrix& mat = fixedMatrices.at(iseg * PCA_NHITBITS);
+
+        for (unsigned layer=0; layer<6; ++layer) {
+            DowndateTerms& terms = downdateTerms.at(iseg * 6 + layer);
+            const unsigned cols[2] = {layer, layer + 6};  // phi, z
+
+            terms.W.setZero();
+            terms.K.setZero();
+            for (unsigned j=0; j<2; ++j) {
+                for (unsigned ivar=0; ivar<nchi2; ++ivar)
+                    terms.W(ivar, j) = mat.V(ivar, cols[j]) * mat.invSqrtEigenvalues(ivar);
+                terms.K.col(j) = mat.DV.col(cols[j]);
+            }
+
+            const Eigen::Matrix<double, 2, 2> H = terms.W.transpose() * terms.W;
+            const double det = H.determinant();
+            terms.valid = (std::isfinite(det) && det > 1e-12 * H(0,0) * H(1,1));
+            if (!terms.valid) {
+                terms.Hinv.setZero();
+                terms.K.setZero();
+                continue;
+            }
+            terms.Hinv = H.inverse();
+            terms.K = terms.K * terms.Hinv;
+        }
+    }
+    return 0;
+}
+
+// _____________________________________________________________________________
+bool TrackFitterAlgoPCA::fitFiveOfSix(const TTRoadComb& acomb, const TTTrack2& atrack6, TTTrack2& atrack) {
+    if (downdateTerms.empty() || acomb.hitBits < 1 || acomb.hitBits > 6)
+        return false;
+
+    // The 6/6 fit must have all its principals, so not be rejected early
+    const TTConstSpan<float> principals6 = atrack6.principals();
+    if (atrack6.ndof() < 0 || principals6.size() != 12)
+        return false;
+
+    const int iseg = acomb.ptSegment;
+    if (iseg < 0 || iseg >= (int) PCA_NSEGMENTS)
+        return false;
+
+    const DowndateTerms& terms = downdateTerms[iseg * 6 + acomb.hitBits - 1];
+    if (!terms.valid)
+        return false;
+
+    const unsigned nchi2 = nvariables_ - nparameters_;
+    FixedVector principals = FixedVector::Zero();
+    double chi2 = 0.;
+    for (unsigned ivar=0; ivar<nchi2; ++ivar) {
+        principals(ivar) = principals6[ivar];
+        chi2 += principals(ivar) * principals(ivar);
+    }
+
+    // Gradient of chi2/2 by the phi and z of the missing layer; moving them to
+    // the minimum removes u^T Hinv u from the chi2
+    const Eigen::Matrix<double, 2, 1> u = terms.W.transpose() * principals;
+    chi2 -= u.dot(terms.Hinv * u);
+    chi2 = std::max(chi2, 0.);
+
+    const Eigen::Matrix<double, 5, 1> dparameters = terms.K * u;
+    const double phi0     = atrack6.phi0()     - dparameters(0);
+    const double cottheta = atrack6.cottheta() - dparameters(1);
+    const double z0       = atrack6.z0()       - dparameters(2);
+    const double invPt    = atrack6.invPt()    - dparameters(3);
+
+    atrack = TTTrack2();
+    atrack.setTrackParams(0.003 * 3.8 * invPt, phi0, cottheta, z0, 0.,
+                          chi2, atrack6.ndof() - 2, 0., 0.);
+    return true;
+}
+
 // _____________________________________________________________________________
 int TrackFitterAlgoPCA::fit(const TTRoadComb& acomb, TTTrack2& atrack) {
 
     int imat = acomb.ptSegment * PCA_NHITBITS + acomb.hitBits;
+    if (imat < 0 || imat >= (int) matrices.size()) {
+        atrack = TTTrack2();
+        return 1;
+    }
+
+    if (!fixedMatrices.empty() && acomb.stubs_phi.size() == 6) {
+        if (nparameters_ == 4)
+            return fitXYZ<4>(acomb, atrack);
+        else
+            return fitXYZ<5>(acomb, atrack);
+    }
+
     const PCAMatrix& mat = matrices[imat];
 
     Eigen::VectorXd variables1 = Eigen::VectorXd::Zero(nvariables_/2);
@@ -73,8 +220,7 @@ int TrackFitterAlgoPCA::fit(const TTRoadComb& acomb, TTTrack2& atrack) {
     double chi2 = 0.;
     unsigned ndof = 0;
     for (unsigned ivar=begin_ivar; ivar<(nvariables_ - nparameters_); ++ivar) {
-        assert(mat.sqrtEigenvalues(ivar) > 0.);
-        chi2 += (principals(ivar)/mat.sqrtEigenvalues(ivar))*(principals(ivar)/mat.sqrtEigenvalues(ivar));
+        chi2 += (principals(ivar)*mat.invSqrtEigenvalues(ivar))*(principals(ivar)*mat.invSqrtEigenvalues(ivar));
         ndof += 1;
     }
     assert(ndof == 3 || ndof == 4 || ndof == 6 || ndof == 8);
@@ -89,13 +235,244 @@ int TrackFitterAlgoPCA::fit(const TTRoadComb& acomb, TTTrack2& atrack) {
         if (mat.sqrtEigenvalues(ivar) <= 0.)
             principals_vec.push_back(0.);
         else
-            principals_vec.push_back(principals(ivar)/mat.sqrtEigenvalues(ivar));
+            principals_vec.push_back(principals(ivar)*mat.invSqrtEigenvalues(ivar));
     }
     atrack.setPrincipals(principals_vec);
 
     return 0;
 }
 
+// _____________________________________________________________________________
+void TrackFitterAlgoPCA::getVariablesXYZ(const FixedMatrix& mat, const TTRoadComb& acomb, FixedVector& variables) const {
+    Eigen::Matrix<double, 6, 1> variables1, variables2, variables3;
+    for (unsigned istub=0; istub<6; ++istub) {
+        variables1(istub) = acomb.stubs_phi[istub];
+        variables2(istub) = acomb.stubs_z[istub];
+        variables3(istub) = mat.meansR(istub) - acomb.stubs_r[istub];
+    }
+
+    variables1 += (mat.solutionsC.dot(variables1)) * variables3;
+    variables2 += (mat.solutionsT.dot(variables2)) * variables3;
+
+    variables << variables1, variables2;
+}
+
+template<int NPAR>
+void TrackFitterAlgoPCA::getEarlyRowsXYZ(const unsigned hitBits, unsigned& first, unsigned& last) const {
+    if (!selection_.cutPrincipals) {
+        first = (1 <= hitBits && hitBits <= 6) ? 2 : 0;
+        last = 12 - NPAR;
+    } else {
+        first = 0;
+        last = 0;
+        for (unsigned ivar=0; ivar<PRINCIPAL_NCUTS6; ++ivar) {
+            if (PRINCIPAL_CUTS6[ivar] != -1)
+                last = ivar + 1;
+        }
+    }
+}
+
+bool TrackFitterAlgoPCA::failsSelectionXYZ(const FixedVector& principals, const unsigned first, const unsigned last) const {
+    if (!selection_.cutPrincipals) {
+        double chi2 = 0.;
+        for (unsigned ivar=first; ivar<last; ++ivar) {
+            chi2 += principals(ivar) * principals(ivar);
+        }
+        return chi2 > selection_.maxChi2 * (last - first) * (1. + earlyRejectMargin);
+    }
+
+    for (unsigned ivar=first; ivar<last; ++ivar) {
+        if (PRINCIPAL_CUTS6[ivar] != -1 && std::abs(principals(ivar)) > PRINCIPAL_CUTS6[ivar] * (1. + earlyRejectMargin))
+            return true;
+    }
+    return false;
+}
+
+template<int NPAR>
+void TrackFitterAlgoPCA::setTrackXYZ(const FixedVector& principals, const Eigen::Matrix<double, NPAR, 1>& parameters_fit,
+                                     const unsigned hitBits, TTTrack2& atrack) const {
+    const unsigned begin_ivar = (1 <= hitBits && hitBits <= 6) ? 2 : 0;
+    const unsigned end_ivar = 12 - NPAR;
+
+    double chi2 = 0.;
+    for (unsigned ivar=begin_ivar; ivar<end_ivar; ++ivar) {
+        chi2 += principals(ivar) * principals(ivar);
+    }
+    unsigned ndof = end_ivar - begin_ivar;
+
+    atrack.setTrackParams(0.003 * 3.8 * parameters_fit(3), parameters_fit(0), parameters_fit(1), parameters_fit(2), 0.,
+                          chi2, ndof, 0., 0.);
+
+    atrack.setPrincipals(principals.data(), principals.data() + 12);
+}
+
+// _____________________________________________________________________________
+template<int NPAR>
+int TrackFitterAlgoPCA::fitXYZ(const TTRoadComb& acomb, TTTrack2& atrack) const {
+
+    int imat = acomb.ptSegment * PCA_NHITBITS + acomb.hitBits;
+    const FixedMatrix& mat = fixedMatrices[imat];
+
+    FixedVector variables;
+    getVariablesXYZ(mat, acomb, variables);
+
+    FixedVector principals;
+
+    // Compute the principals needed by the selection first
+    if (earlyReject_) {
+        unsigned first = 0, last = 0;
+        getEarlyRowsXYZ<NPAR>(acomb.hitBits, first, last);
+        for (unsigned ivar=first; ivar<last; ++ivar) {
+            principals(ivar) = (mat.V.row(ivar).dot(variables) - mat.meansV(ivar)) * mat.invSqrtEigenvalues(ivar);
+        }
+        if (failsSelectionXYZ(principals, first, last)) {
+            atrack = TTTrack2();
+            return 0;
+        }
+    }
+
+    principals.noalias() = mat.V * variables;
+    principals -= mat.meansV;
+
+    Eigen::Matrix<double, NPAR, 1> parameters_fit;
+    parameters_fit.noalias() = mat.DV.template topRows<NPAR>() * variables;
+    parameters_fit -= mat.meansP.template head<NPAR>();
+
+    // Normalized principal components
+    principals = principals.cwiseProduct(mat.invSqrtEigenvalues);
+
+    setTrackXYZ<NPAR>(principals, parameters_fit, acomb.hitBits, atrack);
+    return 0;
+}
+
+// _____________________________________________________________________________
+int TrackFitterAlgoPCA::fitBatch(const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks) {
+    if (fixedMatrices.empty())
+        return TrackFitterAlgoBase::fitBatch(acombs, atracks);
+
+    if (nparameters_ == 4)
+        return fitBatchXYZ<4>(acombs, atracks);
+    else
+        return fitBatchXYZ<5>(acombs, atracks);
+}
+
+template<int NPAR>
+int TrackFitterAlgoPCA::fitBatchXYZ(const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks) {
+    const unsigned n = acombs.size();
+    const unsigned nmat = fixedMatrices.size();
+
+    atracks.clear();
+    atracks.resize(n);
+
+    // Sort the combinations by matrix (counting sort, keeps the order within
+    // a matrix). The two extra last buckets are for combinations that cannot
+    // use the fixed-size matrices, and for combinations without a matrix.
+    batchOffsets_.assign(nmat + 3, 0);
+    for (unsigned i=0; i<n; ++i) {
+        const TTRoadComb& acomb = acombs[i];
+        int imat = acomb.ptSegment * PCA_NHITBITS + acomb.hitBits;
+        if (imat < 0 || imat >= (int) nmat)
+            imat = nmat + 1;
+        else if (acomb.stubs_phi.size() != 6)
+            imat = nmat;
+        ++batchOffsets_[imat + 1];
+    }
+    for (unsigned imat=0; imat<=nmat+1; ++imat) {
+        batchOffsets_[imat + 1] += batchOffsets_[imat];
+    }
+
+    batchPositions_.assign(batchOffsets_.begin(), batchOffsets_.end() - 1);
+    batchOrder_.resize(n);
+    for (unsigned i=0; i<n; ++i) {
+        const TTRoadComb& acomb = acombs[i];
+        int imat = acomb.ptSegment * PCA_NHITBITS + acomb.hitBits;
+        if (imat < 0 || imat >= (int) nmat)
+            imat = nmat + 1;
+        else if (acomb.stubs_phi.size() != 6)
+            imat = nmat;
+        batchOrder_[batchPositions_[imat]++] = i;
+    }
+
+    // Workspace, grown only when needed
+    if (batchVariables_.cols() < n) {
+        batchVariables_ .resize(Eigen::NoChange, n);
+        batchPrincipals_.resize(Eigen::NoChange, n);
+        batchParameters_.resize(Eigen::NoChange, n);
+    }
+
+    int status = 0;
+
+    for (unsigned imat=0; imat<nmat; ++imat) {
+        const unsigned begin = batchOffsets_[imat];
+        const unsigned count = batchOffsets_[imat + 1] - begin;
+        if (count == 0)
+            continue;
+
+        const FixedMatrix& mat = fixedMatrices[imat];
+        const unsigned hitBits = imat % PCA_NHITBITS;
+
+        // One column per combination
+        FixedVector variables;
+        for (unsigned k=0; k<count; ++k) {
+            getVariablesXYZ(mat, acombs[batchOrder_[begin + k]], variables);
+            batchVariables_.col(k) = variables;
+        }
+
+        FixedVector principals;
+        Eigen::Matrix<double, NPAR, 1> parameters_fit;
+
+        // Compute the principals needed by the selection first, and keep
+        // only the combinations that pass. The tracks of the others are
+        // left empty.
+        unsigned nfit = count;
+        if (earlyReject_) {
+            unsigned first = 0, last = 0;
+            getEarlyRowsXYZ<NPAR>(hitBits, first, last);
+            const unsigned nrows = last - first;
+
+            batchPrincipals_.middleRows(first, nrows).leftCols(count).noalias() = mat.V.middleRows(first, nrows) * batchVariables_.leftCols(count);
+
+            nfit = 0;
+            for (unsigned k=0; k<count; ++k) {
+                principals.segment(first, nrows) = (batchPrincipals_.col(k).segment(first, nrows) - mat.meansV.segment(first, nrows)).cwiseProduct(mat.invSqrtEigenvalues.segment(first, nrows));
+                if (failsSelectionXYZ(principals, first, last))
+                    continue;
+
+                if (nfit != k) {
+                    batchVariables_.col(nfit) = batchVariables_.col(k);
+                    batchOrder_[begin + nfit] = batchOrder_[begin + k];
+                }
+                ++nfit;
+            }
+            if (nfit == 0)
+                continue;
+        }
+
+        // Transform all the combinations at once
+        batchPrincipals_.leftCols(nfit).noalias() = mat.V * batchVariables_.leftCols(nfit);
+        batchParameters_.topLeftCorner(NPAR, nfit).noalias() = mat.DV.template topRows<NPAR>() * batchVariables_.leftCols(nfit);
+
+        for (unsigned k=0; k<nfit; ++k) {
+            principals = (batchPrincipals_.col(k) - mat.meansV).cwiseProduct(mat.invSqrtEigenvalues);
+            parameters_fit = batchParameters_.col(k).template head<NPAR>() - mat.meansP.template head<NPAR>();
+
+            setTrackXYZ<NPAR>(principals, parameters_fit, hitBits, atracks[batchOrder_[begin + k]]);
+        }
+    }
+
+    // Fall back to the single fit
+    for (unsigned k=batchOffsets_[nmat]; k<batchOffsets_[nmat + 1]; ++k) {
+        const unsigned i = batchOrder_[k];
+        status |= fit(acombs[i], atracks[i]);
+    }
+
+    // The combinations without a matrix are not fitted, their tracks are
+    // left empty
+    if (batchOffsets_[nmat + 1] < n)
+        status = 1;
+    return status;
+}
+
 // _____________________________________________________________________________
 void TrackFitterAlgoPCA::print() {
     std::cout << "view: " << view_ << " nvariables: " << nvariables_ << " nparameters: " << nparameters_ << std::endl;
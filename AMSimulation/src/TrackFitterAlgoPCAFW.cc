@@ -0,0 +1,345 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackFitterAlgoPCAFW.h"
+using namespace slhcl1tt;
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+const int TrackFitterAlgoPCAFW::PARAMETER_FRAC_BITS[4] = {16, 12, 8, 16};
+
+namespace {
+// Round x * scale to the nearest integer, halfway cases away from zero
+inline int64_t digitize(double x, double scale) {
+    x *= scale;
+    return int64_t(x >= 0. ? x + 0.5 : x - 0.5);
+}
+
+// Round x * 2^shift to the nearest integer
+inline int64_t quantize(double x, int shift) {
+    return digitize(x, std::ldexp(1., shift));
+}
+
+// Saturate to a signed integer of the given width
+inline int32_t saturate(int64_t x, unsigned bits) {
+    const int64_t xmax = (int64_t(1) << (bits - 1)) - 1;
+    return std::max(-xmax, std::min(xmax, x));
+}
+
+// Divide by 2^shift with rounding
+inline int64_t roundShift(int64_t x, int shift) {
+    if (shift <= 0)
+        return x * (int64_t(1) << -shift);
+    return (x + (int64_t(1) << (shift - 1))) >> shift;
+}
+
+// Quantize a row of constants to the given width, return the scale as a shift
+int quantizeRow(const Eigen::RowVectorXd& row, unsigned bits, int16_t * out) {
+    const double maxabs = row.cwiseAbs().maxCoeff();
+    if (!(maxabs > 0.)) {
+        std::fill(out, out + row.size(), 0);
+        return 0;
+    }
+
+    const double limit = double((1 << (bits - 1)) - 1);
+    const int shift = std::min(48, int(std::floor(std::log2(limit / maxabs))));
+    for (unsigned j=0; j<row.size(); ++j) {
+        out[j] = saturate(quantize(row(j), shift), bits);
+    }
+    return shift;
+}
+}
+
+
+// _____________________________________________________________________________
+TrackFitterAlgoPCAFW::TrackFitterAlgoPCAFW(const slhcl1tt::ProgramOption& po)
+: TrackFitterAlgoPCA(po), stubBits_(po.fwStubBits), constBits_(po.fwConstBits) {
+
+    if (view_ != XYZ || nvariables_ != 12 || nparameters_ != 4)
+        throw std::invalid_argument("PCA4-FW fitter requires the XYZ view with 4 parameters.");
+
+    // The products are accumulated in 32 bits
+    if (stubBits_ < 4 || stubBits_ > 16 || constBits_ < 4 || constBits_ > 16 || stubBits_ + constBits_ > 28)
+        throw std::invalid_argument("PCA4-FW fitter requires 4-16 bits for stubs and constants, 28 bits in total.");
+
+    phiExp_ = stubBits_ - 1 - PHI_RANGE_BITS;
+    zExp_   = stubBits_ - 1 - Z_RANGE_BITS;
+    rExp_   = stubBits_ - 1 - R_RANGE_BITS;
+
+    phiScale_ = std::ldexp(1., phiExp_);
+    zScale_   = std::ldexp(1., zExp_);
+    rScale_   = std::ldexp(1., rExp_);
+
+    quantizeConstants();
+}
+
+// _____________________________________________________________________________
+int TrackFitterAlgoPCAFW::quantizeConstants() {
+
+    fwMatrices.resize(matrices.size());
+
+    for (unsigned imat=0; imat<matrices.size(); ++imat) {
+        const PCAMatrix& mat = matrices.at(imat);
+        FWMatrix& fmat = fwMatrices.at(imat);
+        std::memset(&fmat, 0, sizeof(FWMatrix));
+
+        // Centers of the stub coordinates, and their values as doubles
+        Eigen::VectorXd exps(12), centers(12);
+        for (unsigned j=0; j<12; ++j) {
+            exps(j) = (j < 6) ? phiExp_ : zExp_;
+            fmat.meansX[j] = quantize(mat.meansX(j), exps(j));
+            centers(j) = std::ldexp(double(fmat.meansX[j]), -exps(j));
+        }
+        for (unsigned j=0; j<6; ++j) {
+            fmat.meansR[j] = quantize(mat.meansR(j), rExp_);
+        }
+
+        // DeltaR correction: C = solutionsC * (centered phi) + solutionsC * centers
+        fmat.shiftC  = quantizeRow(mat.solutionsC.row(0), constBits_, fmat.solutionsC);
+        fmat.offsetC = quantize(mat.solutionsC.row(0).dot(centers.head(6)), fmat.shiftC + phiExp_);
+        fmat.shiftT  = quantizeRow(mat.solutionsT.row(0), constBits_, fmat.solutionsT);
+        fmat.offsetT = quantize(mat.solutionsT.row(0).dot(centers.tail(6)), fmat.shiftT + zExp_);
+
+        // Normalized principals
+        int16_t column[12];
+        for (unsigned i=0; i<12; ++i) {
+            Eigen::RowVectorXd row = mat.V.row(i) * mat.invSqrtEigenvalues(i);
+            for (unsigned j=0; j<12; ++j)
+                row(j) = std::ldexp(row(j), -exps(j));
+
+            fmat.shiftW[i]  = quantizeRow(row, constBits_, column);
+            fmat.offsetW[i] = quantize((mat.V.row(i).dot(centers) - mat.meansV(i)) * mat.invSqrtEigenvalues(i), fmat.shiftW[i]);
+            for (unsigned j=0; j<12; ++j)
+                fmat.W[j][i] = column[j];
+        }
+
+        // Track parameters
+        for (unsigned p=0; p<4; ++p) {
+            Eigen::RowVectorXd row = mat.DV.row(p);
+            for (unsigned j=0; j<12; ++j)
+                row(j) = std::ldexp(row(j), PARAMETER_FRAC_BITS[p] - exps(j));
+
+            fmat.shiftW[12 + p]  = quantizeRow(row, constBits_, column);
+            fmat.offsetW[12 + p] = quantize(std::ldexp(mat.DV.row(p).dot(centers) - mat.meansP(p), PARAMETER_FRAC_BITS[p]), fmat.shiftW[12 + p]);
+            for (unsigned j=0; j<12; ++j)
+                fmat.W[j][12 + p] = column[j];
+        }
+    }
+    return 0;
+}
+
+// _____________________________________________________________________________
+void TrackFitterAlgoPCAFW::getWordsFW(const FWMatrix& mat, const TTRoadComb& acomb, int16_t * variables) const {
+
+    // Digitize the stub coordinates
+    int16_t deltaR[6];
+    for (unsigned istub=0; istub<6; ++istub) {
+        variables[istub]     = saturate(digitize(acomb.stubs_phi[istub], phiScale_) - mat.meansX[istub]    , stubBits_);
+        variables[istub + 6] = saturate(digitize(acomb.stubs_z  [istub], zScale_  ) - mat.meansX[istub + 6], stubBits_);
+        deltaR[istub]        = saturate(mat.meansR[istub] - digitize(acomb.stubs_r[istub], rScale_), stubBits_);
+    }
+
+    // DeltaR correction
+    int32_t accC = 0, accT = 0;
+    for (unsigned j=0; j<6; ++j) {
+        accC += int32_t(mat.solutionsC[j]) * variables[j];
+        accT += int32_t(mat.solutionsT[j]) * variables[j + 6];
+    }
+    const int64_t valueC = accC + mat.offsetC;
+    const int64_t valueT = accT + mat.offsetT;
+    for (unsigned j=0; j<6; ++j) {
+        variables[j]     = saturate(variables[j]     + roundShift(valueC * deltaR[j], mat.shiftC + rExp_), stubBits_);
+        variables[j + 6] = saturate(variables[j + 6] + roundShift(valueT * deltaR[j], mat.shiftT + rExp_), stubBits_);
+    }
+}
+
+// _____________________________________________________________________________
+void TrackFitterAlgoPCAFW::getResultFW(const FWMatrix& mat, unsigned hitBits, const int32_t * acc, unsigned stride, FWResult& result) const {
+
+    for (unsigned i=0; i<12; ++i) {
+        result.principals[i] = roundShift(acc[i * stride] + mat.offsetW[i], mat.shiftW[i] - PRINCIPAL_FRAC_BITS);
+    }
+    for (unsigned p=0; p<4; ++p) {
+        result.parameters[p] = roundShift(acc[(12 + p) * stride] + mat.offsetW[12 + p], mat.shiftW[12 + p]);
+    }
+
+    // chi2
+    const unsigned begin_ivar = (1 <= hitBits && hitBits <= 6) ? 2 : 0;
+    const unsigned end_ivar = nvariables_ - nparameters_;
+
+    result.chi2 = 0;
+    for (unsigned ivar=begin_ivar; ivar<end_ivar; ++ivar) {
+        result.chi2 += int64_t(result.principals[ivar]) * result.principals[ivar];
+    }
+    result.ndof = end_ivar - begin_ivar;
+}
+
+// _____________________________________________________________________________
+int TrackFitterAlgoPCAFW::fitFW(const TTRoadComb& acomb, FWResult& result) const {
+
+    int imat = acomb.ptSegment * PCA_NHITBITS + acomb.hitBits;
+    if (imat < 0 || imat >= (int) fwMatrices.size() || acomb.stubs_phi.size() != 6)
+        return 1;
+    const FWMatrix& mat = fwMatrices[imat];
+
+    int16_t variables[12];
+    getWordsFW(mat, acomb, variables);
+
+    // Principals and track parameters
+    // (two variables at a time, so that the products of 16-bit pairs are
+    // summed before the 32-bit accumulation)
+    int32_t acc[16] = {0};
+    for (unsigned j=0; j<12; j+=2) {
+        for (unsigned i=0; i<16; ++i)
+            acc[i] += int32_t(mat.W[j][i]) * variables[j] + int32_t(mat.W[j + 1][i]) * variables[j + 1];
+    }
+
+    getResultFW(mat, acomb.hitBits, acc, 1, result);
+    return 0;
+}
+
+// _____________________________________________________________________________
+void TrackFitterAlgoPCAFW::setTrackFW(const FWResult& result, TTTrack2& atrack) const {
+
+    // The LSBs are powers of two, so the products are exact
+    static const double parameterLSB[4] = {
+        std::ldexp(1., -PARAMETER_FRAC_BITS[0]), std::ldexp(1., -PARAMETER_FRAC_BITS[1]),
+        std::ldexp(1., -PARAMETER_FRAC_BITS[2]), std::ldexp(1., -PARAMETER_FRAC_BITS[3])
+    };
+    static const double principalLSB = std::ldexp(1., -PRINCIPAL_FRAC_BITS);
+
+    float parameters[4];
+    for (unsigned p=0; p<4; ++p) {
+        parameters[p] = double(result.parameters[p]) * parameterLSB[p];
+    }
+    const double chi2 = double(result.chi2) * (principalLSB * principalLSB);
+
+    atrack.setTrackParams(0.003 * 3.8 * parameters[3], parameters[0], parameters[1], parameters[2], 0.,
+                          chi2, result.ndof, 0., 0.);
+
+    float principals[12];
+    for (unsigned ivar=0; ivar<12; ++ivar) {
+        principals[ivar] = double(result.principals[ivar]) * principalLSB;
+    }
+    atrack.setPrincipals(principals, principals + 12);
+}
+
+// _____________________________________________________________________________
+int TrackFitterAlgoPCAFW::fit(const TTRoadComb& acomb, TTTrack2& atrack) {
+
+    FWResult result;
+    int status = fitFW(acomb, result);
+    if (status != 0) {
+        atrack = TTTrack2();
+        return status;
+    }
+    setTrackFW(result, atrack);
+    return status;
+}
+
+// _____________________________________________________________________________
+// The combinations of a matrix are fitted four at a time. For the pair of
+// variables (2p, 2p+1), the words of four consecutive combinations are
+// contiguous, so that a 16-bit multiply-add of the pairs with the constants
+// (pmaddwd) gives the four 32-bit sums of the two products at once.
+int TrackFitterAlgoPCAFW::fitBatch(const std::vector<TTRoadComb>& acombs, std::vector<TTTrack2>& atracks) {
+    const unsigned n = acombs.size();
+    const unsigned nmat = fwMatrices.size();
+
+    atracks.clear();
+    atracks.resize(n);
+
+    // Sort the combinations by matrix (counting sort, keeps the order within
+    // a matrix). The extra last bucket is for combinations that have no
+    // matrix or do not have 6 stubs.
+    batchOffsets_.assign(nmat + 2, 0);
+    for (unsigned i=0; i<n; ++i) {
+        const TTRoadComb& acomb = acombs[i];
+        int imat = acomb.ptSegment * PCA_NHITBITS + acomb.hitBits;
+        if (imat < 0 || imat >= (int) nmat || acomb.stubs_phi.size() != 6)
+            imat = nmat;
+        ++batchOffsets_[imat + 1];
+    }
+    for (unsigned imat=0; imat<=nmat; ++imat) {
+        batchOffsets_[imat + 1] += batchOffsets_[imat];
+    }
+
+    batchPositions_.assign(batchOffsets_.begin(), batchOffsets_.end() - 1);
+    batchOrder_.resize(n);
+    for (unsigned i=0; i<n; ++i) {
+        const TTRoadComb& acomb = acombs[i];
+        int imat = acomb.ptSegment * PCA_NHITBITS + acomb.hitBits;
+        if (imat < 0 || imat >= (int) nmat || acomb.stubs_phi.size() != 6)
+            imat = nmat;
+        batchOrder_[batchPositions_[imat]++] = i;
+    }
+
+    int status = 0;
+
+    for (unsigned imat=0; imat<nmat; ++imat) {
+        const unsigned begin = batchOffsets_[imat];
+        const unsigned count = batchOffsets_[imat + 1] - begin;
+        if (count == 0)
+            continue;
+
+        const FWMatrix& mat = fwMatrices[imat];
+        const unsigned hitBits = imat % PCA_NHITBITS;
+
+        // Words of the combinations, padded with zeros to a multiple of 4:
+        // batchWords_[(p * ncols + k) * 2 + h] is variable 2p+h of combination k
+        const unsigned ncols = (count + 3) & ~3u;
+        if (batchWords_.size() < 12 * ncols) {
+            batchWords_.resize(12 * ncols);
+            batchAcc_  .resize(16 * ncols);
+        }
+        int16_t * words = &batchWords_[0];
+        int32_t * acc   = &batchAcc_[0];
+
+        int16_t variables[12];
+        for (unsigned k=0; k<ncols; ++k) {
+            if (k < count)
+                getWordsFW(mat, acombs[batchOrder_[begin + k]], variables);
+            else
+                std::fill(variables, variables + 12, 0);
+            for (unsigned j=0; j<12; ++j)
+                words[((j / 2) * ncols + k) * 2 + (j % 2)] = variables[j];
+        }
+
+        // acc[i * ncols + k] = sum over j of W[j][i] * variable j of combination k
+        for (unsigned i=0; i<16; ++i) {
+#if defined(__SSE2__)
+            __m128i w[6];
+            for (unsigned p=0; p<6; ++p)
+                w[p] = _mm_set1_epi32(int32_t(uint16_t(mat.W[2 * p][i]) | (uint32_t(uint16_t(mat.W[2 * p + 1][i])) << 16)));
+
+            for (unsigned k=0; k<ncols; k+=4) {
+                __m128i sum = _mm_setzero_si128();
+                for (unsigned p=0; p<6; ++p)
+                    sum = _mm_add_epi32(sum, _mm_madd_epi16(w[p], _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + (p * ncols + k) * 2))));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i * ncols + k), sum);
+            }
+#else
+            for (unsigned k=0; k<ncols; ++k) {
+                int32_t sum = 0;
+                for (unsigned p=0; p<6; ++p)
+                    sum += int32_t(mat.W[2 * p][i]) * words[(p * ncols + k) * 2] + int32_t(mat.W[2 * p + 1][i]) * words[(p * ncols + k) * 2 + 1];
+                acc[i * ncols + k] = sum;
+            }
+#endif
+        }
+
+        FWResult result;
+        for (unsigned k=0; k<count; ++k) {
+            getResultFW(mat, hitBits, acc + k, ncols, result);
+            setTrackFW(result, atracks[batchOrder_[begin + k]]);
+        }
+    }
+
+    // Those cannot be fitted, their tracks are left empty
+    if (batchOffsets_[nmat] < n)
+        status = 1;
+    return status;
+}
@@ -0,0 +1,36 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/TrackSelection.h"
+using namespace slhcl1tt;
+
+#include <cmath>
+
+
+// _____________________________________________________________________________
+bool slhcl1tt::PrincipalCuts(const TTConstSpan<float>& princes){
+  bool pass=true;
+  if(princes.size()==12) for(unsigned i=0; i<princes.size(); ++i){
+    if(PRINCIPAL_CUTS6[i]==-1) continue;
+    if(fabs(princes[i])>PRINCIPAL_CUTS6[i]){
+      pass=false;
+      break;
+    }
+  }
+  else for(unsigned i=0; i<princes.size(); ++i){
+    if(PRINCIPAL_CUTS5[i]==-1) continue;
+    if(fabs(princes[i])>PRINCIPAL_CUTS5[i]){
+      pass=false;
+      break;
+    }
+  }
+  return pass;
+}
+
+// _____________________________________________________________________________
+bool TrackSelection::pass(const TTTrack2& atrack) const {
+    // Tracks rejected during the fit have no ndof
+    if (atrack.ndof() < 0)
+        return false;
+
+    if (!cutPrincipals)
+        return atrack.chi2Red() < maxChi2;  // reduced chi^2 = chi^2 / ndof
+    return PrincipalCuts(atrack.principals());
+}
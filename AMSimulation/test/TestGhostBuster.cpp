@@ -0,0 +1,106 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/GhostBuster.h"
+using namespace slhcl1tt;
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <algorithm>
+#include <random>
+
+
+// _____________________________________________________________________________
+// Flag the ghost tracks by comparing all pairs (from the old version)
+void flagGhostTracks_pairwise(const GhostBuster& ghostBuster, std::vector<TTTrack2>& tracks, const unsigned threshold) {
+    for (unsigned itrack=0; itrack<tracks.size(); ++itrack) {  // all tracks
+        for (unsigned jtrack=0; jtrack<itrack; ++jtrack) {  // only non ghost tracks
+            if (tracks.at(jtrack).isGhost())  continue;
+
+            if (ghostBuster.isGhostTrack(tracks.at(jtrack).stubRefs(), tracks.at(itrack).stubRefs(), threshold))
+                tracks.at(itrack).setAsGhost();
+        }
+    }
+}
+
+// Random tracks with nlayers stubRefs, of which at most maxBad are BAD, and
+// exactly maxBad for the first track. The stubRefs are taken from a few values
+// per layer so that ghosts are common
+std::vector<TTTrack2> make_tracks(std::mt19937& gen, unsigned ntracks, unsigned nlayers, unsigned maxBad) {
+    std::uniform_int_distribution<unsigned> stub(0, 3);
+    std::uniform_int_distribution<unsigned> nbad(0, maxBad);
+
+    std::vector<TTTrack2> tracks(ntracks);
+    std::vector<unsigned> stubRefs(nlayers);
+    std::vector<unsigned> layers(nlayers);
+    for (unsigned i=0; i<nlayers; ++i)
+        layers.at(i) = i;
+
+    for (unsigned itrack=0; itrack<ntracks; ++itrack) {
+        for (unsigned i=0; i<nlayers; ++i)
+            stubRefs.at(i) = 10 * i + stub(gen);
+
+        std::shuffle(layers.begin(), layers.end(), gen);
+        const unsigned nbadLayers = (itrack == 0) ? maxBad : nbad(gen);
+        for (unsigned ibad=0; ibad<nbadLayers; ++ibad)
+            stubRefs.at(layers.at(ibad)) = GhostBuster::BAD;
+
+        tracks.at(itrack).setStubRefs(stubRefs);
+    }
+    return tracks;
+}
+
+
+// _____________________________________________________________________________
+// Unit test class
+class TestGhostBuster : public CppUnit::TestFixture  {
+
+CPPUNIT_TEST_SUITE(TestGhostBuster);
+CPPUNIT_TEST(testFlagGhostTracks);
+CPPUNIT_TEST(testFlagGhostTracksPairwise);
+CPPUNIT_TEST_SUITE_END();
+
+private:
+    GhostBuster * ghostBuster_;
+
+    // Compare flagGhostTracks() with the pairwise loop on random events
+    void compare(unsigned nevents, unsigned nlayers, unsigned maxBad, unsigned threshold) {
+        std::mt19937 gen(nevents + 100 * nlayers + 10 * maxBad + threshold);
+        std::uniform_int_distribution<unsigned> ntracks(1, 200);
+
+        for (unsigned ievt=0; ievt<nevents; ++ievt) {
+            std::vector<TTTrack2> tracks = make_tracks(gen, ntracks(gen), nlayers, maxBad);
+            std::vector<TTTrack2> tracks_pairwise = tracks;
+
+            ghostBuster_ -> flagGhostTracks(tracks, threshold);
+            flagGhostTracks_pairwise(*ghostBuster_, tracks_pairwise, threshold);
+
+            for (unsigned itrack=0; itrack<tracks.size(); ++itrack)
+                CPPUNIT_ASSERT_EQUAL(tracks_pairwise.at(itrack).isGhost(), tracks.at(itrack).isGhost());
+        }
+    }
+
+public:
+    void setUp() {
+        ghostBuster_ = new GhostBuster();
+    }
+
+    void tearDown() {
+        if (ghostBuster_)  delete ghostBuster_;
+    }
+
+    void testFlagGhostTracks() {
+        // 6/6 and 5/6 tracks, compared in buckets
+        for (unsigned threshold=1; threshold<=3; ++threshold) {
+            compare(200, 6, 0, threshold);
+            compare(200, 6, 1, threshold);
+        }
+    }
+
+    void testFlagGhostTracksPairwise() {
+        // As many layers as the tracks have may be masked out, then
+        // flagGhostTracks() falls back to the pairwise loop
+        for (unsigned threshold=1; threshold<=3; ++threshold) {
+            compare(50, 6, 7 - threshold, threshold);
+            compare(50, 3, 4 - threshold, threshold);
+        }
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestGhostBuster);
@@ -0,0 +1,221 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulation/interface/PairCombinationFactory.h"
+#include "SLHCL1TrackTriggerSimulations/AMSimulationDataFormats/interface/PairAssignment.h"
+using namespace slhcl1tt;
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <random>
+
+
+// _____________________________________________________________________________
+// Test PDDS combination building (from the old version, with nested loops)
+float old_Coarsener(float DeltaS, int precision, int layer) {
+    float Coarsed=0.;
+    if(layer<3) Coarsed = DeltaS-((int)(2*DeltaS)%(int)pow(2,3-(precision-1)))/2.;
+    else        Coarsed = DeltaS-((int)(2*DeltaS)%(int)pow(2,4-precision))/2.;
+    return Coarsed;
+}
+
+std::vector<PairAssignment> old_Stage1Pair(std::vector<std::pair<unsigned, float> > first, std::vector<std::pair<unsigned, float> > second, float cut) {
+    std::vector<PairAssignment> PairedOnes;
+    for(unsigned i=0; i<first.size(); ++i){
+        for(unsigned j=0; j<second.size(); ++j){
+            bool Survivor=true;
+            if(first[i].first==PairCombinationFactory::BAD && second[j].first==PairCombinationFactory::BAD) Survivor=false;
+            else if(fabs(first[i].second-second[j].second)>cut && !(first[i].first==PairCombinationFactory::BAD || second[j].first==PairCombinationFactory::BAD) ) Survivor=false;
+            PairedOnes.push_back(PairAssignment(first[i].first,second[j].first,Survivor));
+        }
+    }
+    return PairedOnes;
+}
+
+std::vector<std::vector<unsigned> > old_combine(const std::vector<std::vector<unsigned> >& groups, std::vector<std::vector<float> > DeltaS, bool FiveOfSix) {
+    std::vector<std::vector<unsigned> > combinations;
+    std::vector<std::vector<unsigned> > CombinationBase=groups;
+
+    unsigned ngroups = groups.size();
+    std::vector<std::vector<std::pair<unsigned, float> > > Layer;
+
+    for(unsigned i=0; i<ngroups; ++i){
+        if(!CombinationBase[i].size()){
+            CombinationBase[i].push_back(PairCombinationFactory::BAD);
+            DeltaS[i].push_back(999.);
+        }
+        else if(FiveOfSix){
+            CombinationBase[i].insert(CombinationBase[i].begin(),PairCombinationFactory::BAD);
+            DeltaS[i].insert(DeltaS[i].begin(),999.);
+        }
+    }
+
+    if(ngroups!=6) return combinations;
+    for(unsigned layer=0; layer<6; ++layer){
+        Layer.push_back(std::vector<std::pair<unsigned, float> >());
+        for(unsigned j=0; j<CombinationBase[layer].size(); ++j) Layer[layer].push_back(std::make_pair(CombinationBase[layer][j], old_Coarsener(DeltaS[layer][j],4,layer)));
+    }
+
+    std::vector<PairAssignment> Layer10=old_Stage1Pair(Layer[1],Layer[0],1.5);
+    std::vector<PairAssignment> Layer12=old_Stage1Pair(Layer[1],Layer[2],2.5);
+    std::vector<PairAssignment> Layer32=old_Stage1Pair(Layer[3],Layer[2],3.0);
+    std::vector<PairAssignment> Layer34=old_Stage1Pair(Layer[3],Layer[4],2.0);
+    std::vector<PairAssignment> Layer54=old_Stage1Pair(Layer[5],Layer[4],2.0);
+    unsigned l0=CombinationBase[0].size(), l2=CombinationBase[2].size(), l4=CombinationBase[4].size();
+
+    for(unsigned i=0; i<Layer10.size(); ++i){
+        for(unsigned j=0; j<Layer32.size(); ++j){
+            for(unsigned k=0; k<Layer54.size(); ++k){
+                if(!(Layer10[i].SurvivingPair * Layer32[j].SurvivingPair * Layer54[k].SurvivingPair)) continue;
+                int pos12=i/l0*l2+j%l2;
+                int pos34=j/l2*l4+k%l4;
+                if(!(Layer12[pos12].SurvivingPair * Layer34[pos34].SurvivingPair)) continue;
+                std::vector<unsigned> layers={Layer10[i].Stub2Address, Layer10[i].Stub1Address, Layer32[j].Stub2Address, Layer32[j].Stub1Address, Layer54[k].Stub2Address, Layer54[k].Stub1Address};
+
+                unsigned dummyCounter=0;
+                for(unsigned l=0; l<layers.size(); ++l) if(layers[l]==PairCombinationFactory::BAD) ++dummyCounter;
+                if(dummyCounter>1) continue;
+
+                combinations.push_back(layers);
+            }
+        }
+    }
+    return combinations;
+}
+
+// _____________________________________________________________________________
+// A random road: stubRefs per layer, their DeltaS per layer, and the DeltaS
+// of all the stubs indexed by stubRef
+struct TestRoad {
+    std::vector<std::vector<unsigned> > groups;
+    std::vector<std::vector<float> >    DeltaS;
+    std::vector<float>                  stubDeltaS;
+};
+
+TestRoad make_road(std::mt19937& gen, unsigned maxStubs, bool halfStrips) {
+    std::uniform_int_distribution<unsigned> nstubs(0, maxStubs);
+    std::uniform_int_distribution<unsigned> empty(0, 6);
+    std::uniform_int_distribution<int>      halfStrip(0, 15);
+    std::uniform_real_distribution<float>   deltaS(-4., 4.);
+
+    TestRoad road;
+    road.groups.resize(6);
+    road.DeltaS.resize(6);
+    for (unsigned layer=0; layer<6; ++layer) {
+        unsigned n = nstubs(gen);
+        if (empty(gen) == 0)  n = 0;
+
+        for (unsigned j=0; j<n; ++j) {
+            float ds = halfStrips ? halfStrip(gen) / 2. - 4. : deltaS(gen);
+            road.groups.at(layer).push_back(road.stubDeltaS.size());
+            road.DeltaS.at(layer).push_back(ds);
+            road.stubDeltaS.push_back(ds);
+        }
+    }
+    return road;
+}
+
+
+// _____________________________________________________________________________
+// Unit test class
+class TestPairCombinationFactory : public CppUnit::TestFixture  {
+
+CPPUNIT_TEST_SUITE(TestPairCombinationFactory);
+CPPUNIT_TEST(testCombine);
+CPPUNIT_TEST(testStartNext);
+CPPUNIT_TEST(testTruncation);
+CPPUNIT_TEST_SUITE_END();
+
+private:
+    PairCombinationFactory * factory_;
+
+    void assertEqual(const std::vector<std::vector<unsigned> >& expected, const std::vector<std::vector<unsigned> >& combinations) {
+        CPPUNIT_ASSERT_EQUAL(expected.size(), combinations.size());
+        for (unsigned i=0; i<expected.size(); ++i)
+            CPPUNIT_ASSERT(expected.at(i) == combinations.at(i));
+    }
+
+public:
+    void setUp() {
+        factory_ = new PairCombinationFactory();
+    }
+
+    void tearDown() {
+        if (factory_)  delete factory_;
+    }
+
+    void testCombine() {
+        // Identical sequence on 6000 random roads, with DeltaS in half strips
+        // or not, and with or without the 5/6 permutations
+        std::mt19937 gen(36);
+        for (unsigned iroad=0; iroad<3000; ++iroad) {
+            TestRoad road = make_road(gen, 5, iroad%2);
+            for (unsigned FiveOfSix=0; FiveOfSix<2; ++FiveOfSix) {
+                assertEqual(old_combine(road.groups, road.DeltaS, FiveOfSix),
+                            factory_ -> combine(road.groups, road.DeltaS, FiveOfSix));
+            }
+        }
+        CPPUNIT_ASSERT_EQUAL(0L, factory_ -> ntruncated());
+    }
+
+    void testStartNext() {
+        // Same with the DeltaS looked up by stubRef, and at most maxStubs
+        // stubs per layer
+        std::mt19937 gen(360);
+        std::vector<unsigned> combination;
+        for (unsigned iroad=0; iroad<3000; ++iroad) {
+            TestRoad road = make_road(gen, 5, iroad%2);
+            const unsigned maxStubs = 2 + iroad%4;
+
+            std::vector<std::vector<unsigned> > groups = road.groups;
+            std::vector<std::vector<float> > DeltaS = road.DeltaS;
+            for (unsigned layer=0; layer<6; ++layer) {
+                if (groups.at(layer).size() > maxStubs) {
+                    groups.at(layer).resize(maxStubs);
+                    DeltaS.at(layer).resize(maxStubs);
+                }
+            }
+
+            for (unsigned FiveOfSix=0; FiveOfSix<2; ++FiveOfSix) {
+                std::vector<std::vector<unsigned> > combinations;
+                factory_ -> start(road.groups, road.stubDeltaS, FiveOfSix, maxStubs);
+                while (factory_ -> next(combination))
+                    combinations.push_back(combination);
+
+                assertEqual(old_combine(groups, DeltaS, FiveOfSix), combinations);
+            }
+        }
+        CPPUNIT_ASSERT_EQUAL(0L, factory_ -> ntruncated());
+    }
+
+    void testTruncation() {
+        // A layer with more than MAX_STUBS stubs, dummy included, is cut at
+        // MAX_STUBS and the road is counted
+        std::mt19937 gen(3600);
+        TestRoad road = make_road(gen, 3, true);
+        road.groups.at(2).clear();
+        road.DeltaS.at(2).clear();
+        for (unsigned j=0; j<PairCombinationFactory::MAX_STUBS; ++j) {
+            road.groups.at(2).push_back(road.stubDeltaS.size());
+            road.DeltaS.at(2).push_back(0.);
+            road.stubDeltaS.push_back(0.);
+        }
+
+        std::vector<std::vector<unsigned> > groups = road.groups;
+        std::vector<std::vector<float> > DeltaS = road.DeltaS;
+        groups.at(2).resize(PairCombinationFactory::MAX_STUBS - 1);
+        DeltaS.at(2).resize(PairCombinationFactory::MAX_STUBS - 1);
+
+        assertEqual(old_combine(groups, DeltaS, true), factory_ -> combine(road.groups, road.DeltaS, true));
+        CPPUNIT_ASSERT_EQUAL(1L, factory_ -> ntruncated());
+
+        // Without the dummy, all the stubs fit
+        assertEqual(old_combine(road.groups, road.DeltaS, false), factory_ -> combine(road.groups, road.DeltaS, false));
+        CPPUNIT_ASSERT_EQUAL(1L, factory_ -> ntruncated());
+
+        // Cut at maxStubs first
+        std::vector<unsigned> combination;
+        factory_ -> start(road.groups, road.stubDeltaS, true, PairCombinationFactory::MAX_STUBS - 1);
+        CPPUNIT_ASSERT_EQUAL(1L, factory_ -> ntruncated());
+        factory_ -> start(road.groups, road.stubDeltaS, true, PairCombinationFactory::MAX_STUBS);
+        CPPUNIT_ASSERT_EQUAL(2L, factory_ -> ntruncated());
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPairCombinationFactory);
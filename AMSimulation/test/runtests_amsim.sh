@@ -22,6 +22,19 @@ PYTHONTEST=${CMSSW_BASE}/src/SLHCL1TrackTriggerSimulations/AMSimulation/python/t
 
 (amsim -T -i roads.root -o tracks.root -m matrices.txt -n 100 --timing) || die 'Failure during track fitting' $?
 #WONTFIX# (python ${PYTHONTEST}/testTrackFitting.py ${LOCAL_TOP_DIR}/tracks.root) || die 'Failure using testTrackFitting.py' $?
+(amsim -T -i roads.root -o tracks_j2.root -m matrices.txt -n 100 -j 2 --timing) || die 'Failure during track fitting with 2 threads' $?
+(python ${PYTHONTEST}/testSameTrees.py ${LOCAL_TOP_DIR}/tracks.root ${LOCAL_TOP_DIR}/tracks_j2.root) || die 'Failure using testSameTrees.py' $?
+(amsim -T -i roads.root -o tracks_downdate.root -m matrices.txt -n 100 --FiveOfSix --downdate --timing) || die 'Failure during track fitting with the 5/6 downdate' $?
+(amsim -T -i roads.root -o tracks_downdate_j2.root -m matrices.txt -n 100 --FiveOfSix --downdate -j 2 --parallelRoads 1 --timing) || die 'Failure during track fitting with the 5/6 downdate and the roads in parallel' $?
+(python ${PYTHONTEST}/testSameTrees.py ${LOCAL_TOP_DIR}/tracks_downdate.root ${LOCAL_TOP_DIR}/tracks_downdate_j2.root) || die 'Failure using testSameTrees.py' $?
+(amsim -T -i roads.root -o tracks_cache.root -m matrices.txt -n 100 --fitCache --timing) || die 'Failure during track fitting with the fit cache' $?
+(python ${PYTHONTEST}/testSameTrees.py ${LOCAL_TOP_DIR}/tracks.root ${LOCAL_TOP_DIR}/tracks_cache.root) || die 'Failure using testSameTrees.py' $?
+(amsim -T -i roads.root -o tracks_downdate_cache.root -m matrices.txt -n 100 --FiveOfSix --downdate --fitCache --timing) || die 'Failure during track fitting with the 5/6 downdate and the fit cache' $?
+(python ${PYTHONTEST}/testSameTrees.py ${LOCAL_TOP_DIR}/tracks_downdate.root ${LOCAL_TOP_DIR}/tracks_downdate_cache.root) || die 'Failure using testSameTrees.py' $?
+
+(amsim -RT -i test_ntuple.root -o tracks_fused.root -b bank.root -m matrices.txt -n 100 --timing) || die 'Failure during fused pattern recognition and track fitting' $?
+(amsim -RT -i test_ntuple.root -o tracks_pipeline.root -b bank.root -m matrices.txt -n 100 -j 2 --pipeline --timing) || die 'Failure during pipelined pattern recognition and track fitting' $?
+(python ${PYTHONTEST}/testSameTrees.py ${LOCAL_TOP_DIR}/tracks_fused.root ${LOCAL_TOP_DIR}/tracks_pipeline.root) || die 'Failure using testSameTrees.py' $?
 
 (amsim -A -i stubs.root -o attribs.root -b bank.root -n 100 --timing) || die 'Failure during pattern bank analysis' $?
 #WONTFIX# (python ${PYTHONTEST}/testBankAnalysis.py ${LOCAL_TOP_DIR}/attribs.root) || die 'Failure using testBankAnalysis.py' $?
@@ -1,32 +1,82 @@
 #ifndef AMSimulationDataFormats_TTTrack2_h_
 #define AMSimulationDataFormats_TTTrack2_h_
 
+#include <algorithm>
 #include <cmath>
+#include <stdexcept>
 #include <vector>
 #include <iosfwd>
 
 namespace slhcl1tt {
 
+// Read-only view of a contiguous range of elements
+template<typename T>
+class TTConstSpan {
+  public:
+    typedef const T * const_iterator;
+
+    TTConstSpan(const T * data, unsigned size) : data_(data), size_(size) {}
+
+    const T * data()                            const { return data_; }
+    unsigned size()                             const { return size_; }
+    bool empty()                                const { return size_ == 0; }
+
+    const_iterator begin()                      const { return data_; }
+    const_iterator end()                        const { return data_ + size_; }
+
+    const T& front()                            const { return data_[0]; }
+    const T& back()                             const { return data_[size_ - 1]; }
+
+    const T& operator[](unsigned i)             const { return data_[i]; }
+    const T& at(unsigned i)                     const {
+        if (i >= size_)  throw std::out_of_range("TTConstSpan::at");
+        return data_[i];
+    }
+
+    std::vector<T> toVector()                   const { return std::vector<T>(begin(), end()); }
+
+  private:
+    const T * data_;
+    unsigned  size_;
+};
+
+template<typename T>
+inline bool operator==(const TTConstSpan<T>& lhs, const TTConstSpan<T>& rhs) {
+    return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template<typename T>
+inline bool operator!=(const TTConstSpan<T>& lhs, const TTConstSpan<T>& rhs) {
+    return !(lhs == rhs);
+}
+
+
 // A thinner version of TTTrack
+// The stub refs and the principals are stored inline, so that the class is
+// trivially copyable and a track list is a single contiguous block. At most
+// MAX_STUBREFS stub refs and MAX_PRINCIPALS principals are kept, the extra
+// ones are dropped.
 class TTTrack2 {
   public:
+    static const unsigned MAX_STUBREFS = 8;
+    static const unsigned MAX_PRINCIPALS = 12;
+
     // Constructors
     TTTrack2()
     : rinv_(-999999.), phi0_(-999999.), cottheta_(-999999.), z0_(-999999.), d0_(-999999.),
       chi2_(-999999.), ndof_(-1), chi2_phi_(-999999.), chi2_z_(-999999.), 
       matchChi2_(-1),
       isGhost_(false), tpId_(-1), synTpId_(-2), tower_(99), hitBits_(0), ptSegment_(0), roadRef_(0), combRef_(0), patternRef_(0),
-      stubRefs_(), principals_() {}
+      nstubRefs_(0), nprincipals_(0), stubRefs_(), principals_() {}
+
+    TTTrack2(const TTTrack2& rhs) = default;
+    TTTrack2(TTTrack2&& rhs) = default;
 
-    TTTrack2(const TTTrack2& rhs)
-    : rinv_(rhs.rinv_), phi0_(rhs.phi0_), cottheta_(rhs.cottheta_), z0_(rhs.z0_), d0_(rhs.d0_),
-      chi2_(rhs.chi2_), ndof_(rhs.ndof_), chi2_phi_(rhs.chi2_phi_), chi2_z_(rhs.chi2_z_), 
-      matchChi2_(rhs.matchChi2_),
-      isGhost_(rhs.isGhost_), tpId_(rhs.tpId_), synTpId_(rhs.synTpId_), tower_(rhs.tower_), hitBits_(rhs.hitBits_), ptSegment_(rhs.ptSegment_), roadRef_(rhs.roadRef_), combRef_(rhs.combRef_), patternRef_(rhs.patternRef_),
-      stubRefs_(rhs.stubRefs_), principals_(rhs.principals_) {}
+    TTTrack2& operator=(const TTTrack2& rhs) = default;
+    TTTrack2& operator=(TTTrack2&& rhs) = default;
 
     // Destructor
-    ~TTTrack2() {}
+    ~TTTrack2() = default;
 
     // Setters
     void setTrackParams(float rinv, float phi0, float cottheta, float z0, float d0,
@@ -53,11 +103,21 @@ class TTTrack2 {
     void setCombRef(unsigned combRef)                       { combRef_ = combRef; }
     void setPatternRef(unsigned patternRef)                 { patternRef_ = patternRef; }
 
-    void addStubRef(unsigned stubRef)                       { stubRefs_.push_back(stubRef); }
-    void setStubRefs(const std::vector<unsigned>& stubRefs) { stubRefs_ = stubRefs; }
+    void addStubRef(unsigned stubRef)                       { if (nstubRefs_ < MAX_STUBREFS)  stubRefs_[nstubRefs_++] = stubRef; }
+    void setStubRefs(const std::vector<unsigned>& stubRefs) { setStubRefs(stubRefs.begin(), stubRefs.end()); }
+    template<typename It>
+    void setStubRefs(It first, It last) {
+        for (nstubRefs_ = 0; first != last && nstubRefs_ < MAX_STUBREFS; ++first)
+            stubRefs_[nstubRefs_++] = *first;
+    }
 
-    void addPrincipal(float principal)                      { principals_.push_back(principal); }
-    void setPrincipals(const std::vector<float>& principals){ principals_ = principals; }
+    void addPrincipal(float principal)                      { if (nprincipals_ < MAX_PRINCIPALS)  principals_[nprincipals_++] = principal; }
+    void setPrincipals(const std::vector<float>& principals){ setPrincipals(principals.begin(), principals.end()); }
+    template<typename It>
+    void setPrincipals(It first, It last) {
+        for (nprincipals_ = 0; first != last && nprincipals_ < MAX_PRINCIPALS; ++first)
+            principals_[nprincipals_++] = *first;
+    }
 
     // Getters
     float rinv()                                const { return rinv_; }
@@ -100,11 +160,11 @@ class TTTrack2 {
 
     unsigned patternRef()                       const { return patternRef_; }
 
-    std::vector<unsigned> stubRefs()            const { return stubRefs_; }
-    unsigned stubRef(int l)                     const { return stubRefs_.at(l); }
+    TTConstSpan<unsigned> stubRefs()            const { return TTConstSpan<unsigned>(stubRefs_, nstubRefs_); }
+    unsigned stubRef(int l)                     const { return stubRefs().at(l); }
 
-    std::vector<float> principals()             const { return principals_; }
-    float principal(int l)                      const { return principals_.at(l); }
+    TTConstSpan<float> principals()             const { return TTConstSpan<float>(principals_, nprincipals_); }
+    float principal(int l)                      const { return principals().at(l); }
 
     float pt(float B=3.8)                       const { return std::abs(0.003 * B / rinv()); }  // assume r is in cm, B is in Tesla
     float invPt(float B=3.8)                    const { return rinv() / (0.003 * B); }          // assume r is in cm, B is in Tesla
@@ -139,8 +199,10 @@ class TTTrack2 {
     unsigned roadRef_;
     unsigned combRef_;
     unsigned patternRef_;
-    std::vector<unsigned> stubRefs_;
-    std::vector<float>    principals_;
+    unsigned char nstubRefs_;
+    unsigned char nprincipals_;
+    unsigned stubRefs_[MAX_STUBREFS];
+    float    principals_[MAX_PRINCIPALS];
 };
 
 // _____________________________________________________________________________
@@ -1,6 +1,7 @@
 #ifndef AMSimulationIO_BasicReader_h_
 #define AMSimulationIO_BasicReader_h_
 
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/StubCache.h"
 #include "TChain.h"
 #include "TFile.h"
 #include "TFileCollection.h"
@@ -14,22 +15,78 @@
 namespace slhcl1tt {
 
 
+// _____________________________________________________________________________
+// Branch contents of one event, moved out of a reader by swapBuffers() and
+// moved back by a second call, e.g. before filling a writer whose tree shares
+// the branches of the reader. The vectors are swapped, not copied.
+class BranchBuffers {
+  public:
+    BranchBuffers() { rewind(); }
+
+    // Start again from the first branch
+    void rewind() {
+        floats_.next = ints_.next = unsigneds_.next = bools_.next = unsigneds2_.next = unsigneds3_.next = 0;
+    }
+
+    // Swap the next branch with *v; a null v is skipped
+    template <typename T>
+    void swap(std::vector<T>* v);
+
+  private:
+    template <typename T>
+    struct Store {
+        std::vector<std::vector<T> > buffers;
+        unsigned next;
+    };
+
+    Store<float>&                                store(float*)                                { return floats_; }
+    Store<int>&                                  store(int*)                                  { return ints_; }
+    Store<unsigned>&                             store(unsigned*)                             { return unsigneds_; }
+    Store<bool>&                                 store(bool*)                                 { return bools_; }
+    Store<std::vector<unsigned> >&               store(std::vector<unsigned>*)                { return unsigneds2_; }
+    Store<std::vector<std::vector<unsigned> > >& store(std::vector<std::vector<unsigned> >*) { return unsigneds3_; }
+
+    Store<float>                                floats_;
+    Store<int>                                  ints_;
+    Store<unsigned>                             unsigneds_;
+    Store<bool>                                 bools_;
+    Store<std::vector<unsigned> >               unsigneds2_;
+    Store<std::vector<std::vector<unsigned> > > unsigneds3_;
+};
+
+
 // _____________________________________________________________________________
 class BasicReader {
   public:
     BasicReader(int verbose=1);
     ~BasicReader();
 
+    // The source is a .root file, a .txt list of files, or a .cache file
+    // made by amsim --makeCache, from which the branches below are read
     int init(TString src, bool full=true);
 
+    // Read cache size in MB and background unzipping, see SetReadAhead();
+    // call before init()
+    void setReadAhead(int cacheSize, bool readAhead) {
+        readCacheSize_ = cacheSize;
+        readAhead_ = readAhead;
+    }
+
     template <typename T>
     void nullVectorElements(std::vector<T>* v, const std::vector<bool>& nulling);
 
     void nullStubs(const std::vector<bool>& nulling, bool full=true);
 
-    Long64_t loadTree(Long64_t entry) { return tchain->LoadTree(entry); }
+    Long64_t loadTree(Long64_t entry) { return cache_ ? cache_->loadEntry(entry) : tchain->LoadTree(entry); }
+
+    Int_t getEntry(Long64_t entry) { return cache_ ? cache_->getEntry(entry) : tchain->GetEntry(entry); }
+
+    // Swap the branches below with the buffers of an event
+    void swapBuffers(BranchBuffers& buffers);
 
-    Int_t getEntry(Long64_t entry) { return tchain->GetEntry(entry); }
+    // Connect the branches below to the columns of a stub cache
+    template <class Cache>
+    void connectCache(Cache& cache, bool full=true);
 
     TChain* getChain() { return tchain; }
 
@@ -60,6 +117,9 @@ class BasicReader {
 
   protected:
     TChain* tchain;
+    StubCacheReader* cache_;
+    int readCacheSize_;
+    bool readAhead_;
     int treenumber;
     const int verbose_;
 };
@@ -84,6 +144,41 @@ class BasicWriter {
 
 // _____________________________________________________________________________
 // Template implementation
+template <typename T>
+void BranchBuffers::swap(std::vector<T>* v) {
+    Store<T>& s = store(static_cast<T*>(0));
+    if (s.next == s.buffers.size())
+        s.buffers.push_back(std::vector<T>());
+    std::vector<T>& buffer = s.buffers.at(s.next++);
+    if (v)
+        v->swap(buffer);
+}
+
+template <class Cache>
+void BasicReader::connectCache(Cache& cache, bool full) {
+    cache.setAddress("genParts_pt"       , StubCacheFormat::GENPARTS, &(vp_pt));
+    cache.setAddress("genParts_eta"      , StubCacheFormat::GENPARTS, &(vp_eta));
+    cache.setAddress("genParts_phi"      , StubCacheFormat::GENPARTS, &(vp_phi));
+    cache.setAddress("genParts_vx"       , StubCacheFormat::GENPARTS, &(vp_vx));
+    cache.setAddress("genParts_vy"       , StubCacheFormat::GENPARTS, &(vp_vy));
+    cache.setAddress("genParts_vz"       , StubCacheFormat::GENPARTS, &(vp_vz));
+    cache.setAddress("genParts_charge"   , StubCacheFormat::GENPARTS, &(vp_charge));
+    if (full)  cache.setAddress("TTStubs_x"         , StubCacheFormat::TTSTUBS, &(vb_x));
+    if (full)  cache.setAddress("TTStubs_y"         , StubCacheFormat::TTSTUBS, &(vb_y));
+    cache.setAddress("TTStubs_z"         , StubCacheFormat::TTSTUBS, &(vb_z));
+    cache.setAddress("TTStubs_r"         , StubCacheFormat::TTSTUBS, &(vb_r));
+    cache.setAddress("TTStubs_eta"       , StubCacheFormat::TTSTUBS, &(vb_eta));
+    cache.setAddress("TTStubs_phi"       , StubCacheFormat::TTSTUBS, &(vb_phi));
+    cache.setAddress("TTStubs_coordx"    , StubCacheFormat::TTSTUBS, &(vb_coordx));
+    cache.setAddress("TTStubs_coordy"    , StubCacheFormat::TTSTUBS, &(vb_coordy));
+    cache.setAddress("TTStubs_trigBend"  , StubCacheFormat::TTSTUBS, &(vb_trigBend));
+    if (full)  cache.setAddress("TTStubs_roughPt"   , StubCacheFormat::TTSTUBS, &(vb_roughPt));
+    if (full)  cache.setAddress("TTStubs_clusWidth0", StubCacheFormat::TTSTUBS, &(vb_clusWidth0));
+    if (full)  cache.setAddress("TTStubs_clusWidth1", StubCacheFormat::TTSTUBS, &(vb_clusWidth1));
+    cache.setAddress("TTStubs_modId"     , StubCacheFormat::TTSTUBS, &(vb_modId));
+    cache.setAddress("TTStubs_tpId"      , StubCacheFormat::TTSTUBS, &(vb_tpId));
+}
+
 template <typename T>
 void BasicReader::nullVectorElements(std::vector<T>* v, const std::vector<bool>& nulling) {
     assert(v->size() == nulling.size());
@@ -33,6 +33,11 @@ TString Debug();
 
 void ResetDeleteBranches(TTree* tree);
 
+// Set up the read cache of a tree: cacheSize in MB (0: keep the default);
+// if readAhead, the baskets of the next entries are unzipped in a background
+// thread while the current entry is processed
+void SetReadAhead(TTree* tree, int cacheSize, bool readAhead);
+
 }  // namespace slhcl1tt
 
 #endif
@@ -0,0 +1,223 @@
+#ifndef AMSimulationIO_StubCache_h_
+#define AMSimulationIO_StubCache_h_
+
+#include "TString.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace slhcl1tt {
+
+// _____________________________________________________________________________
+// Columnar cache of the genParticle, stub and trkParticle branches of an
+// ntuple. The file is a header, a table of columns, the event offsets of each
+// collection, then the data of each column and the path of the source ntuple.
+// A column holds the values of one branch for all events back to back; the
+// elements of event i of a collection are [offsets[i], offsets[i+1]).
+// The readers map the file, so an event is copied out without decompressing
+// anything. The source ntuple is still opened for its tree structure, which
+// the writers clone.
+struct StubCacheFormat {
+    static const uint32_t VERSION = 1;
+
+    enum Collection { GENPARTS=0, TTSTUBS, TRKPARTS, NCOLLECTIONS };
+
+    enum Type { FLOAT=0, INT, UINT, BOOL };
+
+    struct Header {
+        char     magic[8];      // "STUBCACH"
+        uint32_t version;
+        uint32_t headerSize;
+        uint32_t columnSize;
+        uint32_t ncolumns;
+        uint64_t nevents;
+        uint64_t offsets[NCOLLECTIONS];  // file positions of the event offsets
+        uint64_t source;                 // file position of the source path
+        uint64_t sourceSize;
+    };
+
+    struct Column {
+        char     name[40];      // branch name
+        uint32_t collection;
+        uint32_t type;
+        uint64_t data;          // file position of the values
+    };
+};
+
+// Element types of the columns; bool is stored as one byte
+template <typename T> struct StubCacheTraits;
+template <> struct StubCacheTraits<float>    { typedef float    Storage; static const uint32_t type = StubCacheFormat::FLOAT; };
+template <> struct StubCacheTraits<int>      { typedef int32_t  Storage; static const uint32_t type = StubCacheFormat::INT;   };
+template <> struct StubCacheTraits<unsigned> { typedef uint32_t Storage; static const uint32_t type = StubCacheFormat::UINT;  };
+template <> struct StubCacheTraits<bool>     { typedef uint8_t  Storage; static const uint32_t type = StubCacheFormat::BOOL;  };
+
+
+// _____________________________________________________________________________
+class StubCacheReader : public StubCacheFormat {
+  public:
+    StubCacheReader(int verbose=1);
+    ~StubCacheReader();
+
+    int open(TString cache);
+
+    void close();
+
+    // Path of the ntuple the cache was made from
+    TString source() const;
+
+    Long64_t size() const { return header_ ? header_->nevents : 0; }
+
+    // Fill *address with the column of that branch at every getEntry(); the
+    // vector is created if *address is null
+    template <typename T>
+    void setAddress(const char* name, Collection collection, std::vector<T>** address);
+
+    // Number of columns requested by setAddress() that are not in the cache
+    unsigned nmissing() const { return nmissing_; }
+
+    Long64_t loadEntry(Long64_t entry) const { return (0 <= entry && entry < size()) ? entry : -2; }
+
+    Int_t getEntry(Long64_t entry);
+
+  private:
+    // Non-copyable, it owns the mapping and the vectors it created
+    StubCacheReader(const StubCacheReader&);
+    StubCacheReader& operator=(const StubCacheReader&);
+
+    const Column * findColumn(const char* name, Collection collection, uint32_t type);
+
+    struct Binding {
+        const char *     data;
+        const uint64_t * offsets;
+        void *           vec;
+        bool             owned;
+        Int_t (*load)(const char* data, uint64_t begin, uint64_t end, void* vec);
+        void  (*destroy)(void* vec);
+    };
+
+    template <typename T, typename S>
+    static Int_t loadColumn(const char* data, uint64_t begin, uint64_t end, void* vec) {
+        const S * first = reinterpret_cast<const S *>(data) + begin;
+        static_cast<std::vector<T> *>(vec)->assign(first, first + (end - begin));
+        return (end - begin) * sizeof(S);
+    }
+
+    template <typename T>
+    static void destroyColumn(void* vec) { delete static_cast<std::vector<T> *>(vec); }
+
+    void * data_;
+    std::size_t length_;
+    const Header * header_;
+    const Column * columns_;
+    std::vector<Binding> bindings_;
+    unsigned nmissing_;
+    const int verbose_;
+};
+
+
+// _____________________________________________________________________________
+class StubCacheWriter : public StubCacheFormat {
+  public:
+    StubCacheWriter(int verbose=1);
+    ~StubCacheWriter();
+
+    int init(TString out, TString source);
+
+    // Append *address at every fill()
+    template <typename T>
+    void setAddress(const char* name, Collection collection, std::vector<T>** address);
+
+    // Append the current event; returns 1 if the columns of a collection
+    // differ in size
+    int fill();
+
+    // Assemble the cache file; returns the number of events
+    Long64_t write();
+
+  private:
+    // Non-copyable, it owns the temporary files
+    StubCacheWriter(const StubCacheWriter&);
+    StubCacheWriter& operator=(const StubCacheWriter&);
+
+    void removeTemporaries();
+
+    struct Binding {
+        std::string    name;
+        uint32_t       collection;
+        uint32_t       type;
+        std::string    tmpname;
+        std::FILE *    tmpfile;
+        const void *   address;
+        uint64_t (*size)(const void* address);
+        void     (*append)(const void* address, std::vector<char>& buffer);
+    };
+
+    // A null vector counts as empty
+    template <typename T>
+    static uint64_t columnSize(const void* address) {
+        const std::vector<T> * v = *static_cast<std::vector<T> * const *>(address);
+        return v ? v->size() : 0;
+    }
+
+    template <typename T, typename S>
+    static void appendColumn(const void* address, std::vector<char>& buffer) {
+        const std::vector<T> * v = *static_cast<std::vector<T> * const *>(address);
+        buffer.resize(v ? v->size() * sizeof(S) : 0);
+        if (v)
+            std::copy(v->begin(), v->end(), reinterpret_cast<S *>(buffer.data()));
+    }
+
+    TString out_;
+    TString source_;
+    std::vector<Binding> bindings_;
+    std::vector<uint64_t> offsets_[NCOLLECTIONS];
+    std::vector<char> buffer_;
+    bool good_;
+    const int verbose_;
+};
+
+
+// _____________________________________________________________________________
+// Template implementation
+template <typename T>
+void StubCacheReader::setAddress(const char* name, Collection collection, std::vector<T>** address) {
+    typedef typename StubCacheTraits<T>::Storage S;
+    const Column * column = findColumn(name, collection, StubCacheTraits<T>::type);
+    if (!column)
+        return;
+
+    Binding binding;
+    binding.data    = static_cast<const char *>(data_) + column->data;
+    binding.offsets = reinterpret_cast<const uint64_t *>(static_cast<const char *>(data_) + header_->offsets[collection]);
+    binding.owned   = (*address == 0);
+    if (binding.owned)
+        *address = new std::vector<T>();
+    binding.vec     = *address;
+    binding.load    = &loadColumn<T, S>;
+    binding.destroy = &destroyColumn<T>;
+    bindings_.push_back(binding);
+}
+
+template <typename T>
+void StubCacheWriter::setAddress(const char* name, Collection collection, std::vector<T>** address) {
+    typedef typename StubCacheTraits<T>::Storage S;
+    Binding binding;
+    binding.name       = name;
+    binding.collection = collection;
+    binding.type       = StubCacheTraits<T>::type;
+    binding.tmpname    = (out_ + Form(".%u.tmp", unsigned(bindings_.size()))).Data();
+    binding.tmpfile    = std::fopen(binding.tmpname.c_str(), "w+b");
+    binding.address    = address;
+    binding.size       = &columnSize<T>;
+    binding.append     = &appendColumn<T, S>;
+    if (!binding.tmpfile || binding.name.size() >= sizeof(Column().name))
+        good_ = false;
+    bindings_.push_back(binding);
+}
+
+}  // namespace slhcl1tt
+
+#endif
@@ -15,6 +15,8 @@ class TTRoadReader : public TTStubPlusTPReader {
 
     int init(TString src, TString prefix, TString suffix);
 
+    void swapBuffers(BranchBuffers& buffers);
+
     // Roads
     std::vector<unsigned> *                             vr_patternRef;
     std::vector<unsigned> *                             vr_tower;
@@ -16,6 +16,15 @@ class TTStubPlusTPReader : public BasicReader {
 
     void nullParticles(const std::vector<bool>& nulling, bool full=true);
 
+    void swapBuffers(BranchBuffers& buffers);
+
+    // Connect the branches to the columns of a stub cache
+    template <class Cache>
+    void connectCache(Cache& cache, bool full=true) {
+        BasicReader::connectCache(cache, full);
+        connectParticleCache(cache);
+    }
+
     // trkParticle information
     std::vector<float> *          vp2_pt;
     std::vector<float> *          vp2_eta;
@@ -28,6 +37,10 @@ class TTStubPlusTPReader : public BasicReader {
     std::vector<bool> *           vp2_signal;
     std::vector<bool> *           vp2_intime;
     std::vector<bool> *           vp2_primary;
+
+  protected:
+    template <class Cache>
+    void connectParticleCache(Cache& cache);
 };
 
 
@@ -42,6 +55,24 @@ class TTStubPlusTPWriter : public BasicWriter {
     void fill();
 };
 
+
+// _____________________________________________________________________________
+// Template implementation
+template <class Cache>
+void TTStubPlusTPReader::connectParticleCache(Cache& cache) {
+    cache.setAddress("trkParts_pt"       , StubCacheFormat::TRKPARTS, &(vp2_pt));
+    cache.setAddress("trkParts_eta"      , StubCacheFormat::TRKPARTS, &(vp2_eta));
+    cache.setAddress("trkParts_phi"      , StubCacheFormat::TRKPARTS, &(vp2_phi));
+    cache.setAddress("trkParts_vx"       , StubCacheFormat::TRKPARTS, &(vp2_vx));
+    cache.setAddress("trkParts_vy"       , StubCacheFormat::TRKPARTS, &(vp2_vy));
+    cache.setAddress("trkParts_vz"       , StubCacheFormat::TRKPARTS, &(vp2_vz));
+    cache.setAddress("trkParts_charge"   , StubCacheFormat::TRKPARTS, &(vp2_charge));
+    cache.setAddress("trkParts_pdgId"    , StubCacheFormat::TRKPARTS, &(vp2_pdgId));
+    cache.setAddress("trkParts_signal"   , StubCacheFormat::TRKPARTS, &(vp2_signal));
+    cache.setAddress("trkParts_intime"   , StubCacheFormat::TRKPARTS, &(vp2_intime));
+    cache.setAddress("trkParts_primary"  , StubCacheFormat::TRKPARTS, &(vp2_primary));
+}
+
 }  // namespace slhcl1tt
 
 #endif
@@ -29,15 +29,29 @@ BasicReader::BasicReader(int verbose)
   vb_modId            (0),
   vb_tpId             (0),
   //
+  tchain              (0),
+  cache_              (0),
+  readCacheSize_      (0),
+  readAhead_          (false),
   verbose_(verbose) {}
 
 BasicReader::~BasicReader() {
+    if (cache_)  delete cache_;
     if (tchain)  delete tchain;
 }
 
 int BasicReader::init(TString src, bool full) {
+    // The events are read from the cache, the ntuple it was made from only
+    // provides the tree structure
+    if (src.EndsWith(".cache")) {
+        cache_ = new StubCacheReader(verbose_);
+        if (cache_->open(src))
+            return 1;
+        src = cache_->source();
+    }
+
     if (!src.EndsWith(".root") && !src.EndsWith(".txt")) {
-        std::cout << Error() << "Input source must be either .root or .txt" << std::endl;
+        std::cout << Error() << "Input source must be either .root, .txt or .cache" << std::endl;
         return 1;
     }
 
@@ -109,6 +123,14 @@ int BasicReader::init(TString src, bool full) {
     if (full)  tchain->SetBranchStatus("TTStubs_clusWidth1", 1);
     tchain->SetBranchStatus("TTStubs_modId"     , 1);
     tchain->SetBranchStatus("TTStubs_tpId"      , 1);
+
+    if (cache_) {
+        connectCache(*cache_, full);
+        if (cache_->nmissing())
+            return 1;
+    } else {
+        SetReadAhead(tchain, readCacheSize_, readAhead_);
+    }
     return 0;
 }
 
@@ -129,6 +151,31 @@ void BasicReader::nullStubs(const std::vector<bool>& nulling, bool full) {
     nullVectorElements(vb_tpId      , nulling);
 }
 
+void BasicReader::swapBuffers(BranchBuffers& buffers) {
+    buffers.rewind();
+    buffers.swap(vp_pt        );
+    buffers.swap(vp_eta       );
+    buffers.swap(vp_phi       );
+    buffers.swap(vp_vx        );
+    buffers.swap(vp_vy        );
+    buffers.swap(vp_vz        );
+    buffers.swap(vp_charge    );
+    buffers.swap(vb_x         );
+    buffers.swap(vb_y         );
+    buffers.swap(vb_z         );
+    buffers.swap(vb_r         );
+    buffers.swap(vb_eta       );
+    buffers.swap(vb_phi       );
+    buffers.swap(vb_coordx    );
+    buffers.swap(vb_coordy    );
+    buffers.swap(vb_trigBend  );
+    buffers.swap(vb_roughPt   );
+    buffers.swap(vb_clusWidth0);
+    buffers.swap(vb_clusWidth1);
+    buffers.swap(vb_modId     );
+    buffers.swap(vb_tpId      );
+}
+
 
 // _____________________________________________________________________________
 BasicWriter::BasicWriter(int verbose)
@@ -121,5 +121,19 @@ void ResetDeleteBranches (TTree* tree) {
     }
 }
 
+void SetReadAhead(TTree* tree, int cacheSize, bool readAhead) {
+    if (cacheSize <= 0 && !readAhead)
+        return;
+
+    // The unzipping thread is attached to the cache when it is created
+    if (readAhead)
+        TTree::SetParallelUnzip(kTRUE);
+
+    // Only the branches read during the first entries are cached, which are
+    // the active ones
+    tree->SetCacheSize(cacheSize > 0 ? Long64_t(cacheSize) << 20 : -1);
+    tree->SetCacheLearnEntries(10);
+}
+
 }  // namespace slhcl1tt
 
@@ -0,0 +1,284 @@
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/StubCache.h"
+
+#include "SLHCL1TrackTriggerSimulations/AMSimulationIO/interface/Helper.h"
+using namespace slhcl1tt;
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const char magic[8] = {'S','T','U','B','C','A','C','H'};
+
+// Column data start on 64-byte boundaries
+const uint64_t alignment = 64;
+
+uint64_t align(uint64_t pos) {
+    return (pos + alignment - 1) / alignment * alignment;
+}
+
+bool writeAt(std::FILE* f, uint64_t pos, const void* data, uint64_t size) {
+    return std::fseek(f, pos, SEEK_SET) == 0 && std::fwrite(data, 1, size, f) == size;
+}
+
+// Append the content of a temporary file at the current position
+bool copyFile(std::FILE* from, std::FILE* to, std::vector<char>& buffer) {
+    buffer.resize(1 << 20);
+    std::rewind(from);
+    size_t n = 0;
+    while ((n = std::fread(buffer.data(), 1, buffer.size(), from)) > 0) {
+        if (std::fwrite(buffer.data(), 1, n, to) != n)
+            return false;
+    }
+    return !std::ferror(from);
+}
+}
+
+
+// _____________________________________________________________________________
+StubCacheReader::StubCacheReader(int verbose)
+: data_(0), length_(0), header_(0), columns_(0), nmissing_(0), verbose_(verbose) {}
+
+StubCacheReader::~StubCacheReader() {
+    close();
+}
+
+int StubCacheReader::open(TString cache) {
+    close();
+
+    int fd = ::open(cache.Data(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << Error() << "Failed to open " << cache << std::endl;
+        return 1;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(Header)) {
+        ::close(fd);
+        std::cout << Error() << "Failed to read " << cache << std::endl;
+        return 1;
+    }
+
+    length_ = st.st_size;
+    data_ = ::mmap(0, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data_ == MAP_FAILED) {
+        data_ = 0;
+        std::cout << Error() << "Failed to map " << cache << std::endl;
+        return 1;
+    }
+
+    header_  = static_cast<const Header *>(data_);
+    columns_ = reinterpret_cast<const Column *>(static_cast<const char *>(data_) + sizeof(Header));
+
+    bool good = std::memcmp(header_->magic, magic, sizeof(magic)) == 0 &&
+                header_->version == VERSION &&
+                header_->headerSize == sizeof(Header) &&
+                header_->columnSize == sizeof(Column) &&
+                sizeof(Header) + header_->ncolumns * sizeof(Column) <= length_ &&
+                header_->source + header_->sourceSize <= length_;
+    for (unsigned i=0; good && i<NCOLLECTIONS; ++i) {
+        good = header_->offsets[i] % sizeof(uint64_t) == 0 &&
+               header_->offsets[i] + (header_->nevents + 1) * sizeof(uint64_t) <= length_;
+    }
+    if (!good) {
+        close();
+        std::cout << Error() << "Incompatible stub cache " << cache << std::endl;
+        return 1;
+    }
+
+    if (verbose_)  std::cout << Info() << "Successfully mapped " << cache << " with " << size() << " events from " << source() << std::endl;
+    return 0;
+}
+
+void StubCacheReader::close() {
+    for (unsigned i=0; i<bindings_.size(); ++i) {
+        if (bindings_.at(i).owned)
+            bindings_.at(i).destroy(bindings_.at(i).vec);
+    }
+    bindings_.clear();
+    nmissing_ = 0;
+
+    if (data_)
+        ::munmap(data_, length_);
+    data_ = 0;
+    length_ = 0;
+    header_ = 0;
+    columns_ = 0;
+}
+
+TString StubCacheReader::source() const {
+    if (!header_)
+        return TString();
+    return TString(static_cast<const char *>(data_) + header_->source, header_->sourceSize);
+}
+
+const StubCacheFormat::Column * StubCacheReader::findColumn(const char* name, Collection collection, uint32_t type) {
+    for (unsigned i=0; header_ && i<header_->ncolumns; ++i) {
+        const Column& column = columns_[i];
+        if (std::strncmp(column.name, name, sizeof(column.name)) != 0)
+            continue;
+
+        const uint64_t nvalues = reinterpret_cast<const uint64_t *>(static_cast<const char *>(data_) + header_->offsets[collection])[header_->nevents];
+        const uint64_t size = (type == BOOL) ? 1 : 4;
+        if (column.collection != (uint32_t) collection || column.type != type || column.data + nvalues * size > length_)
+            break;
+        return &column;
+    }
+
+    std::cout << Error() << "Stub cache has no column " << name << " of the requested type" << std::endl;
+    ++nmissing_;
+    return 0;
+}
+
+Int_t StubCacheReader::getEntry(Long64_t entry) {
+    if (loadEntry(entry) < 0)
+        return 0;
+
+    Int_t nbytes = 0;
+    for (unsigned i=0; i<bindings_.size(); ++i) {
+        const Binding& binding = bindings_[i];
+        nbytes += binding.load(binding.data, binding.offsets[entry], binding.offsets[entry + 1], binding.vec);
+    }
+    return nbytes;
+}
+
+
+// _____________________________________________________________________________
+StubCacheWriter::StubCacheWriter(int verbose)
+: good_(true), verbose_(verbose) {}
+
+StubCacheWriter::~StubCacheWriter() {
+    removeTemporaries();
+}
+
+int StubCacheWriter::init(TString out, TString source) {
+    if (!out.EndsWith(".cache")) {
+        std::cout << Error() << "Output filename must be .cache" << std::endl;
+        return 1;
+    }
+
+    out_ = out;
+    source_ = source;
+    for (unsigned i=0; i<NCOLLECTIONS; ++i)
+        offsets_[i].assign(1, 0);
+    return 0;
+}
+
+void StubCacheWriter::removeTemporaries() {
+    for (unsigned i=0; i<bindings_.size(); ++i) {
+        Binding& binding = bindings_.at(i);
+        if (binding.tmpfile) {
+            std::fclose(binding.tmpfile);
+            std::remove(binding.tmpname.c_str());
+        }
+        binding.tmpfile = 0;
+    }
+}
+
+int StubCacheWriter::fill() {
+    if (!good_) {
+        std::cout << Error() << "Failed to open the temporary files of " << out_ << std::endl;
+        return 1;
+    }
+
+    // All the columns of a collection must have the same size
+    uint64_t sizes[NCOLLECTIONS];
+    bool found[NCOLLECTIONS] = {false};
+    for (unsigned i=0; i<bindings_.size(); ++i) {
+        const Binding& binding = bindings_.at(i);
+        const uint64_t size = binding.size(binding.address);
+        if (!found[binding.collection]) {
+            sizes[binding.collection] = size;
+            found[binding.collection] = true;
+        } else if (sizes[binding.collection] != size) {
+            std::cout << Error() << "Column " << binding.name << " has " << size << " elements instead of " << sizes[binding.collection] << std::endl;
+            return 1;
+        }
+    }
+
+    for (unsigned i=0; i<bindings_.size(); ++i) {
+        Binding& binding = bindings_.at(i);
+        binding.append(binding.address, buffer_);
+        if (std::fwrite(buffer_.data(), 1, buffer_.size(), binding.tmpfile) != buffer_.size()) {
+            std::cout << Error() << "Failed to write " << binding.tmpname << std::endl;
+            good_ = false;
+            return 1;
+        }
+    }
+
+    for (unsigned i=0; i<NCOLLECTIONS; ++i)
+        offsets_[i].push_back(offsets_[i].back() + (found[i] ? sizes[i] : 0));
+    return 0;
+}
+
+Long64_t StubCacheWriter::write() {
+    const uint64_t nevents = offsets_[0].size() - 1;
+
+    // Layout
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version    = VERSION;
+    header.headerSize = sizeof(Header);
+    header.columnSize = sizeof(Column);
+    header.ncolumns   = bindings_.size();
+    header.nevents    = nevents;
+
+    uint64_t pos = sizeof(Header) + bindings_.size() * sizeof(Column);
+    for (unsigned i=0; i<NCOLLECTIONS; ++i) {
+        pos = align(pos);
+        header.offsets[i] = pos;
+        pos += offsets_[i].size() * sizeof(uint64_t);
+    }
+
+    std::vector<Column> columns(bindings_.size());
+    std::memset(columns.data(), 0, columns.size() * sizeof(Column));
+    for (unsigned i=0; i<bindings_.size(); ++i) {
+        const Binding& binding = bindings_.at(i);
+        Column& column = columns.at(i);
+        std::strncpy(column.name, binding.name.c_str(), sizeof(column.name) - 1);
+        column.collection = binding.collection;
+        column.type       = binding.type;
+
+        pos = align(pos);
+        column.data = pos;
+        pos += offsets_[binding.collection].back() * ((binding.type == BOOL) ? 1 : 4);
+    }
+
+    header.source     = pos;
+    header.sourceSize = source_.Length();
+
+    // Write
+    if (verbose_)  std::cout << Info() << "Opening " << out_ << std::endl;
+    std::FILE* f = std::fopen(out_.Data(), "wb");
+    if (!f) {
+        std::cout << Error() << "Failed to open " << out_ << std::endl;
+        return -1;
+    }
+
+    bool good = good_ &&
+                writeAt(f, 0, &header, sizeof(Header)) &&
+                writeAt(f, sizeof(Header), columns.data(), columns.size() * sizeof(Column));
+    for (unsigned i=0; good && i<NCOLLECTIONS; ++i) {
+        good = writeAt(f, header.offsets[i], offsets_[i].data(), offsets_[i].size() * sizeof(uint64_t));
+    }
+    for (unsigned i=0; good && i<bindings_.size(); ++i) {
+        Binding& binding = bindings_.at(i);
+        good = std::fflush(binding.tmpfile) == 0 &&
+               std::fseek(f, columns.at(i).data, SEEK_SET) == 0 &&
+               copyFile(binding.tmpfile, f, buffer_);
+    }
+    good = good && writeAt(f, header.source, source_.Data(), header.sourceSize);
+    good = (std::fclose(f) == 0) && good;
+    removeTemporaries();
+
+    if (!good) {
+        std::cout << Error() << "Failed to write " << out_ << std::endl;
+        std::remove(out_.Data());
+        return -1;
+    }
+    return nevents;
+}
@@ -18,6 +18,11 @@ TTRoadReader::TTRoadReader(int verbose)
 TTRoadReader::~TTRoadReader() {}
 
 int TTRoadReader::init(TString src, TString prefix, TString suffix) {
+    if (src.EndsWith(".cache")) {
+        std::cout << Error() << "Roads cannot be read from a stub cache" << std::endl;
+        return 1;
+    }
+
     if (TTStubPlusTPReader::init(src))
         return 1;
 
@@ -31,6 +36,16 @@ int TTRoadReader::init(TString src, TString prefix, TString suffix) {
     return 0;
 }
 
+void TTRoadReader::swapBuffers(BranchBuffers& buffers) {
+    TTStubPlusTPReader::swapBuffers(buffers);
+    buffers.swap(vr_patternRef   );
+    buffers.swap(vr_tower        );
+    buffers.swap(vr_nstubs       );
+    buffers.swap(vr_patternInvPt );
+    buffers.swap(vr_superstripIds);
+    buffers.swap(vr_stubRefs     );
+}
+
 
 // _____________________________________________________________________________
 TTRoadWriter::TTRoadWriter(int verbose)
@@ -49,6 +49,12 @@ int TTStubPlusTPReader::init(TString src, bool full) {
     tchain->SetBranchStatus("trkParts_signal"   , 1);
     tchain->SetBranchStatus("trkParts_intime"   , 1);
     tchain->SetBranchStatus("trkParts_primary"  , 1);
+
+    if (cache_) {
+        connectParticleCache(*cache_);
+        if (cache_->nmissing())
+            return 1;
+    }
     return 0;
 }
 
@@ -66,6 +72,21 @@ void TTStubPlusTPReader::nullParticles(const std::vector<bool>& nulling, bool fu
     //nullVectorElements(vp2_primary   , nulling);  // don't null this guy
 }
 
+void TTStubPlusTPReader::swapBuffers(BranchBuffers& buffers) {
+    BasicReader::swapBuffers(buffers);
+    buffers.swap(vp2_pt        );
+    buffers.swap(vp2_eta       );
+    buffers.swap(vp2_phi       );
+    buffers.swap(vp2_vx        );
+    buffers.swap(vp2_vy        );
+    buffers.swap(vp2_vz        );
+    buffers.swap(vp2_charge    );
+    buffers.swap(vp2_pdgId     );
+    buffers.swap(vp2_signal    );
+    buffers.swap(vp2_intime    );
+    buffers.swap(vp2_primary   );
+}
+
 
 // _____________________________________________________________________________
 TTStubPlusTPWriter::TTStubPlusTPWriter(int verbose)
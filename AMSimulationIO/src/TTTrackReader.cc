@@ -216,8 +216,8 @@ void TTTrackWriter::fill(const std::vector<TTTrack2>& tracks) {
         vt_roadRef         ->push_back(track.roadRef());
         vt_combRef         ->push_back(track.combRef());
         vt_patternRef      ->push_back(track.patternRef());
-        vt_stubRefs        ->push_back(track.stubRefs());
-        vt_principals      ->push_back(track.principals());
+        vt_stubRefs        ->push_back(track.stubRefs().toVector());
+        vt_principals      ->push_back(track.principals().toVector());
     }
 
     ttree->Fill();